@@ -71,6 +71,7 @@ struct clientsocket_s
 struct cmds_ctx_s
 {
 	player_ctx_t *player;
+	sink_t *sink;
 	const char *socketpath;
 	pthread_t threadrecv;
 	pthread_t threadsend;
@@ -87,7 +88,9 @@ struct cmds_ctx_s
 #include "cmds.h"
 #include "media.h"
 #include "decoder.h"
+#include "encoder.h"
 #include "src.h"
+#include "sink.h"
 
 #define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
 #define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
@@ -1273,6 +1276,97 @@ static int method_capabilities(json_t *json_params, json_t **result, void *userd
 }
 
 
+#ifdef ENCODER_EFFORT
+static int method_effort(json_t *json_params, json_t **result, void *userdata)
+{
+	cmds_ctx_t *ctx = (cmds_ctx_t *)userdata;
+
+	encoder_effort_t *effort = NULL;
+	encoder_t *encoder = player_encoder(ctx->player, 0);
+	if (encoder != NULL && encoder->ops->effort != NULL)
+		effort = encoder->ops->effort(encoder->ctx);
+	if (effort == NULL)
+	{
+		*result = jsonrpc_error_object(JSONRPC_INVALID_REQUEST, "Method not available", json_null());
+		return -1;
+	}
+	int level = effort->level;
+	json_t *value = NULL;
+	if (json_is_object(json_params))
+	{
+		value = json_object_get(json_params, "margin");
+		if (value && json_is_integer(value))
+		{
+			int margin = json_integer_value(value);
+			if (margin > 90)
+				margin = 90;
+			if (margin < 0)
+				margin = 0;
+			effort->margin = margin;
+		}
+		value = json_object_get(json_params, "adaptive");
+		if (value && json_is_boolean(value))
+			effort->adaptive = json_is_true(value);
+		value = json_object_get(json_params, "level");
+		if (value && json_is_integer(value))
+		{
+			/**
+			 * the encoder changes the level on the next frame
+			 */
+			level = json_integer_value(value);
+			if (level >= effort->nlevels)
+				level = effort->nlevels - 1;
+			if (level < 0)
+				level = 0;
+			effort->request = level;
+		}
+	}
+	*result = json_object();
+	json_object_set(*result, "encoder", json_string(encoder->ops->name));
+	json_object_set(*result, "level", json_integer(level));
+	json_object_set(*result, "levels", json_integer(effort->nlevels));
+	json_object_set(*result, "adaptive", json_boolean(effort->adaptive && effort->request < 0));
+	json_object_set(*result, "margin", json_integer(effort->margin));
+	json_object_set(*result, "load", json_integer(effort->load));
+	return 0;
+}
+#endif
+
+#ifdef RTP_RTCP
+static int method_receivers(json_t *json_params, json_t **result, void *userdata)
+{
+	cmds_ctx_t *ctx = (cmds_ctx_t *)userdata;
+
+	sink_t *sink = ctx->sink;
+	if (sink == NULL || sink->ops->receivers == NULL)
+	{
+		*result = jsonrpc_error_object(JSONRPC_INVALID_REQUEST, "Method not available", json_null());
+		return -1;
+	}
+	sink_receiver_t *receivers = calloc(SINK_MAXRECEIVERS, sizeof(*receivers));
+	int nreceivers = sink->ops->receivers(sink->ctx, receivers, SINK_MAXRECEIVERS);
+	time_t now = time(NULL);
+	*result = json_array();
+	int i;
+	for (i = 0; i < nreceivers; i++)
+	{
+		json_t *receiver = json_object();
+		json_object_set(receiver, "ssrc", json_integer(receivers[i].ssrc));
+		json_object_set(receiver, "address", json_string(receivers[i].address));
+		json_object_set(receiver, "fractionlost", json_real(receivers[i].fraction / 256.0));
+		json_object_set(receiver, "lost", json_integer(receivers[i].lost));
+		json_object_set(receiver, "highest", json_integer(receivers[i].highest));
+		json_object_set(receiver, "jitter", json_integer(receivers[i].jitter));
+		json_object_set(receiver, "rtt", json_integer(receivers[i].rtt));
+		json_object_set(receiver, "delay", json_integer(receivers[i].delay));
+		json_object_set(receiver, "age", json_integer(now - receivers[i].last));
+		json_array_append_new(*result, receiver);
+	}
+	free(receivers);
+	return 0;
+}
+#endif
+
 static struct jsonrpc_method_entry_t method_table[] = {
 	{ 'r', "capabilities", method_capabilities, "o" },
 	{ 'r', "play", method_play, "" },
@@ -1292,6 +1386,12 @@ static struct jsonrpc_method_entry_t method_table[] = {
 	{ 'r', "options", method_options, "o" },
 	{ 'r', "volume", method_volume, "o" },
 	{ 'r', "getposition", method_getposition, "" },
+#ifdef ENCODER_EFFORT
+	{ 'r', "effort", method_effort, "o" },
+#endif
+#ifdef RTP_RTCP
+	{ 'r', "receivers", method_receivers, "" },
+#endif
 	{ 0, NULL },
 };
 
@@ -1705,6 +1805,7 @@ static void *_cmds_json_pthreadrecv(void *arg)
 
 static int cmds_json_run(cmds_ctx_t *ctx, sink_t *sink)
 {
+	ctx->sink = sink;
 	pthread_create(&ctx->threadsend, NULL, _cmds_json_pthreadsend, (void *)ctx);
 	/**
 	 * wait that the sending loop is ready
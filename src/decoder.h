@@ -17,6 +17,11 @@ struct decoder_ops_s
 	decoder_ctx_t *(*init)(player_ctx_t *);
 	int (*checkin)(decoder_ctx_t *ctx, const char *path);
 	jitter_t *(*jitter)(decoder_ctx_t *decoder, jitte_t jitte);
+	/**
+	 * optional: the whole stream is available into memory,
+	 * the decoder reads it without jitter.
+	 */
+	int (*map)(decoder_ctx_t *decoder, const unsigned char *buffer, size_t length);
 	int (*checkout)(decoder_ctx_t *decoder, jitter_format_t format);
 	int (*prepare)(decoder_ctx_t *, filter_t *, const char *info);
 	int (*run)(decoder_ctx_t *, jitter_t *);
@@ -42,4 +47,7 @@ extern const decoder_ops_t *decoder_mad;
 extern const decoder_ops_t *decoder_flac;
 extern const decoder_ops_t *decoder_faad2;
 extern const decoder_ops_t *decoder_passthrough;
+extern const decoder_ops_t *decoder_l16;
+extern const decoder_ops_t *decoder_l24;
+extern const decoder_ops_t *decoder_opus;
 #endif
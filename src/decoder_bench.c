@@ -0,0 +1,471 @@
+/*****************************************************************************
+ * decoder_bench.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "player.h"
+#include "decoder.h"
+#include "filter.h"
+#include "jitter.h"
+#include "media.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define bench_dbg(...)
+
+/**
+ * the decoders run alone: the stream comes from memory,
+ * the samples go to a jitter without heartbeat and without sink.
+ */
+#define OUT_NBBUFFERS 4
+#define OUT_BUFFERSIZE 8192
+#define DEFAULT_FILTERCHAIN "pcm?boost=6&stats&mono=mixed"
+
+static const char *jitter_name = "bench";
+
+struct player_ctx_s
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	state_t state;
+};
+
+/**
+ * the decoders signal the end of the stream to the player
+ */
+state_t player_state(player_ctx_t *ctx, state_t state)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	if (state != STATE_UNKNOWN)
+	{
+		ctx->state = state;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	state = ctx->state;
+	pthread_mutex_unlock(&ctx->mutex);
+	return state;
+}
+
+/**
+ * the media libraries are linked with media_common.c but unused
+ */
+int player_mediaid(player_ctx_t *ctx)
+{
+	return -1;
+}
+
+#ifdef __GLIBC__
+/**
+ * all the allocations of the process, libraries included,
+ * are counted during the decoding.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+static unsigned long _bench_nallocs = 0;
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&_bench_nallocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&_bench_nallocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&_bench_nallocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+#define bench_nallocs() __atomic_load_n(&_bench_nallocs, __ATOMIC_RELAXED)
+#else
+#define bench_nallocs() 0
+#endif
+
+typedef struct bench_stream_s bench_stream_t;
+struct bench_stream_s
+{
+	const unsigned char *data;
+	size_t length;
+	size_t offset;
+	unsigned long long outlength;
+};
+
+typedef struct bench_result_s bench_result_t;
+struct bench_result_s
+{
+	double audio;
+	double wall;
+	double cpu;
+	unsigned long nallocs;
+};
+
+static int _bench_read(void *arg, unsigned char *buffer, size_t size)
+{
+	bench_stream_t *stream = (bench_stream_t *)arg;
+	size_t length = stream->length - stream->offset;
+	if (length > size)
+		length = size;
+	memcpy(buffer, stream->data + stream->offset, length);
+	stream->offset += length;
+	return length;
+}
+
+static int _bench_write(void *arg, unsigned char *buffer, size_t size)
+{
+	bench_stream_t *stream = (bench_stream_t *)arg;
+	stream->outlength += size;
+	return size;
+}
+
+static double _bench_diff(struct timespec *start, struct timespec *stop)
+{
+	return (stop->tv_sec - start->tv_sec) + (stop->tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static unsigned char *_bench_load(const char *path, size_t *length)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		err("bench: open %s error %s", path, strerror(errno));
+		return NULL;
+	}
+	struct stat filestat;
+	fstat(fd, &filestat);
+	unsigned char *data = malloc(filestat.st_size);
+	size_t offset = 0;
+	while (data != NULL && offset < filestat.st_size)
+	{
+		ssize_t ret = read(fd, data + offset, filestat.st_size - offset);
+		if (ret <= 0)
+		{
+			err("bench: read %s error %s", path, strerror(errno));
+			free(data);
+			data = NULL;
+			break;
+		}
+		offset += ret;
+	}
+	close(fd);
+	*length = offset;
+	return data;
+}
+
+/**
+ * the synthetic stream is a triangle tone of 1 kHz on the left and 500 Hz
+ * on the right, big endian and interleaved like an RTP payload.
+ * It is decoded by the raw PCM decoders, without media file.
+ */
+#define TONE_FREQUENCE 1000
+#define TONE_NCHANNELS 2
+static unsigned char *_bench_tone(unsigned char samplesize, unsigned int seconds, size_t *length)
+{
+	unsigned int samplerate = DEFAULT_SAMPLERATE;
+	size_t nframes = (size_t)samplerate * seconds;
+	unsigned char *data = malloc(nframes * samplesize * TONE_NCHANNELS);
+	if (data == NULL)
+		return NULL;
+	int32_t max = (1 << (samplesize * 8 - 1)) - 1;
+	unsigned char *buffer = data;
+	size_t i;
+	for (i = 0; i < nframes; i++)
+	{
+		int j;
+		for (j = 0; j < TONE_NCHANNELS; j++)
+		{
+			unsigned int period = samplerate / (TONE_FREQUENCE >> j);
+			unsigned int phase = i % period;
+			int64_t sample = (int64_t)4 * max * phase / period;
+			if (phase < period / 2)
+				sample = sample - max;
+			else
+				sample = 3 * (int64_t)max - sample;
+			int k;
+			for (k = samplesize - 1; k >= 0; k--)
+				*buffer++ = (uint32_t)sample >> (k * 8);
+		}
+	}
+	*length = buffer - data;
+	return data;
+}
+
+static int _bench_run(player_ctx_t *player, const char *mime, const unsigned char *data, size_t length,
+		const char *filtername, jitter_format_t format, int usemap, bench_result_t *result)
+{
+	bench_stream_t stream = { .data = data, .length = length};
+	decoder_t *decoder = decoder_build(player, mime);
+	if (decoder == NULL)
+	{
+		err("bench: decoder not found for %s", mime);
+		return -1;
+	}
+	jitter_t *out = jitter_init(JITTER_TYPE_SG, jitter_name, OUT_NBBUFFERS, OUT_BUFFERSIZE);
+	if (out == NULL)
+	{
+		decoder->ops->destroy(decoder->ctx);
+		free(decoder);
+		return -1;
+	}
+	out->format = format;
+	out->ctx->frequence = 0; // automatic freq
+	out->ctx->consume = _bench_write;
+	out->ctx->consumer = &stream;
+
+	/**
+	 * the decoder reads the jitter from its own thread,
+	 * like with src_file
+	 */
+	if (!usemap || decoder->ops->map == NULL ||
+		decoder->ops->map(decoder->ctx, data, length) < 0)
+	{
+		jitter_t *in = decoder->ops->jitter(decoder->ctx, JITTE_LOW);
+		if (in == NULL)
+		{
+			decoder->ops->destroy(decoder->ctx);
+			free(decoder);
+			jitter_destroy(out);
+			return -1;
+		}
+		in->ctx->produce = _bench_read;
+		in->ctx->producter = &stream;
+	}
+	filter_t *filter = NULL;
+	if (decoder->ops->checkout(decoder->ctx, out->format))
+		filter = filter_build(filtername, out, NULL);
+	decoder->filter = filter;
+
+	player->state = STATE_PLAY;
+	unsigned long nallocs = bench_nallocs();
+	struct timespec start, stop, cpustart, cpustop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpustart);
+
+	int ret = 0;
+	if (decoder->ops->prepare)
+		ret = decoder->ops->prepare(decoder->ctx, filter, NULL);
+	if (ret == 0)
+		ret = decoder->ops->run(decoder->ctx, out);
+	if (ret == 0)
+	{
+		pthread_mutex_lock(&player->mutex);
+		while (player->state == STATE_PLAY)
+			pthread_cond_wait(&player->cond, &player->mutex);
+		pthread_mutex_unlock(&player->mutex);
+	}
+	else
+		err("bench: decoder %s error", decoder->ops->name);
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpustop);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	result->nallocs = bench_nallocs() - nallocs;
+	result->wall = _bench_diff(&start, &stop);
+	result->cpu = _bench_diff(&cpustart, &cpustop);
+	result->audio = 0;
+	unsigned int framesize = FORMAT_SAMPLESIZE(format) / 8 * FORMAT_NCHANNELS(format);
+	if (jitter_samplerate(out) > 0 && framesize > 0)
+		result->audio = (double)stream.outlength / framesize / jitter_samplerate(out);
+
+	decoder->ops->destroy(decoder->ctx);
+	free(decoder);
+	jitter_destroy(out);
+	return ret;
+}
+
+static jitter_format_t _bench_format(int bits)
+{
+	switch (bits)
+	{
+	case 16:
+		return PCM_16bits_LE_stereo;
+	case 24:
+		return PCM_24bits4_LE_stereo;
+	}
+	return PCM_32bits_LE_stereo;
+}
+
+static void _bench_print(const char *path, const char *decoder, const char *chain, bench_result_t *result)
+{
+	double realtime = (result->wall > 0)? result->audio / result->wall: 0;
+	double cpu = (result->audio > 0)? result->cpu * 1000 / result->audio: 0;
+	fprintf(stdout, "%s\t%s\t%s\t%.1f x realtime\t%.3f ms cpu/s\t%lu allocs\t%.1f s audio\n",
+		path, decoder, chain, realtime, cpu, result->nallocs, result->audio);
+}
+
+static int _bench_input(player_ctx_t *player, const char *path, const char *mime,
+		const unsigned char *data, size_t length, const char *chains[],
+		jitter_format_t format, int usemap, int loops)
+{
+	int j;
+	for (j = 0; j < 2; j++)
+	{
+		bench_result_t total = {0};
+		int k;
+		for (k = 0; k < loops; k++)
+		{
+			bench_result_t result = {0};
+			if (_bench_run(player, mime, data, length, chains[j], format, usemap, &result) < 0)
+				return -1;
+			total.audio += result.audio;
+			total.wall += result.wall;
+			total.cpu += result.cpu;
+			total.nallocs += result.nallocs;
+		}
+		total.nallocs /= loops;
+		total.audio /= loops;
+		total.wall /= loops;
+		total.cpu /= loops;
+		_bench_print(path, utils_mime2mime(mime), chains[j], &total);
+	}
+	return 0;
+}
+
+static void _bench_usage(const char *name)
+{
+	fprintf(stderr, "%s [-n <loops>][-b 16|24|32][-f <filtername>][-m][-t <mime>][-s <seconds>] [<file> ...]\n", name);
+	fprintf(stderr, "\t-n <loops>\tdecode each file several times and print the average\n");
+	fprintf(stderr, "\t-b <bits>\tsamples size of the output\n");
+	fprintf(stderr, "\t-f <filtername>\tfilter chain to compare with \"pcm\" (default %s)\n", DEFAULT_FILTERCHAIN);
+	fprintf(stderr, "\t-m\tmap the file into the decoder when it is possible\n");
+	fprintf(stderr, "\t-t <mime>\tforce the mime type of the files\n");
+	fprintf(stderr, "\t-s <seconds>\tdecode a synthetic tone with the raw PCM decoders\n");
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 1;
+	int bits = 32;
+	int usemap = 0;
+	const char *filterchain = DEFAULT_FILTERCHAIN;
+	const char *forcemime = NULL;
+	unsigned int seconds = 0;
+	int opt;
+	do
+	{
+		opt = getopt(argc, argv, "n:b:f:mt:s:h");
+		switch (opt)
+		{
+			case 'n':
+				loops = atoi(optarg);
+			break;
+			case 'b':
+				bits = atoi(optarg);
+			break;
+			case 'f':
+				filterchain = optarg;
+			break;
+			case 'm':
+				usemap = 1;
+			break;
+			case 't':
+				forcemime = optarg;
+			break;
+			case 's':
+				seconds = atoi(optarg);
+			break;
+			case 'h':
+				_bench_usage(argv[0]);
+			return -1;
+		}
+	} while (opt != -1);
+	if ((optind >= argc && seconds == 0) || loops < 1)
+	{
+		_bench_usage(argv[0]);
+		return -1;
+	}
+
+	player_ctx_t player = {0};
+	pthread_mutex_init(&player.mutex, NULL);
+	pthread_cond_init(&player.cond, NULL);
+	jitter_format_t format = _bench_format(bits);
+	const char *chains[] = {"pcm", filterchain};
+
+	int ret = 0;
+	int i;
+	for (i = optind; i < argc; i++)
+	{
+		const char *path = argv[i];
+		const char *mime = forcemime;
+		if (mime == NULL)
+			mime = decoder_mime(path);
+		if (mime == NULL)
+		{
+			err("bench: %s not supported", path);
+			ret = -1;
+			continue;
+		}
+		size_t length = 0;
+		unsigned char *data = _bench_load(path, &length);
+		if (data == NULL)
+		{
+			ret = -1;
+			continue;
+		}
+		if (_bench_input(&player, path, mime, data, length, chains, format, usemap, loops) < 0)
+			ret = -1;
+		free(data);
+	}
+	if (seconds > 0)
+	{
+		const char *tonemimes[] = {mime_audiol16, mime_audiol24};
+		for (i = 0; i < 2; i++)
+		{
+			size_t length = 0;
+			unsigned char *data = _bench_tone(i + 2, seconds, &length);
+			if (data == NULL)
+			{
+				ret = -1;
+				continue;
+			}
+			if (_bench_input(&player, "tone", tonemimes[i], data, length, chains, format, usemap, loops) < 0)
+				ret = -1;
+			free(data);
+		}
+	}
+	pthread_cond_destroy(&player.cond);
+	pthread_mutex_destroy(&player.mutex);
+	return ret;
+}
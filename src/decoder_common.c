@@ -36,11 +36,13 @@
 #ifdef DECODER_MODULES
 #include <dlfcn.h>
 #include <dirent.h>
+#include <sys/stat.h>
 #endif
 
 #include "player.h"
 #include "decoder.h"
 #include "filter.h"
+#include "media.h"
 
 #define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
 #define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
@@ -55,6 +57,42 @@
 static const decoder_ops_t * decoderslist [10];
 
 #ifdef DECODER_MODULES
+/**
+ * the modules' directory may be read-only,
+ * the cache is generated at runtime with the other caches of putv
+ */
+#ifndef DECODER_CACHEDIR
+#define DECODER_CACHEDIR LOCALSTATEDIR"/cache/putv"
+#endif
+#ifndef DECODER_CACHE
+#define DECODER_CACHE DECODER_CACHEDIR"/decoders.cache"
+#endif
+#define MAX_MODULES 10
+#define MAX_EXTENSIONS 64
+
+/**
+ * The capabilities of each module are stored into a cache file.
+ * A module is loaded only when a stream needs it, and stays resident.
+ */
+typedef struct decoder_module_s decoder_module_t;
+struct decoder_module_s
+{
+	char *name;
+	const char *mime;
+	/// list of extensions separated by ','
+	char *extensions;
+	const decoder_ops_t *ops;
+};
+static decoder_module_t decodermodules[MAX_MODULES];
+static int ndecodermodules = 0;
+static pthread_mutex_t decodermutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// the extensions checked on the modules to build the cache
+static const char *const decoder_extensions[] = {
+	".mp3", ".flac", ".aac", ".m4a", ".mp4", ".opus", ".ogg",
+	".wav", ".pcm", NULL
+};
+
 static const decoder_ops_t * decoder_load_module(const char *root, const char *name)
 {
 	const decoder_ops_t *ops = NULL;
@@ -79,6 +117,126 @@ static const decoder_ops_t * decoder_load_module(const char *root, const char *n
 	}
 	return ops;
 }
+
+static const decoder_ops_t *decoder_module(decoder_module_t *module)
+{
+	pthread_mutex_lock(&decodermutex);
+	if (module->ops == NULL)
+	{
+		warn("decoder: load %s for %s", module->name, module->mime);
+		module->ops = decoder_load_module(PKGLIBDIR, module->name);
+	}
+	pthread_mutex_unlock(&decodermutex);
+	return module->ops;
+}
+
+static int decoder_checkextension(decoder_module_t *module, const char *path)
+{
+	const char *ext = strrchr(path, '.');
+	if (ext == NULL || module->extensions == NULL)
+		return 0;
+	int length = strlen(ext);
+	const char *it = module->extensions;
+	while (it != NULL && *it != '\0')
+	{
+		const char *next = strchr(it, ',');
+		int itlength = (next != NULL)? next - it: strlen(it);
+		if (itlength == length && !strncmp(it, ext, length))
+			return 1;
+		it = (next != NULL)? next + 1: NULL;
+	}
+	return 0;
+}
+
+static int decoder_readcache(const char *cache)
+{
+	struct stat cachestat;
+	struct stat dirstat;
+	if (stat(cache, &cachestat) != 0 || stat(PKGLIBDIR, &dirstat) != 0)
+		return -1;
+	/**
+	 * a module has been installed or removed after the cache generation
+	 */
+	if (dirstat.st_mtime > cachestat.st_mtime)
+		return -1;
+	FILE *file = fopen(cache, "r");
+	if (file == NULL)
+		return -1;
+	char name[256];
+	char mime[128];
+	char extensions[MAX_EXTENSIONS];
+	while (ndecodermodules < MAX_MODULES &&
+		fscanf(file, "%255s %127s %63s\n", name, mime, extensions) == 3)
+	{
+		decoder_module_t *module = &decodermodules[ndecodermodules++];
+		module->name = strdup(name);
+		module->mime = utils_mime2mime(mime);
+		if (module->mime == mime_octetstream)
+			module->mime = strdup(mime);
+		if (strcmp(extensions, "-"))
+			module->extensions = strdup(extensions);
+	}
+	fclose(file);
+	dbg("decoder: %d modules into %s", ndecodermodules, cache);
+	return 0;
+}
+
+static void decoder_writecache(const char *cache)
+{
+	struct dirent **namelist;
+	int n;
+
+	n = scandir(PKGLIBDIR, &namelist, NULL, alphasort);
+	while (n > 0)
+	{
+		n--;
+		if (namelist[n]->d_name[0] != '.' && ndecodermodules < MAX_MODULES)
+		{
+			const decoder_ops_t *ops = decoder_load_module(PKGLIBDIR, namelist[n]->d_name);
+			if (ops != NULL)
+			{
+				decoder_module_t *module = &decodermodules[ndecodermodules++];
+				module->name = strdup(namelist[n]->d_name);
+				module->ops = ops;
+				module->mime = ops->mime(NULL);
+				char extensions[MAX_EXTENSIONS] = {0};
+				int length = 0;
+				for (int i = 0; decoder_extensions[i] != NULL; i++)
+				{
+					char path[8];
+					snprintf(path, sizeof(path), "a%s", decoder_extensions[i]);
+					if (ops->checkin(NULL, path))
+						length += snprintf(extensions + length, sizeof(extensions) - length,
+								"%s%s", (length > 0)? ",": "", decoder_extensions[i]);
+				}
+				if (length > 0)
+					module->extensions = strdup(extensions);
+			}
+		}
+		free(namelist[n]);
+	}
+	if (namelist)
+		free(namelist);
+
+	if (mkdir(DECODER_CACHEDIR, 0755) != 0 && errno != EEXIST)
+	{
+		warn("decoder: cache %s not available %s", DECODER_CACHEDIR, strerror(errno));
+		return;
+	}
+	FILE *file = fopen(cache, "w");
+	if (file == NULL)
+	{
+		warn("decoder: cache %s not available %s", cache, strerror(errno));
+		return;
+	}
+	for (int i = 0; i < ndecodermodules; i++)
+	{
+		decoder_module_t *module = &decodermodules[i];
+		fprintf(file, "%s %s %s\n", module->name, module->mime,
+				(module->extensions)? module->extensions: "-");
+	}
+	fclose(file);
+}
 #endif
 
 decoder_t *decoder_build(player_ctx_t *player, const char *mime)
@@ -99,6 +257,13 @@ decoder_t *decoder_build(player_ctx_t *player, const char *mime)
 			}
 			i++;
 		}
+#ifdef DECODER_MODULES
+		for (i = 0; ops == NULL && i < ndecodermodules; i++)
+		{
+			if (!strcmp(mime, decodermodules[i].mime))
+				ops = decoder_module(&decodermodules[i]);
+		}
+#endif
 	}
 
 	if (ops != NULL)
@@ -121,11 +286,23 @@ const char *decoder_mimelist(int first)
 	static int i = 0;
 	if (first)
 		i = 0;
-	if (decoderslist[i] != NULL)
+	if (i < 10 && decoderslist[i] != NULL)
 	{
 		mime = decoderslist[i]->mime(NULL);
 		i++;
 	}
+#ifdef DECODER_MODULES
+	else if (i < 10 + ndecodermodules)
+	{
+		/**
+		 * the modules follow the built-in decoders
+		 */
+		if (i < 10)
+			i = 10;
+		mime = decodermodules[i - 10].mime;
+		i++;
+	}
+#endif
 	else
 		i = 0;
 	return mime;
@@ -145,6 +322,13 @@ const char *decoder_mime(const char *path)
 		i++;
 		ops = decoderslist[i];
 	}
+#ifdef DECODER_MODULES
+	for (i = 0; i < ndecodermodules; i++)
+	{
+		if (decoder_checkextension(&decodermodules[i], path))
+			return decodermodules[i].mime;
+	}
+#endif
 	return NULL;
 }
 
@@ -163,9 +347,16 @@ static void _decoder_init(void)
 #ifdef DECODER_FAAD2
 		decoder_faad2,
 #endif
+#ifdef DECODER_OPUS
+		decoder_opus,
+#endif
 #endif
 #ifdef DECODER_PASSTHROUGH
 		decoder_passthrough,
+#endif
+#ifdef DECODER_LPCM
+		decoder_l16,
+		decoder_l24,
 #endif
 		NULL
 	};
@@ -177,21 +368,10 @@ static void _decoder_init(void)
 	}
 
 #ifdef DECODER_MODULES
-	struct dirent **namelist;
-	int n;
-
-	n = scandir(PKGLIBDIR, &namelist, NULL, alphasort);
-	while (n > 0)
-	{
-		n--;
-		if (namelist[n]->d_name[0] != '.')
-		{
-			const decoder_ops_t *ops = decoder_load_module(PKGLIBDIR, namelist[n]->d_name);
-			if (ops != NULL)
-				decoderslist[i++] = ops;
-			if (i >= 10)
-				break;
-		}
-	}
+	/**
+	 * the modules are loaded here only to generate the cache
+	 */
+	if (decoder_readcache(DECODER_CACHE) != 0)
+		decoder_writecache(DECODER_CACHE);
 #endif
 }
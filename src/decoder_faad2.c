@@ -52,6 +52,9 @@ struct decoder_ctx_s
 
 	jitter_t *in;
 	unsigned char *inbuffer;
+	int framing;
+	unsigned char *frame;
+	uint64_t nsamples;
 
 	jitter_t *out;
 	unsigned char *outbuffer;
@@ -95,6 +98,12 @@ struct decoder_ctx_s
 #define JITTER_TYPE JITTER_TYPE_RING
 #define MAX_CHANNELS 6
 
+#define FRAMING_RAW 0
+#define FRAMING_ADTS 1
+#define FRAMING_LATM 2
+/// the length of a frame is coded on 13 bits for ADTS and LATM
+#define FRAME_MAXSIZE (8192 + 3)
+
 static jitter_t *_decoder_jitter(decoder_ctx_t *ctx, jitte_t jitte);
 
 #ifdef DEBUG
@@ -170,6 +179,120 @@ static int _faad_parsetags(decoder_ctx_t *ctx)
 	return 0;
 }
 
+static int _faad_framing(const unsigned char *buffer, size_t len)
+{
+	if (len < 2)
+		return FRAMING_RAW;
+	/**
+	 * ADTS: syncword 0xFFF and layer 0
+	 */
+	if (buffer[0] == 0xFF && (buffer[1] & 0xF6) == 0xF0)
+		return FRAMING_ADTS;
+	/**
+	 * LATM into LOAS AudioSyncStream: syncword 0x2B7
+	 */
+	if (buffer[0] == 0x56 && (buffer[1] & 0xE0) == 0xE0)
+		return FRAMING_LATM;
+	return FRAMING_RAW;
+}
+
+static size_t _faad_framelength(int framing, const unsigned char *header)
+{
+	size_t len = 0;
+	switch (framing)
+	{
+	case FRAMING_ADTS:
+		len = ((header[3] & 0x03) << 11) | (header[4] << 3) | (header[5] >> 5);
+		/// the header is 7 bytes long and 9 with the crc
+		if (len < 7)
+			len = 0;
+	break;
+	case FRAMING_LATM:
+		len = ((header[1] & 0x1F) << 8) | header[2];
+		len += 3;
+	break;
+	}
+	return len;
+}
+
+/**
+ * copy the frame split on several buffers of the jitter
+ */
+static int _faad_gather(decoder_ctx_t *ctx, size_t offset, size_t length)
+{
+	while (offset < length)
+	{
+		unsigned char *buffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		if (buffer == NULL)
+			return -1;
+		size_t len = ctx->in->ops->length(ctx->in->ctx);
+		if (len > length - offset)
+			len = length - offset;
+		memcpy(ctx->frame + offset, buffer, len);
+		ctx->in->ops->pop(ctx->in->ctx, len);
+		offset += len;
+	}
+	return 0;
+}
+
+/**
+ * return the next whole frame of the stream.
+ * The frame is read directly from the jitter when it is contiguous,
+ * otherwise it is gathered into the frame buffer and already popped.
+ */
+static unsigned char *_faad_frame(decoder_ctx_t *ctx, size_t *framelen, int *popped)
+{
+	const size_t headerlen = (ctx->framing == FRAMING_ADTS)? 7: 3;
+	while (1)
+	{
+		ctx->inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		if (ctx->inbuffer == NULL)
+			return NULL;
+		size_t len = ctx->in->ops->length(ctx->in->ctx);
+		unsigned char *frame = ctx->inbuffer;
+		size_t offset = 0;
+
+		if (len >= 2 && _faad_framing(frame, len) != ctx->framing)
+		{
+			/**
+			 * resynchronization on the next syncword
+			 */
+			size_t skip = 1;
+			while (skip < len - 1 && _faad_framing(frame + skip, len - skip) != ctx->framing)
+				skip++;
+			decoder_dbg("decoder faad: skip %lu bytes", skip);
+			ctx->in->ops->pop(ctx->in->ctx, skip);
+			continue;
+		}
+		if (len < headerlen)
+		{
+			if (_faad_gather(ctx, 0, headerlen) < 0)
+				return NULL;
+			frame = ctx->frame;
+			offset = headerlen;
+			if (_faad_framing(frame, headerlen) != ctx->framing)
+				continue;
+		}
+		*framelen = _faad_framelength(ctx->framing, frame);
+		if (*framelen == 0)
+		{
+			if (offset == 0)
+				ctx->in->ops->pop(ctx->in->ctx, 1);
+			continue;
+		}
+		if (offset == 0 && len >= *framelen)
+		{
+			*popped = 0;
+			return frame;
+		}
+		if (_faad_gather(ctx, offset, *framelen) < 0)
+			return NULL;
+		*popped = 1;
+		return ctx->frame;
+	}
+	return NULL;
+}
+
 static int _faad_initaac(decoder_ctx_t *ctx)
 {
 	size_t len = ctx->in->ctx->size;
@@ -187,6 +310,14 @@ static int _faad_initaac(decoder_ctx_t *ctx)
 	}
 	decoder_dbg("decoder faad: samplerate %lu fps, channels %d", samplerate, channels);
 	ctx->in->ops->pop(ctx->in->ctx, len);
+
+	ctx->inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
+	if (ctx->inbuffer != NULL)
+		ctx->framing = _faad_framing(ctx->inbuffer, ctx->in->ops->length(ctx->in->ctx));
+	if (ctx->framing != FRAMING_RAW && ctx->frame == NULL)
+		ctx->frame = malloc(FRAME_MAXSIZE);
+	dbg("decoder faad: framing %s", (ctx->framing == FRAMING_ADTS)? "adts":
+			(ctx->framing == FRAMING_LATM)? "latm": "raw");
 	return 0;
 }
 
@@ -197,18 +328,25 @@ static int _faad_loop(decoder_ctx_t *ctx)
 
 	do
 	{
+		int popped = 0;
+		unsigned char *frame;
 		_faad_parsetags(ctx);
-		ctx->inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
-		if (ctx->inbuffer == NULL)
+		if (ctx->framing != FRAMING_RAW)
+			frame = _faad_frame(ctx, &len, &popped);
+		else
+		{
+			frame = ctx->in->ops->peer(ctx->in->ctx, NULL);
+			len = ctx->in->ops->length(ctx->in->ctx);
+		}
+		if (frame == NULL)
 		{
 			decoder_dbg("decoder faad: end of file");
 			ret = -1;
 			break;
 		}
-		len = ctx->in->ops->length(ctx->in->ctx);
 
 		NeAACDecFrameInfo frameInfo = {0};
-		void *samples = NeAACDecDecode(ctx->decoder, &frameInfo, ctx->inbuffer, len);
+		void *samples = NeAACDecDecode(ctx->decoder, &frameInfo, frame, len);
 		decoder_dbg("decoder faad: decode %ld samples", frameInfo.samples);
 		if (frameInfo.error > 0)
 		{
@@ -219,13 +357,22 @@ static int _faad_loop(decoder_ctx_t *ctx)
 #ifdef DECODER_DUMP
 		write(ctx->dumpfd, samples, frameInfo.samples * 4);
 #endif
-		if (frameInfo.header_type == 2)
+		if (frameInfo.channels > 0)
+			ctx->nsamples += frameInfo.samples / frameInfo.channels;
+		/// 2 is ADTS and 3 is LATM
+		if (frameInfo.header_type == 2 || frameInfo.header_type == 3)
 			ret = _faad_output(ctx, &frameInfo, samples);
 		else
 		{
 			dbg("frame type %d", frameInfo.header_type);
 		}
-		ctx->in->ops->pop(ctx->in->ctx, frameInfo.bytesconsumed);
+		/**
+		 * a whole frame is given to faad, the frame is entirely consumed
+		 */
+		if (ctx->framing == FRAMING_RAW)
+			ctx->in->ops->pop(ctx->in->ctx, frameInfo.bytesconsumed);
+		else if (!popped)
+			ctx->in->ops->pop(ctx->in->ctx, len);
 	} while(ret == 0);
 
 	return ret;
@@ -396,6 +543,13 @@ static int _decoder_checkout(decoder_ctx_t *ctx, jitter_format_t format)
 	return (format & JITTER_AUDIO);
 }
 
+static uint32_t _decoder_position(decoder_ctx_t *ctx)
+{
+	if (ctx->samplerate == 0)
+		return 0;
+	return ctx->nsamples / ctx->samplerate;
+}
+
 static void _decoder_destroy(decoder_ctx_t *ctx)
 {
 	if (ctx->out)
@@ -413,6 +567,8 @@ static void _decoder_destroy(decoder_ctx_t *ctx)
 		free(ctx->filter);
 	}
 	jitter_destroy(ctx->in);
+	if (ctx->frame)
+		free(ctx->frame);
 	free(ctx);
 }
 
@@ -427,6 +583,7 @@ const decoder_ops_t _decoder_faad2 =
 	.run = _decoder_run,
 	.destroy = _decoder_destroy,
 	.mime = _decoder_mime,
+	.position = _decoder_position,
 };
 
 const decoder_ops_t *decoder_faad2 = &_decoder_faad2;
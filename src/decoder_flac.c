@@ -47,6 +47,9 @@ struct decoder_ctx_s
 	pthread_t thread;
 	jitter_t *in;
 	unsigned char *inbuffer;
+	const unsigned char *map;
+	size_t maplength;
+	size_t mapoffset;
 	jitter_t *out;
 	unsigned char *outbuffer;
 	size_t outbufferlen;
@@ -110,12 +113,43 @@ static jitter_t *_decoder_jitter(decoder_ctx_t *ctx, jitte_t jitte)
 	return ctx->in;
 }
 
+static int _decoder_map(decoder_ctx_t *ctx, const unsigned char *buffer, size_t length)
+{
+	if (ctx->in != NULL)
+		return -1;
+	ctx->map = buffer;
+	ctx->maplength = length;
+	ctx->mapoffset = 0;
+	return 0;
+}
+
+static FLAC__StreamDecoderReadStatus
+input_map_cb(decoder_ctx_t *ctx, FLAC__byte buffer[], size_t *bytes)
+{
+	size_t len = ctx->maplength - ctx->mapoffset;
+	if (len == 0)
+	{
+		*bytes = 0;
+		decoder_dbg("decoder flac: end of file");
+		return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+	}
+	if (len > *bytes)
+		len = *bytes;
+	else
+		*bytes = len;
+	memcpy(buffer, ctx->map + ctx->mapoffset, len);
+	ctx->mapoffset += len;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
 static FLAC__StreamDecoderReadStatus
 input_cb(const FLAC__StreamDecoder *decoder,
 			FLAC__byte buffer[], size_t *bytes,
 			void *data)
 {
 	decoder_ctx_t *ctx = (decoder_ctx_t *)data;
+	if (ctx->map != NULL)
+		return input_map_cb(ctx, buffer, bytes);
 	size_t len = ctx->in->ctx->size;
 
 	ctx->inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
@@ -185,7 +219,8 @@ output_cb(const FLAC__StreamDecoder *decoder,
 			/**
 			 * flush the src jitter to break the stream
 			 */
-			ctx->in->ops->flush(ctx->in->ctx);
+			if (ctx->in != NULL)
+				ctx->in->ops->flush(ctx->in->ctx);
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
 	}
@@ -196,6 +231,12 @@ output_cb(const FLAC__StreamDecoder *decoder,
 static FLAC__StreamDecoderLengthStatus
 length_cb(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
 {
+	decoder_ctx_t *ctx = (decoder_ctx_t *)client_data;
+	if (ctx->map != NULL)
+	{
+		*stream_length = ctx->maplength;
+		return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+	}
 	return FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED;
 }
 
@@ -322,7 +363,8 @@ static void _decoder_destroy(decoder_ctx_t *ctx)
 		pthread_join(ctx->thread, NULL);
 	/* release the decoder */
 	FLAC__stream_decoder_delete(ctx->decoder);
-	jitter_destroy(ctx->in);
+	if (ctx->in != NULL)
+		jitter_destroy(ctx->in);
 	if (ctx->filter)
 	{
 		ctx->filter->ops->destroy(ctx->filter->ctx);
@@ -339,6 +381,7 @@ static const decoder_ops_t _decoder_flac =
 	.prepare = _decoder_prepare,
 	.checkout = _decoder_checkout,
 	.jitter = _decoder_jitter,
+	.map = _decoder_map,
 	.run = _decoder_run,
 	.mime = _decoder_mime,
 	.position = _decoder_position,
@@ -0,0 +1,302 @@
+/*****************************************************************************
+ * decoder_lpcm.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "player.h"
+#include "filter.h"
+typedef struct decoder_s decoder_t;
+typedef struct decoder_ops_s decoder_ops_t;
+typedef struct decoder_ctx_s decoder_ctx_t;
+struct decoder_ctx_s
+{
+	const decoder_ops_t *ops;
+	/// size of one sample into the RTP payload: 2 for L16, 3 for L24
+	unsigned char samplesize;
+	unsigned char nchannels;
+	pthread_t thread;
+	jitter_t *in;
+	jitter_t *out;
+	filter_t *filter;
+	player_ctx_t *player;
+	sample_t *samples[MAXCHANNELS];
+	unsigned int nsamples;
+	uint32_t position;
+	rescale_t rescale;
+};
+#define DECODER_CTX
+#include "decoder.h"
+#include "media.h"
+#include "jitter.h"
+#include "filter.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define decoder_dbg(...)
+
+/// one RTP payload by buffer
+#define BUFFERSIZE 1500
+#define NBUFFER 32
+#ifndef DEFAULT_NCHANNELS
+# define DEFAULT_NCHANNELS 2
+#endif
+
+static const char *jitter_name = "lpcm decoder";
+
+static decoder_ctx_t *_decoder_init(const decoder_ops_t *ops, player_ctx_t *player, unsigned char samplesize)
+{
+	decoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->ops = ops;
+	ctx->player = player;
+	ctx->samplesize = samplesize;
+	ctx->nchannels = DEFAULT_NCHANNELS;
+	int i;
+	for (i = 0; i < ctx->nchannels; i++)
+		ctx->samples[i] = calloc(BUFFERSIZE / samplesize, sizeof(sample_t));
+	return ctx;
+}
+
+static decoder_ctx_t *_decoder_l16_init(player_ctx_t *player)
+{
+	return _decoder_init(decoder_l16, player, 2);
+}
+
+static decoder_ctx_t *_decoder_l24_init(player_ctx_t *player)
+{
+	return _decoder_init(decoder_l24, player, 3);
+}
+
+static jitter_t *_decoder_jitter(decoder_ctx_t *ctx, jitte_t jitte)
+{
+	if (ctx->in == NULL)
+	{
+		int factor = jitte;
+		int nbbuffer = NBUFFER << factor;
+		jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, nbbuffer, BUFFERSIZE);
+		if (jitter == NULL)
+			return NULL;
+		jitter->ctx->thredhold = nbbuffer / 2;
+		if (ctx->samplesize == 3)
+			jitter->format = PCM_24bits3_BE_stereo;
+		else
+			jitter->format = PCM_16bits_BE_stereo;
+		ctx->in = jitter;
+	}
+	return ctx->in;
+}
+
+static int _decoder_checkin(decoder_ctx_t *ctx, const char *path)
+{
+	/**
+	 * the stream is available only from RTP
+	 */
+	return 0;
+}
+
+static void _decoder_samples(decoder_ctx_t *ctx, const unsigned char *buffer, unsigned int nframes)
+{
+	unsigned int i;
+	int j;
+	for (i = 0; i < nframes; i++)
+	{
+		for (j = 0; j < ctx->nchannels; j++)
+		{
+			int32_t sample = 0;
+			if (ctx->samplesize == 3)
+				sample = ((int32_t)((uint32_t)buffer[0] << 24 | buffer[1] << 16 | buffer[2] << 8)) >> 8;
+			else
+				sample = (int16_t)(buffer[0] << 8 | buffer[1]);
+			ctx->samples[j][i] = sample;
+			buffer += ctx->samplesize;
+		}
+	}
+}
+
+static void *_decoder_thread(void *arg)
+{
+	decoder_ctx_t *ctx = (decoder_ctx_t *)arg;
+	unsigned int framesize = ctx->samplesize * ctx->nchannels;
+	filter_audio_t audio;
+	unsigned int samplerate = jitter_samplerate(ctx->out);
+	if (samplerate == 0)
+		samplerate = DEFAULT_SAMPLERATE;
+
+	dbg("decoder: start running");
+	while (1)
+	{
+		const unsigned char *inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		if (inbuffer == NULL)
+			break;
+		unsigned int nframes = ctx->in->ops->length(ctx->in->ctx) / framesize;
+		_decoder_samples(ctx, inbuffer, nframes);
+		ctx->in->ops->pop(ctx->in->ctx, ctx->in->ops->length(ctx->in->ctx));
+
+		audio.samplerate = samplerate;
+		audio.nchannels = ctx->nchannels;
+		audio.nsamples = nframes;
+		audio.bitspersample = ctx->samplesize * 8;
+		audio.regain = 0;
+		audio.mode = 0;
+		int i;
+		for (i = 0; i < audio.nchannels; i++)
+			audio.samples[i] = ctx->samples[i];
+		if (audio.nchannels == 1)
+			audio.samples[1] = audio.samples[0];
+
+		ctx->nsamples += audio.nsamples;
+		if (ctx->nsamples >= samplerate)
+		{
+			ctx->position++;
+			ctx->nsamples -= samplerate;
+		}
+		while (audio.nsamples > 0)
+		{
+			if (filter_filloutput(ctx->filter, &audio, ctx->out) < 0)
+				break;
+		}
+		if (audio.nsamples > 0)
+		{
+			/**
+			 * flush the src jitter to break the stream
+			 */
+			ctx->in->ops->flush(ctx->in->ctx);
+			break;
+		}
+	}
+	filter_flushoutput(ctx->out);
+	dbg("decoder: stop running");
+	player_state(ctx->player, STATE_CHANGE);
+
+	return NULL;
+}
+
+static int _decoder_prepare(decoder_ctx_t *ctx, filter_t *filter, const char *info)
+{
+	ctx->filter = filter;
+	return 0;
+}
+
+static int _decoder_run(decoder_ctx_t *ctx, jitter_t *jitter)
+{
+	int ret = 0;
+	ctx->out = jitter;
+	if (ctx->filter != NULL)
+	{
+		rescale_init(&ctx->rescale, 0, jitter->format);
+		ctx->filter->ops->set(ctx->filter->ctx, FILTER_SAMPLED, rescale_cb, &ctx->rescale, 0);
+		ret = ctx->filter->ops->set(ctx->filter->ctx, FILTER_FORMAT, jitter->format, FILTER_SAMPLERATE, jitter_samplerate(jitter), 0);
+	}
+	if (ret == 0 && ctx->in != NULL)
+		pthread_create(&ctx->thread, NULL, _decoder_thread, ctx);
+	return ret;
+}
+
+static const char *_decoder_l16_mime(decoder_ctx_t *ctx)
+{
+	return mime_audiol16;
+}
+
+static const char *_decoder_l24_mime(decoder_ctx_t *ctx)
+{
+	return mime_audiol24;
+}
+
+static int _decoder_checkout(decoder_ctx_t *ctx, jitter_format_t format)
+{
+	return (format & JITTER_AUDIO);
+}
+
+static uint32_t _decoder_position(decoder_ctx_t *ctx)
+{
+	return ctx->position;
+}
+
+static uint32_t _decoder_duration(decoder_ctx_t *ctx)
+{
+	return 0;
+}
+
+static void _decoder_destroy(decoder_ctx_t *ctx)
+{
+	if (ctx->out)
+		ctx->out->ops->flush(ctx->out->ctx);
+	if (ctx->in != NULL)
+		ctx->in->ops->flush(ctx->in->ctx);
+	if (ctx->thread > 0)
+		pthread_join(ctx->thread, NULL);
+	if (ctx->in != NULL)
+		jitter_destroy(ctx->in);
+	if (ctx->filter)
+	{
+		ctx->filter->ops->destroy(ctx->filter->ctx);
+		free(ctx->filter);
+	}
+	int i;
+	for (i = 0; i < ctx->nchannels; i++)
+		free(ctx->samples[i]);
+	free(ctx);
+}
+
+const decoder_ops_t *decoder_l16 = &(decoder_ops_t)
+{
+	.name = "l16",
+	.checkin = _decoder_checkin,
+	.init = _decoder_l16_init,
+	.prepare = _decoder_prepare,
+	.checkout = _decoder_checkout,
+	.jitter = _decoder_jitter,
+	.run = _decoder_run,
+	.mime = _decoder_l16_mime,
+	.position = _decoder_position,
+	.duration = _decoder_duration,
+	.destroy = _decoder_destroy,
+};
+
+const decoder_ops_t *decoder_l24 = &(decoder_ops_t)
+{
+	.name = "l24",
+	.checkin = _decoder_checkin,
+	.init = _decoder_l24_init,
+	.prepare = _decoder_prepare,
+	.checkout = _decoder_checkout,
+	.jitter = _decoder_jitter,
+	.run = _decoder_run,
+	.mime = _decoder_l24_mime,
+	.position = _decoder_position,
+	.duration = _decoder_duration,
+	.destroy = _decoder_destroy,
+};
@@ -51,6 +51,9 @@ struct decoder_ctx_s
 
 	jitter_t *in;
 	unsigned char *inbuffer;
+	const unsigned char *map;
+	size_t maplength;
+	unsigned char *guard;
 
 	jitter_t *out;
 	unsigned char *outbuffer;
@@ -93,13 +96,48 @@ struct decoder_ctx_s
 #define FRACBITS		28
 #define JITTER_TYPE JITTER_TYPE_RING
 
+/// MAD_BUFFER_MDLEN is too small on ARM device
+#define BUFFERSIZE 2881
+//#define BUFFERSIZE MAD_BUFFER_MDLEN
+
 static jitter_t *_decoder_jitter(decoder_ctx_t *ctx, jitte_t jitte);
 
+static
+enum mad_flow input_map(decoder_ctx_t *ctx,
+		    struct mad_stream *stream)
+{
+	if (ctx->inbuffer == NULL)
+	{
+		ctx->inbuffer = (unsigned char *)ctx->map;
+		mad_stream_buffer(stream, ctx->map, ctx->maplength);
+		return MAD_FLOW_CONTINUE;
+	}
+	/**
+	 * the last frame is decoded only with MAD_BUFFER_GUARD bytes
+	 * after its end. The mapping is read only, the end is copied.
+	 */
+	if (ctx->inbuffer != ctx->guard && stream->next_frame != NULL)
+	{
+		size_t len = stream->bufend - stream->next_frame;
+		if (len > 0 && len <= BUFFERSIZE)
+		{
+			memcpy(ctx->guard, stream->next_frame, len);
+			memset(ctx->guard + len, 0, MAD_BUFFER_GUARD);
+			ctx->inbuffer = ctx->guard;
+			mad_stream_buffer(stream, ctx->guard, len + MAD_BUFFER_GUARD);
+			return MAD_FLOW_CONTINUE;
+		}
+	}
+	return MAD_FLOW_STOP;
+}
+
 static
 enum mad_flow input(void *data,
 		    struct mad_stream *stream)
 {
 	decoder_ctx_t *ctx = (decoder_ctx_t *)data;
+	if (ctx->map != NULL)
+		return input_map(ctx, stream);
 	if (ctx->in == NULL)
 	{
 		err("decoder mad: input stream error");
@@ -191,7 +229,8 @@ enum mad_flow output(void *data,
 			/**
 			 * flush the src jitter to break the stream
 			 */
-			ctx->in->ops->flush(ctx->in->ctx);
+			if (ctx->in != NULL)
+				ctx->in->ops->flush(ctx->in->ctx);
 			return MAD_FLOW_STOP;
 		}
 	}
@@ -251,10 +290,6 @@ enum mad_flow header(void *data, struct mad_header const *header)
 	return MAD_FLOW_CONTINUE;
 }
 
-/// MAD_BUFFER_MDLEN is too small on ARM device
-#define BUFFERSIZE 2881
-//#define BUFFERSIZE MAD_BUFFER_MDLEN
-
 /// NBBUFFER must be at least 3 otherwise the decoder block on the end of the source
 #define NBUFFER 4
 
@@ -293,6 +328,18 @@ static jitter_t *_decoder_jitter(decoder_ctx_t *ctx, jitte_t jitte)
 	return ctx->in;
 }
 
+static int _decoder_map(decoder_ctx_t *ctx, const unsigned char *buffer, size_t length)
+{
+	if (ctx->in != NULL)
+		return -1;
+	ctx->guard = malloc(BUFFERSIZE + MAD_BUFFER_GUARD);
+	if (ctx->guard == NULL)
+		return -1;
+	ctx->map = buffer;
+	ctx->maplength = length;
+	return 0;
+}
+
 static void *mad_thread(void *arg)
 {
 	int result = 0;
@@ -411,7 +458,10 @@ static void _decoder_destroy(decoder_ctx_t *ctx)
 		ctx->filter->ops->destroy(ctx->filter->ctx);
 		free(ctx->filter);
 	}
-	jitter_destroy(ctx->in);
+	if (ctx->in != NULL)
+		jitter_destroy(ctx->in);
+	if (ctx->guard != NULL)
+		free(ctx->guard);
 	free(ctx);
 }
 
@@ -423,6 +473,7 @@ const decoder_ops_t _decoder_mad =
 	.prepare = _decoder_prepare,
 	.checkout = _decoder_checkout,
 	.jitter = _decoder_jitter,
+	.map = _decoder_map,
 	.run = _decoder_run,
 	.position = _decoder_position,
 	.duration = _decoder_duration,
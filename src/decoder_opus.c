@@ -0,0 +1,288 @@
+/*****************************************************************************
+ * decoder_opus.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2025
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <opus.h>
+
+#include "player.h"
+#include "filter.h"
+typedef struct decoder_s decoder_t;
+typedef struct decoder_ops_s decoder_ops_t;
+typedef struct decoder_ctx_s decoder_ctx_t;
+struct decoder_ctx_s
+{
+	OpusDecoder *decoder;
+	int nchannels;
+	uint32_t samplerate;
+	pthread_t thread;
+	jitter_t *in;
+	jitter_t *out;
+	filter_t *filter;
+	player_ctx_t *player;
+	opus_int16 *pcm;
+	sample_t *samples[MAXCHANNELS];
+	uint32_t nsamples;
+	uint32_t position;
+	rescale_t rescale;
+};
+#define DECODER_CTX
+#include "decoder.h"
+#include "media.h"
+#include "jitter.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define decoder_dbg(...)
+
+/// one RTP payload by buffer
+#define BUFFERSIZE 1500
+#define NBUFFER 8
+#define OPUS_SAMPLERATE 48000
+/// the longest opus packet contains 120 ms
+#define MAX_NSAMPLES (OPUS_SAMPLERATE * 120 / 1000)
+
+static const char *jitter_name = "opus decoder";
+
+static decoder_ctx_t *_decoder_init(player_ctx_t *player)
+{
+	decoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->nchannels = 2;
+	ctx->samplerate = OPUS_SAMPLERATE;
+	ctx->player = player;
+	ctx->pcm = calloc(MAX_NSAMPLES * ctx->nchannels, sizeof(*ctx->pcm));
+	int i;
+	for (i = 0; i < ctx->nchannels; i++)
+		ctx->samples[i] = calloc(MAX_NSAMPLES, sizeof(sample_t));
+	return ctx;
+}
+
+static jitter_t *_decoder_jitter(decoder_ctx_t *ctx, jitte_t jitte)
+{
+	if (ctx->in == NULL)
+	{
+		int factor = jitte;
+		int nbbuffer = NBUFFER << factor;
+		jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, nbbuffer, BUFFERSIZE);
+		if (jitter == NULL)
+			return NULL;
+		jitter->ctx->thredhold = nbbuffer / 2;
+		jitter->format = OPUS;
+		ctx->in = jitter;
+	}
+	return ctx->in;
+}
+
+static int _decoder_checkin(decoder_ctx_t *ctx, const char *path)
+{
+	/**
+	 * the stream is available only from RTP,
+	 * the ogg container is not supported
+	 */
+	return 0;
+}
+
+static void *_decoder_thread(void *arg)
+{
+	decoder_ctx_t *ctx = (decoder_ctx_t *)arg;
+	filter_audio_t audio;
+
+	dbg("decoder: start running");
+	while (1)
+	{
+		const unsigned char *inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		if (inbuffer == NULL)
+			break;
+		size_t length = ctx->in->ops->length(ctx->in->ctx);
+		int nsamples = opus_decode(ctx->decoder, inbuffer, length, ctx->pcm, MAX_NSAMPLES, 0);
+		ctx->in->ops->pop(ctx->in->ctx, length);
+		if (nsamples < 0)
+		{
+			warn("decoder: opus error %s", opus_strerror(nsamples));
+			continue;
+		}
+
+		int i;
+		int j;
+		for (i = 0; i < nsamples; i++)
+		{
+			for (j = 0; j < ctx->nchannels; j++)
+				ctx->samples[j][i] = ctx->pcm[i * ctx->nchannels + j];
+		}
+		audio.samplerate = ctx->samplerate;
+		audio.nchannels = ctx->nchannels;
+		audio.nsamples = nsamples;
+		audio.bitspersample = 16;
+		audio.regain = 0;
+		audio.mode = 0;
+		for (j = 0; j < audio.nchannels; j++)
+			audio.samples[j] = ctx->samples[j];
+
+		ctx->nsamples += audio.nsamples;
+		if (ctx->nsamples >= ctx->samplerate)
+		{
+			ctx->position++;
+			ctx->nsamples -= ctx->samplerate;
+		}
+		while (audio.nsamples > 0)
+		{
+			if (filter_filloutput(ctx->filter, &audio, ctx->out) < 0)
+				break;
+		}
+		if (audio.nsamples > 0)
+		{
+			/**
+			 * flush the src jitter to break the stream
+			 */
+			ctx->in->ops->flush(ctx->in->ctx);
+			break;
+		}
+	}
+	filter_flushoutput(ctx->out);
+	dbg("decoder: stop running");
+	player_state(ctx->player, STATE_CHANGE);
+
+	return NULL;
+}
+
+static int _decoder_prepare(decoder_ctx_t *ctx, filter_t *filter, const char *info)
+{
+	ctx->filter = filter;
+	return 0;
+}
+
+static int _decoder_run(decoder_ctx_t *ctx, jitter_t *jitter)
+{
+	int ret = 0;
+	ctx->out = jitter;
+	/**
+	 * opus decodes to any of its internal samplerates,
+	 * otherwise the sink has to accept 48kHz
+	 */
+	switch (jitter_samplerate(jitter))
+	{
+	case 8000:
+	case 12000:
+	case 16000:
+	case 24000:
+		ctx->samplerate = jitter_samplerate(jitter);
+	break;
+	default:
+		ctx->samplerate = OPUS_SAMPLERATE;
+	}
+	int error = OPUS_OK;
+	ctx->decoder = opus_decoder_create(ctx->samplerate, ctx->nchannels, &error);
+	if (ctx->decoder == NULL)
+	{
+		err("decoder: opus error %s", opus_strerror(error));
+		return -1;
+	}
+	if (ctx->filter != NULL)
+	{
+		rescale_init(&ctx->rescale, 0, jitter->format);
+		ctx->filter->ops->set(ctx->filter->ctx, FILTER_SAMPLED, rescale_cb, &ctx->rescale, 0);
+		ret = ctx->filter->ops->set(ctx->filter->ctx, FILTER_FORMAT, jitter->format, FILTER_SAMPLERATE, ctx->samplerate, 0);
+	}
+	if (ret == 0 && ctx->in != NULL)
+		pthread_create(&ctx->thread, NULL, _decoder_thread, ctx);
+	return ret;
+}
+
+static const char *_decoder_mime(decoder_ctx_t *ctx)
+{
+	return mime_audioopus;
+}
+
+static int _decoder_checkout(decoder_ctx_t *ctx, jitter_format_t format)
+{
+	return (format & JITTER_AUDIO);
+}
+
+static uint32_t _decoder_position(decoder_ctx_t *ctx)
+{
+	return ctx->position;
+}
+
+static uint32_t _decoder_duration(decoder_ctx_t *ctx)
+{
+	return 0;
+}
+
+static void _decoder_destroy(decoder_ctx_t *ctx)
+{
+	if (ctx->out)
+		ctx->out->ops->flush(ctx->out->ctx);
+	if (ctx->in != NULL)
+		ctx->in->ops->flush(ctx->in->ctx);
+	if (ctx->thread > 0)
+		pthread_join(ctx->thread, NULL);
+	if (ctx->decoder)
+		opus_decoder_destroy(ctx->decoder);
+	if (ctx->in != NULL)
+		jitter_destroy(ctx->in);
+	if (ctx->filter)
+	{
+		ctx->filter->ops->destroy(ctx->filter->ctx);
+		free(ctx->filter);
+	}
+	int i;
+	for (i = 0; i < ctx->nchannels; i++)
+		free(ctx->samples[i]);
+	free(ctx->pcm);
+	free(ctx);
+}
+
+static const decoder_ops_t _decoder_opus =
+{
+	.name = "opus",
+	.checkin = _decoder_checkin,
+	.init = _decoder_init,
+	.prepare = _decoder_prepare,
+	.checkout = _decoder_checkout,
+	.jitter = _decoder_jitter,
+	.run = _decoder_run,
+	.mime = _decoder_mime,
+	.position = _decoder_position,
+	.duration = _decoder_duration,
+	.destroy = _decoder_destroy,
+};
+
+const decoder_ops_t *decoder_opus = &_decoder_opus;
+
+#ifdef DECODER_MODULES
+extern const decoder_ops_t decoder_ops __attribute__ ((weak, alias ("_decoder_opus")));
+#endif
@@ -48,11 +48,18 @@ struct demux_out_s
 	uint16_t pid;
 	decoder_t *estream;
 	jitter_t *jitter;
-	char *data;
+	unsigned char *data;
+	size_t length;
 	const char *mime;
+	/// the payload is pushed from the start of a PES
+	int synced;
+	int counterset;
+	uint8_t counter;
 	demux_out_t *next;
 };
 
+#define MAX_PIDS 16
+
 #ifdef LIBDVBPSI
 struct ts_pmt_s
 {
@@ -71,7 +78,21 @@ typedef struct demux_ctx_s src_ctx_t;
 struct demux_ctx_s
 {
 	uint32_t nbpackets;
-	uint8_t payloadsize;
+	uint32_t nbfiltered;
+	/// sync byte and PID of the wanted packets, see TS_HEADER_MASK
+	uint32_t filter[MAX_PIDS];
+	unsigned int nfilters;
+	uint32_t ccerrors;
+	uint32_t syncerrors;
+	/// PCR jitter against the arrival time (RFC 3550 A.8)
+	uint16_t pcrpid;
+	uint32_t npcrs;
+	uint64_t pcrorig;
+	uint64_t pcrlast;
+	uint64_t arrivalorig;
+	int64_t pcrdelta;
+	uint32_t pcrjitter;
+	uint32_t pcrjittermax;
 	demux_out_t *out;
 	jitter_t *in;
 	jitte_t jitte;
@@ -90,6 +111,7 @@ struct demux_ctx_s
 #include "src.h"
 #include "media.h"
 #include "jitter.h"
+#include "heartbeat.h"
 #include "dvb.h"
 
 #define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
@@ -105,6 +127,19 @@ struct demux_ctx_s
 #define BUFFERSIZE  1500
 #define NB_BUFFERS 6
 
+#define TS_SYNC 0x47
+#define TS_PACKETSIZE 188
+#define TS_MAXPACKETS (BUFFERSIZE / TS_PACKETSIZE)
+#define TS_NOPID 0x1FFF
+/**
+ * the first word of the TS packet contains the sync byte and the PID,
+ * one compare of the masked word checks both.
+ */
+#define TS_HEADER_MASK 0xFF1FFF00
+#define TS_HEADER_PID(pid) (((uint32_t)TS_SYNC << 24) | ((uint32_t)(pid) << 8))
+/// the PCR jitter is reported every DEMUX_STATS_PCRS
+#define DEMUX_STATS_PCRS 1024
+
 #define FULL_PCR
 #ifdef FULL_PCR
 #define PCR_MAX ((0x1FFFFFFull * 300 ) + 0x1FF)
@@ -138,6 +173,19 @@ static unsigned long long _pcr(unsigned char *offset)
 #define PCR_SET(p_pcr, value)	(*p_pcr = value)
 #define PCR_DIFF(p_pcr1, p_pcr2) (*p_pcr1 - *p_pcr2)
 
+static void _demux_wantpid(demux_ctx_t *ctx, uint16_t pid)
+{
+	uint32_t header = TS_HEADER_PID(pid);
+	unsigned int i;
+	for (i = 0; i < ctx->nfilters; i++)
+		if (ctx->filter[i] == header)
+			return;
+	if (i < MAX_PIDS)
+		ctx->filter[ctx->nfilters++] = header;
+	else
+		err("demux: too many PIDs to filter");
+}
+
 static int demux_createdecoder(demux_ctx_t *ctx, uint16_t pid, const char *mime, demux_out_t **pout)
 {
 	event_listener_t *listener = ctx->listener;
@@ -199,6 +247,7 @@ static void _dvbpsi_pmt(void *p_cb_data, dvbpsi_pmt_t *p_new_pmt)
 {
 	demux_ctx_t *ctx = (demux_ctx_t *)p_cb_data;
 	dbg("PMT programm es pid 0x%02X with pcr", p_new_pmt->i_pcr_pid);
+	_demux_wantpid(ctx, p_new_pmt->i_pcr_pid);
 	dvbpsi_pmt_es_t *dvbi_es = p_new_pmt->p_first_es;
 	while (dvbi_es != NULL)
 	{
@@ -244,6 +293,7 @@ void _dvbpsi_pat(void *p_cb_data, dvbpsi_pat_t *p_new_pat)
 			ctx->dvbpsi_pmts = pmt;
 		}
 		dbg("PAT programm %d pid 0x%02X",program->i_number, program->i_pid);
+		_demux_wantpid(ctx, program->i_pid);
 		pmt->pmt = dvbpsi_new(_dvbpsi_debug, DVBPSI_MSG_NONE);
 		dvbpsi_pmt_attach(pmt->pmt, program->i_number, _dvbpsi_pmt, (void *)ctx);
 		program = program->p_next;
@@ -288,63 +338,223 @@ int ts_synchronize(ts_t *stream, char *buffer, int max)
 		return 1;
 }
 #endif
-static int demux_parsecontent(demux_ctx_t *ctx, char *input, size_t len, demux_out_t *out)
+/**
+ * find the first packet of a buffer, the next sync byte must follow
+ */
+static int _demux_sync(const unsigned char *input, size_t len)
 {
-	if (out == NULL)
-		return 0;
-	if (len < ctx->payloadsize)
-		return -1;
-	if (out->data == NULL)
-		out->data = out->jitter->ops->pull(out->jitter->ctx);
-	len = ctx->payloadsize;
-	while (len > out->jitter->ctx->size)
+	size_t i;
+	for (i = 0; i < TS_PACKETSIZE && i < len; i++)
 	{
-		err("demux: udp packet has not to overflow 1500 bytes (%ld)", len);
-		memcpy(out->data, input, out->jitter->ctx->size);
-		out->jitter->ops->push(out->jitter->ctx, out->jitter->ctx->size, NULL);
-		len -= out->jitter->ctx->size;
-		input += out->jitter->ctx->size;
-		out->data = out->jitter->ops->pull(out->jitter->ctx);
+		if (input[i] == TS_SYNC &&
+			(i + TS_PACKETSIZE >= len || input[i + TS_PACKETSIZE] == TS_SYNC))
+			return i;
 	}
-	memcpy(out->data, input, len);
-	demux_dbg("demux: push %ld", len);
-	out->jitter->ops->push(out->jitter->ctx, len, NULL);
-	out->data = NULL;
-	return ctx->payloadsize;
+	return -1;
 }
 
-static int demux_parseheader(demux_ctx_t *ctx, char *buffer, size_t length, demux_out_t **pout)
+/**
+ * The whole buffer is scanned before any parsing. Only the header word
+ * of each packet is loaded and compared to the wanted PIDs, the other
+ * packets of the multiplex are never touched.
+ */
+static unsigned int _demux_filter(demux_ctx_t *ctx, const unsigned char *input, size_t len, const unsigned char **packets)
 {
-	int ret = 0;
-	char *offset = buffer;
+	unsigned int npackets = 0;
+	const unsigned char *end = input + len;
+	const unsigned char *packet = input;
+	while (packet + TS_PACKETSIZE <= end)
+	{
+		uint32_t header = ((uint32_t)packet[0] << 24) | (packet[1] << 16) | (packet[2] << 8) | packet[3];
+		if (packet[0] != TS_SYNC)
+		{
+			int offset = _demux_sync(packet, end - packet);
+			ctx->syncerrors++;
+			if (offset <= 0)
+				break;
+			packet += offset;
+			continue;
+		}
+		ctx->nbpackets++;
+		header &= TS_HEADER_MASK;
+		unsigned int i;
+		for (i = 0; i < ctx->nfilters; i++)
+		{
+			if (header == ctx->filter[i])
+			{
+				packets[npackets++] = packet;
+				break;
+			}
+		}
+		packet += TS_PACKETSIZE;
+	}
+	ctx->nbfiltered += npackets;
+	return npackets;
+}
 
-	ts_packet_header_t *header = (ts_packet_header_t *)offset;
-	if (length < sizeof(*header))
-		return -1;
+static uint64_t _demux_arrival(const beat_t *beat)
+{
+	struct timespec now;
+	if (beat != NULL && beat->isset)
+	{
+		now.tv_sec = beat->timestamp.sec;
+		now.tv_nsec = beat->timestamp.nsec;
+	}
+	else
+		clock_gettime(CLOCK_REALTIME, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
 
-	int16_t pid = ((header->decoded.hpid & 0x1F) << 8) + header->decoded.lpid;
+static void _demux_stats(demux_ctx_t *ctx)
+{
+	warn("demux: %u/%u packets filtered, %u continuity errors, %u sync errors",
+		ctx->nbfiltered, ctx->nbpackets, ctx->ccerrors, ctx->syncerrors);
+	if (ctx->npcrs > 0)
+		warn("demux: pid 0x%02X pcr jitter %uus (max %uus) over %u pcrs",
+			ctx->pcrpid, ctx->pcrjitter, ctx->pcrjittermax, ctx->npcrs);
+}
 
-	ctx->nbpackets++;
-	if (header->decoded.sync != 0x47)
+/**
+ * the interarrival jitter of RFC 3550 applied to the PCR in us
+ */
+static void _demux_pcrjitter(demux_ctx_t *ctx, uint16_t pid, uint64_t pcr, uint64_t arrival, int discontinuity)
+{
+	if (ctx->pcrpid == TS_NOPID)
+		ctx->pcrpid = pid;
+	if (pid != ctx->pcrpid)
+		return;
+	if (ctx->npcrs == 0 || discontinuity || pcr < ctx->pcrlast)
 	{
-		err("TS buffer is not a packet");
-		return -1;
+		/// the clock starts again
+		ctx->pcrorig = pcr;
+		ctx->arrivalorig = arrival;
+		ctx->pcrdelta = 0;
 	}
-#ifdef DEBUG
 	else
 	{
-		fprintf(stderr, "pid: 0x%02X ", pid);
-		fprintf(stderr, "counter %u ", header->decoded.counter);
-		if (header->decoded.payload)
-			fprintf(stderr, "payload ");
-		if (header->decoded.scrambling)
-			fprintf(stderr, "scrambling ");
-		if (header->decoded.adaption)
-			fprintf(stderr, "adaption ");
-		fprintf(stderr, "\n");
+		int64_t delta = (int64_t)(arrival - ctx->arrivalorig) - (int64_t)((pcr - ctx->pcrorig) / 27);
+		int64_t d = delta - ctx->pcrdelta;
+		if (d < 0)
+			d = -d;
+		ctx->pcrjitter += (d - (int64_t)ctx->pcrjitter) / 16;
+		if (d > ctx->pcrjittermax)
+			ctx->pcrjittermax = d;
+		ctx->pcrdelta = delta;
 	}
-#endif
-	//short pid = ntohs((short)header->decoded.pid);
+	ctx->pcrlast = pcr;
+	ctx->npcrs++;
+	if ((ctx->npcrs % DEMUX_STATS_PCRS) == 0)
+		_demux_stats(ctx);
+}
+
+static void _demux_pushout(demux_out_t *out)
+{
+	if (out->data != NULL && out->length > 0)
+	{
+		demux_dbg("demux: push %ld", out->length);
+		out->jitter->ops->push(out->jitter->ctx, out->length, NULL);
+		out->data = NULL;
+		out->length = 0;
+	}
+}
+
+#define PES_HEADERLENGTH 6
+#define PES_PROGRAM_STREAM_MAP 0xBC
+#define PES_PADDING_STREAM 0xBE
+#define PES_PRIVATE_STREAM_2 0xBF
+#define PES_ECM_STREAM 0xF0
+#define PES_EMM_STREAM 0xF1
+#define PES_PROGRAM_STREAM_DIRECTORY 0xFF
+#define PES_DSMCC_STREAM 0xF2
+#define PES_H2221_TYPE_E 0xF8
+/**
+ * ISO 13818-1 2.4.3.7: some stream ids don't have the optional header
+ * of the PES, the data follows the PES_packet_length.
+ */
+static int _demux_pesoptional(unsigned char streamid)
+{
+	switch (streamid)
+	{
+	case PES_PROGRAM_STREAM_MAP:
+	case PES_PADDING_STREAM:
+	case PES_PRIVATE_STREAM_2:
+	case PES_ECM_STREAM:
+	case PES_EMM_STREAM:
+	case PES_PROGRAM_STREAM_DIRECTORY:
+	case PES_DSMCC_STREAM:
+	case PES_H2221_TYPE_E:
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * The PES header is removed and the elementary stream is pushed
+ * to the decoder.
+ */
+static int demux_parsecontent(demux_ctx_t *ctx, const unsigned char *input, size_t len, int start, demux_out_t *out)
+{
+	if (out == NULL || out->jitter == NULL)
+		return 0;
+	if (start)
+	{
+		_demux_pushout(out);
+		out->synced = 0;
+		if (len < 9 || input[0] != 0x00 || input[1] != 0x00 || input[2] != 0x01)
+		{
+			warn("demux: pid 0x%02X PES not found", out->pid);
+			return -1;
+		}
+		unsigned char streamid = input[3];
+		/// the padding stream doesn't carry any data
+		if (streamid == PES_PADDING_STREAM)
+			return 0;
+		size_t headerlen = PES_HEADERLENGTH;
+		if (_demux_pesoptional(streamid))
+			headerlen = 9 + input[8];
+		if (headerlen > len)
+			return -1;
+		input += headerlen;
+		len -= headerlen;
+		out->synced = 1;
+	}
+	/// wait the next PES after a lost
+	if (!out->synced)
+		return 0;
+	while (len > 0)
+	{
+		if (out->data == NULL)
+		{
+			out->data = out->jitter->ops->pull(out->jitter->ctx);
+			out->length = 0;
+			if (out->data == NULL)
+				return -1;
+		}
+		size_t length = out->jitter->ctx->size - out->length;
+		if (length > len)
+			length = len;
+		memcpy(out->data + out->length, input, length);
+		out->length += length;
+		input += length;
+		len -= length;
+		if (out->length == out->jitter->ctx->size)
+			_demux_pushout(out);
+	}
+	return 0;
+}
+
+static int demux_parseheader(demux_ctx_t *ctx, const unsigned char *buffer, uint64_t arrival, demux_out_t **pout)
+{
+	const unsigned char *offset = buffer;
+	ts_packet_header_t *header = (ts_packet_header_t *)offset;
+	uint16_t pid = ((header->decoded.hpid & 0x1F) << 8) + header->decoded.lpid;
+
+	demux_dbg("pid: 0x%02X counter %u%s%s%s", pid, header->decoded.counter,
+		header->decoded.payload? " payload": "",
+		header->decoded.scrambling? " scrambling": "",
+		header->decoded.adaption? " adaption": "");
+	if (header->decoded.transport_error || header->decoded.scrambling)
+		return -1;
 
 	uint64_t pcr = 0;
 	demux_out_t *out = ctx->out;
@@ -372,36 +582,47 @@ static int demux_parseheader(demux_ctx_t *ctx, char *buffer, size_t length, demu
 	if (pid == 0x42 && out == NULL && demux_createdecoder(ctx, pid, mime_audiopcm, &out) < 0)
 			return -1;
 #endif
+	offset += sizeof(*header);
+	int discontinuity = 0;
 	if (header->decoded.adaption)
 	{
-		offset += sizeof(*header);
 		ts_packet_adaption_t *adaption = (ts_packet_adaption_t *)offset;
-		offset +=  sizeof(*adaption);
-		if (adaption->decoded.pcr)
-		{
-			pcr = _pcr(offset);
-			dbg("pid: 0x%02X adaption pcr %lu ", pid, pcr);
-			offset += 6;
-		}
-		if (adaption->decoded.opcr)
-		{
-			unsigned long int opcr = _pcr(offset);
-			dbg("opcr %06lX ", opcr);
-			offset += 6;
-		}
-		if (adaption->decoded.splicing)
+		const unsigned char *field = offset + sizeof(*adaption);
+		/// the length byte is not included into the length
+		offset += 1 + adaption->decoded.length;
+		if (offset > buffer + TS_PACKETSIZE)
+			return -1;
+		if (adaption->decoded.length > 0)
 		{
-			unsigned char splicing = *offset;
-			dbg("splicing %d ", splicing);
-			offset += sizeof(splicing);
+			discontinuity = adaption->decoded.discontinuity;
+			if (adaption->decoded.pcr)
+			{
+				pcr = _pcr((unsigned char *)field);
+				dbg("pid: 0x%02X adaption pcr %lu ", pid, pcr);
+				_demux_pcrjitter(ctx, pid, pcr, arrival, discontinuity);
+			}
 		}
-		if (adaption->decoded.private)
+	}
+	if (!header->decoded.payload)
+		return 0;
+	if (out != NULL)
+	{
+		uint8_t counter = header->decoded.counter;
+		if (out->counterset && !discontinuity)
 		{
-			unsigned char privatelength = *offset;
-			dbg("privatelength %d ", privatelength);
-			offset += sizeof(privatelength);
-			offset += privatelength;
+			/// a packet may be sent twice
+			if (counter == out->counter)
+				return 0;
+			if (counter != ((out->counter + 1) & 0x0F))
+			{
+				ctx->ccerrors++;
+				warn("demux: pid 0x%02X continuity error %u/%u (%u errors)",
+					pid, out->counter, counter, ctx->ccerrors);
+				out->synced = 0;
+			}
 		}
+		out->counter = counter;
+		out->counterset = 1;
 	}
 	*pout = out;
 	return offset - buffer;
@@ -413,10 +634,16 @@ static demux_ctx_t *demux_init(player_ctx_t *player, const char *url, const char
 {
 	demux_ctx_t *ctx = calloc(1, sizeof(*ctx));
 	ctx->mime = utils_mime2mime(mime);
-	ctx->payloadsize = 184;
+	ctx->pcrpid = TS_NOPID;
 #ifdef LIBDVBPSI
 	ctx->dvbpsi_pat = dvbpsi_new(_dvbpsi_debug, DVBPSI_MSG_DEBUG);
 	dvbpsi_pat_attach(ctx->dvbpsi_pat, _dvbpsi_pat, (void *)ctx);
+	_demux_wantpid(ctx, 0x0000);
+#else
+	_demux_wantpid(ctx, 0x39);
+	_demux_wantpid(ctx, 0x40);
+	_demux_wantpid(ctx, 0x41);
+	_demux_wantpid(ctx, 0x42);
 #endif
 	return ctx;
 }
@@ -443,28 +670,43 @@ static void *demux_thread(void *arg)
 	int run = 1;
 	do
 	{
-		char *input;
-		input = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		unsigned char *input;
+		beat_t *beat = NULL;
+		input = ctx->in->ops->peer(ctx->in->ctx, (void **)&beat);
 		if (input == NULL)
 		{
 			run = 0;
 			break;
 		}
 
-		int len;
+		size_t len;
 		len = ctx->in->ops->length(ctx->in->ctx);
-		demux_out_t *out = NULL;
-		int headerlen = 0;
+		uint64_t arrival = _demux_arrival(beat);
+		const unsigned char *packets[TS_MAXPACKETS];
+		unsigned int npackets = 0;
 		if (len > 0)
-			headerlen = demux_parseheader(ctx, input, len, &out);
+			npackets = _demux_filter(ctx, input, len, packets);
 		else
 			warn("demux: empty buffer %p", input);
-		if (headerlen > 0)
+		unsigned int i;
+		for (i = 0; i < npackets; i++)
 		{
-			demux_parsecontent(ctx, input + headerlen, len - headerlen, out);
+			demux_out_t *out = NULL;
+			int headerlen = demux_parseheader(ctx, packets[i], arrival, &out);
+			if (headerlen > 0 && headerlen < TS_PACKETSIZE)
+			{
+				ts_packet_header_t *header = (ts_packet_header_t *)packets[i];
+				demux_parsecontent(ctx, packets[i] + headerlen, TS_PACKETSIZE - headerlen,
+						header->decoded.start_payload, out);
+			}
 		}
 		ctx->in->ops->pop(ctx->in->ctx, len);
+		/// the decoders receive the data of each datagram without waiting the next PES
+		demux_out_t *out;
+		for (out = ctx->out; out != NULL; out = out->next)
+			_demux_pushout(out);
 	} while (run);
+	_demux_stats(ctx);
 	return NULL;
 }
 
@@ -520,6 +762,7 @@ static int demux_attach(demux_ctx_t *ctx, long index, decoder_t *decoder)
 	}
 	out->estream = decoder;
 	out->jitter = decoder->ops->jitter(out->estream->ctx, ctx->jitte);
+	_demux_wantpid(ctx, index);
 	return 0;
 }
 
@@ -34,7 +34,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <byteswap.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include <pthread.h>
 
@@ -42,22 +45,87 @@
 #include "decoder.h"
 #include "event.h"
 #include "heartbeat.h"
+#include "jitter.h"
+#include "rtp.h"
 typedef struct src_s demux_t;
 typedef struct src_ops_s demux_ops_t;
 
-#define NB_LOOPS 21
 #define NB_BUFFERS 24
 #define BUFFERSIZE 1500
 
-#ifdef DEMUX_RTP_REORDER
-typedef struct demux_reorder_s demux_reorder_t;
-struct demux_reorder_s
+#ifdef DEMUX_RTP_PLAYOUT
+/// target delay of the playout buffer in ms
+#define PLAYOUT_DELAY 60
+
+typedef struct demux_playout_s demux_playout_t;
+struct demux_playout_s
 {
 	char buffer[BUFFERSIZE];
 	size_t len;
-	char id;
+	uint32_t timestamp;
+	/// arrival time of the packet in ms
+	uint64_t arrival;
+	uint16_t seqnum;
 	char ready;
 };
+
+typedef enum
+{
+	/// the decoder resynchronizes itself on the next frame
+	PLAYOUT_SKIP,
+	/// the payload is PCM, the hole is filled with silence
+	PLAYOUT_SILENCE,
+	/// one frame by packet, the previous frame is played again
+	PLAYOUT_REPEAT,
+} demux_conceal_t;
+#endif
+
+#ifdef DEMUX_RTP_FEC
+#ifndef DEMUX_RTP_PLAYOUT
+#error "DEMUX_RTP_FEC needs DEMUX_RTP_PLAYOUT"
+#endif
+/// number of parity packets waiting for the recovery
+#define FEC_PENDING 32
+
+typedef struct demux_fec_s demux_fec_t;
+struct demux_fec_s
+{
+	rtpfec_t header;
+	char buffer[BUFFERSIZE];
+	size_t len;
+	char ready;
+};
+#endif
+
+#ifdef RTP_RTCP
+typedef struct demux_rtcp_s demux_rtcp_t;
+struct demux_rtcp_s
+{
+	int sock;
+	struct sockaddr_in addr;
+	uint32_t ssrc;
+	/// ssrc of the sender
+	uint32_t sender;
+	char started;
+	uint16_t baseseq;
+	uint16_t maxseq;
+	uint32_t cycles;
+	uint32_t received;
+	uint32_t expectedprior;
+	uint32_t receivedprior;
+	int64_t transit;
+	/// interarrival jitter in ms, scaled by 16
+	uint32_t jitter;
+	/// delay between the sending and the arrival in ms
+	int32_t delay;
+	/// middle of the NTP timestamp of the last sender report
+	uint32_t lsr;
+	uint64_t lsrarrival;
+	/// wallclock (ms) and RTP timestamp of the last sender report
+	uint64_t wallclock;
+	uint32_t timestamp;
+	uint64_t reporttime;
+};
 #endif
 
 typedef struct demux_out_s demux_out_t;
@@ -66,14 +134,38 @@ struct demux_out_s
 	decoder_t *estream;
 	uint32_t ssrc;
 	uint32_t ssrc2;
+	/// even ssrc of the session in host order, the key of the hash table
+	uint32_t sessionid;
+	/// index of the output which plays the session
+	int index;
 	jitter_t *jitter;
 	char *data;
 	const char *mime;
 	short cc;
 	uint8_t pt;
+#ifdef DEMUX_RTP_PLAYOUT
+	demux_playout_t *playout;
+	demux_conceal_t conceal;
+	/// sequence number of the next packet to release
+	uint16_t seqnext;
+	char started;
+	/// copy of the last released payload for the concealment
+	char last[BUFFERSIZE];
+	size_t lastlen;
+	uint32_t lasttimestamp;
+#endif
+#ifdef DEMUX_RTP_FEC
+	demux_fec_t *fec;
+	unsigned int fecnext;
+#endif
 	demux_out_t *next;
+	demux_out_t *hnext;
 };
 
+/// the sessions are found with the ssrc of each packet
+#define DEMUX_SESSIONS_HASH 32
+#define DEMUX_SESSION_HASH(ssrc) (((ssrc) >> 1) % DEMUX_SESSIONS_HASH)
+
 typedef struct demux_profile_s demux_profile_t;
 struct demux_profile_s
 {
@@ -88,6 +180,10 @@ typedef struct demux_ctx_s src_ctx_t;
 struct demux_ctx_s
 {
 	demux_out_t *out;
+	demux_out_t *sessions[DEMUX_SESSIONS_HASH];
+	/// number of sessions decoded together
+	unsigned int maxsessions;
+	unsigned int nsessions;
 	player_ctx_t *player;
 	jitter_t *in;
 	jitte_t jitte;
@@ -96,8 +192,18 @@ struct demux_ctx_s
 	uint16_t seqnum;
 	uint16_t seqorig;
 	unsigned long missing;
-#ifdef DEMUX_RTP_REORDER
-	demux_reorder_t *reorder;
+#ifdef DEMUX_RTP_PLAYOUT
+	/// target delay in ms
+	unsigned int delay;
+	unsigned long npackets;
+	unsigned long late;
+	unsigned long duplicate;
+#endif
+#ifdef DEMUX_RTP_FEC
+	unsigned long recovered;
+#endif
+#ifdef RTP_RTCP
+	demux_rtcp_t rtcp;
 #endif
 	uint32_t lasttimestamp;
 	const char *mime;
@@ -120,8 +226,6 @@ struct demux_ctx_s
 #include "demux.h"
 #include "src.h"
 #include "media.h"
-#include "jitter.h"
-#include "rtp.h"
 
 #define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
 #define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
@@ -149,6 +253,38 @@ static void _demux_player_cb(void *arg, event_t event, void *data)
 	}
 }
 
+#ifdef RTP_RTCP
+static void _demux_rtcpinit(demux_ctx_t *ctx, const char *search)
+{
+	demux_rtcp_t *rtcp = &ctx->rtcp;
+	rtcp->sock = -1;
+	rtcp->ssrc = random();
+	char host[64] = {0};
+	/// rfc3551
+	int port = 5005;
+	if (ctx->port != NULL)
+		port = atoi(ctx->port) + 1;
+	const char *string = NULL;
+	if (search != NULL)
+		string = strstr(search, "rtcp=");
+	if (string != NULL)
+		sscanf(string + 5, "%63[^:&]:%d", host, &port);
+	else if (ctx->host != NULL && IN_MULTICAST(ntohl(inet_addr(ctx->host))))
+		snprintf(host, sizeof(host), "%s", ctx->host);
+	if (host[0] == '\0')
+	{
+		warn("demux: rtcp receiver reports disabled, set rtcp=<host>:<port>");
+		return;
+	}
+	rtcp->addr.sin_family = AF_INET;
+	rtcp->addr.sin_addr.s_addr = inet_addr(host);
+	rtcp->addr.sin_port = htons(port);
+	rtcp->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (rtcp->sock < 0)
+		err("demux: rtcp socket error %s", strerror(errno));
+}
+#endif
+
 static demux_ctx_t *demux_init(player_ctx_t *player, const char *url, const char *mime)
 {
 	demux_ctx_t *ctx = calloc(1, sizeof(*ctx));
@@ -156,8 +292,9 @@ static demux_ctx_t *demux_init(player_ctx_t *player, const char *url, const char
 	ctx->mime = utils_mime2mime(mime);
 	demux_profile_t *profile = NULL;
 	ctx->nbbuffers = NB_BUFFERS;
-#ifdef DEMUX_RTP_REORDER
-	ctx->reorder = calloc(ctx->nbbuffers, sizeof(*ctx->reorder));
+	ctx->maxsessions = 1;
+#ifdef DEMUX_RTP_PLAYOUT
+	ctx->delay = PLAYOUT_DELAY;
 #endif
 	char pt = 20;
 	uint32_t ssrc = 0;
@@ -191,15 +328,48 @@ static demux_ctx_t *demux_init(player_ctx_t *player, const char *url, const char
 			string += 5;
 			sscanf(string, "%hd", &ctx->nbbuffers);
 		}
+#ifdef DEMUX_RTP_PLAYOUT
+		string = strstr(search, "delay=");
+		if (string != NULL)
+		{
+			string += 6;
+			sscanf(string, "%u", &ctx->delay);
+		}
+		/**
+		 * sessions=N decodes up to N senders of the group together,
+		 * each one on its own output.
+		 */
+		string = strstr(search, "sessions=");
+		if (string != NULL)
+		{
+			string += 9;
+			sscanf(string, "%u", &ctx->maxsessions);
+			if (ctx->maxsessions < 1)
+				ctx->maxsessions = 1;
+			if (ctx->maxsessions > MAX_ESTREAM)
+				ctx->maxsessions = MAX_ESTREAM;
+		}
+#endif
 	}
 
 	demux_rtp_addprofile(ctx, 14, mime_audiomp3);
 	demux_rtp_addprofile(ctx, 11, mime_audiopcm);
 	demux_rtp_addprofile(ctx, 46, mime_audioflac);
+#ifdef DECODER_LPCM
+	demux_rtp_addprofile(ctx, 10, mime_audiol16);
+	demux_rtp_addprofile(ctx, RTP_PT_L16, mime_audiol16);
+	demux_rtp_addprofile(ctx, RTP_PT_L24, mime_audiol24);
+#endif
+#ifdef DECODER_OPUS
+	demux_rtp_addprofile(ctx, RTP_PT_OPUS, mime_audioopus);
+#endif
 	warn("demux: add profile %s on %d", mime, pt);
 	demux_rtp_addprofile(ctx, pt, mime);
 
 	ctx->sessionid = ssrc;
+#ifdef RTP_RTCP
+	_demux_rtcpinit(ctx, search);
+#endif
 	player_eventlistener(player, _demux_player_cb, ctx, jitter_name);
 #ifdef DEMUX_DUMP
 	ctx->dumpfd = open("rtp_dump.rtp", O_RDWR | O_CREAT, 0644);
@@ -248,12 +418,42 @@ void demux_rtp_addprofile(demux_ctx_t *ctx, char pt, const char *mime)
 	ctx->profiles = profile;
 }
 
+static demux_out_t *_demux_session(demux_ctx_t *ctx, uint32_t ssrc)
+{
+	ssrc &= ~0x01;
+	demux_out_t *out = ctx->sessions[DEMUX_SESSION_HASH(ssrc)];
+	while (out != NULL && out->sessionid != ssrc)
+		out = out->hnext;
+	return out;
+}
+
+static void _demux_rekey(demux_ctx_t *ctx, demux_out_t *out, uint32_t ssrc)
+{
+	demux_out_t **it = &ctx->sessions[DEMUX_SESSION_HASH(out->sessionid)];
+	while (*it != NULL && *it != out)
+		it = &(*it)->hnext;
+	if (*it != NULL)
+		*it = out->hnext;
+	ctx->sessionid = ssrc & ~0x01;
+	ctx->sessionid2 = ctx->sessionid + 1;
+	/// out->ssrc stays the id of the stream for the player
+	out->sessionid = ctx->sessionid;
+	out->hnext = ctx->sessions[DEMUX_SESSION_HASH(out->sessionid)];
+	ctx->sessions[DEMUX_SESSION_HASH(out->sessionid)] = out;
+}
+
 static demux_out_t *_demux_getout(demux_ctx_t *ctx, uint32_t ssrc, rtpheader_t *header, rtpext_t *extheader)
 {
-	demux_out_t *out;
-	out = ctx->out;
-	while (out != NULL && out->ssrc != ssrc && out->ssrc2 != ssrc && out->pt != header->b.pt)
-		out = out->next;
+	demux_out_t *out = _demux_session(ctx, ssrc);
+	/// the single session is kept when the sender changes
+	if (out == NULL && ctx->maxsessions == 1)
+	{
+		out = ctx->out;
+		while (out != NULL && out->pt != header->b.pt)
+			out = out->next;
+		if (out != NULL)
+			_demux_rekey(ctx, out, ssrc);
+	}
 	if (out == NULL)
 	{
 		if (!(ssrc % 2))
@@ -275,18 +475,39 @@ static demux_out_t *_demux_getout(demux_ctx_t *ctx, uint32_t ssrc, rtpheader_t *
 		out->mime = mime;
 		out->ssrc = __bswap_32(ctx->sessionid);
 		out->ssrc2 = __bswap_32(ctx->sessionid2);
+		out->sessionid = ctx->sessionid;
+		/// one output by session, the single session uses always the first one
+		out->index = (ctx->maxsessions > 1)? ctx->nsessions: 0;
+		ctx->nsessions++;
 		out->pt = header->b.pt;
 		out->cc = header->b.cc;
+#ifdef DEMUX_RTP_PLAYOUT
+		out->playout = calloc(ctx->nbbuffers, sizeof(*out->playout));
+		out->conceal = PLAYOUT_SKIP;
+		if (mime == mime_audiol16 || mime == mime_audiol24 || mime == mime_audiopcm)
+			out->conceal = PLAYOUT_SILENCE;
+		else if (mime == mime_audioopus)
+			out->conceal = PLAYOUT_REPEAT;
+		/**
+		 * mp3 and aac are cut without care of the frames,
+		 * a repeated packet should break the bitstream.
+		 */
+#endif
+#ifdef DEMUX_RTP_FEC
+		out->fec = calloc(FEC_PENDING, sizeof(*out->fec));
+#endif
 		out->next = ctx->out;
 		ctx->out = out;
+		out->hnext = ctx->sessions[DEMUX_SESSION_HASH(out->sessionid)];
+		ctx->sessions[DEMUX_SESSION_HASH(out->sessionid)] = out;
 		warn("demux: new rtp substream %d %s(%d)", header->ssrc, out->mime, header->b.pt);
 		event_listener_t *listener = ctx->listener;
 		const char *ext = NULL;
 		if (extheader)
 			ext = (char *)(extheader + sizeof (*extheader));
 		const src_t src = { .ops = demux_rtp, .ctx = ctx, .info = ext };
-		event_new_es_t event = {.pid = out->ssrc, .src = &src, .mime = out->mime, .jitte = JITTE_HIGH};
-		event_decode_es_t event_decode = {.src = &src};
+		event_new_es_t event = {.pid = out->ssrc, .src = &src, .mime = out->mime, .jitte = JITTE_HIGH, .index = out->index};
+		event_decode_es_t event_decode = {.src = &src, .index = out->index};
 		while (listener != NULL)
 		{
 			listener->cb(listener->arg, SRC_EVENT_NEW_ES, (void *)&event);
@@ -299,9 +520,406 @@ static demux_out_t *_demux_getout(demux_ctx_t *ctx, uint32_t ssrc, rtpheader_t *
 	return out;
 }
 
-static size_t demux_parseheader(demux_ctx_t *ctx, unsigned char *input, size_t len)
+#if defined(DEMUX_RTP_PLAYOUT) || defined(RTP_RTCP)
+static uint64_t _demux_arrival(const beat_t *beat)
+{
+	struct timespec now;
+	if (beat != NULL && beat->isset)
+	{
+		now.tv_sec = beat->timestamp.sec;
+		now.tv_nsec = beat->timestamp.nsec;
+	}
+	else
+		clock_gettime(CLOCK_REALTIME, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+#endif
+
+#ifdef RTP_RTCP
+static void _demux_rtcpreport(demux_ctx_t *ctx, uint64_t now)
+{
+	demux_rtcp_t *rtcp = &ctx->rtcp;
+	rtcp->reporttime = now;
+	if (rtcp->sock < 0)
+		return;
+	uint32_t extended = rtcp->cycles + rtcp->maxseq;
+	uint32_t expected = extended - rtcp->baseseq + 1;
+	int32_t lost = expected - rtcp->received;
+	uint32_t expectedinterval = expected - rtcp->expectedprior;
+	uint32_t receivedinterval = rtcp->received - rtcp->receivedprior;
+	int32_t lostinterval = expectedinterval - receivedinterval;
+	rtcp->expectedprior = expected;
+	rtcp->receivedprior = rtcp->received;
+	uint8_t fraction = 0;
+	if (expectedinterval > 0 && lostinterval > 0)
+		fraction = (lostinterval << 8) / expectedinterval;
+	if (lost > 0x7fffff)
+		lost = 0x7fffff;
+	if (lost < -0x800000)
+		lost = -0x800000;
+
+	uint32_t buffer[(sizeof(rtcpheader_t) + sizeof(rtcpreport_t) + sizeof(rtcpext_putv_t)) / sizeof(uint32_t)] = {0};
+	rtcpheader_t *header = (rtcpheader_t *)buffer;
+	header->v = 2;
+	header->rc = 1;
+	header->pt = RTCP_RR;
+	header->length = htons(sizeof(buffer) / sizeof(uint32_t) - 1);
+	header->ssrc = htonl(rtcp->ssrc);
+	rtcpreport_t *report = (rtcpreport_t *)(header + 1);
+	report->ssrc = htonl(rtcp->sender);
+	report->lost = htonl(fraction << 24 | (lost & 0xffffff));
+	report->highest = htonl(extended);
+	/// the timestamp runs at 100Hz
+	report->jitter = htonl((rtcp->jitter >> 4) * 1000000 / RTP_HEARTBEAT_TIMELAPS);
+	report->lsr = htonl(rtcp->lsr);
+	if (rtcp->lsr != 0)
+		report->dlsr = htonl((now - rtcp->lsrarrival) * 65536 / 1000);
+	rtcpext_putv_t *ext = (rtcpext_putv_t *)(report + 1);
+	ext->delay = htonl(rtcp->delay);
+	ext->jitter = htonl((rtcp->jitter >> 4) * 1000);
+	if (sendto(rtcp->sock, buffer, sizeof(buffer), MSG_DONTWAIT,
+			(struct sockaddr *)&rtcp->addr, sizeof(rtcp->addr)) < 0)
+		warn("demux: rtcp report error %s", strerror(errno));
+	demux_dbg("demux: rtcp report lost %d jitter %u delay %d", lost, rtcp->jitter >> 4, rtcp->delay);
+}
+
+/**
+ * RFC 3550 A.1 and A.8: sequence number cycles and interarrival jitter
+ */
+static void _demux_rtcpupdate(demux_ctx_t *ctx, uint32_t ssrc, uint16_t seqnum, uint32_t timestamp, uint64_t arrival)
+{
+	demux_rtcp_t *rtcp = &ctx->rtcp;
+	if (!rtcp->started || rtcp->sender != ssrc)
+	{
+		rtcp->sender = ssrc;
+		rtcp->started = 1;
+		rtcp->baseseq = seqnum;
+		rtcp->maxseq = seqnum;
+		rtcp->cycles = 0;
+		rtcp->received = 0;
+		rtcp->expectedprior = 0;
+		rtcp->receivedprior = 0;
+		rtcp->jitter = 0;
+		rtcp->reporttime = arrival;
+	}
+	else if ((int16_t)(seqnum - rtcp->maxseq) > 0)
+	{
+		if (seqnum < rtcp->maxseq)
+			rtcp->cycles += 0x10000;
+		rtcp->maxseq = seqnum;
+	}
+	rtcp->received++;
+	int64_t transit = (int64_t)arrival - (int64_t)timestamp * (RTP_HEARTBEAT_TIMELAPS / 1000000);
+	if (rtcp->received > 1)
+	{
+		int64_t d = transit - rtcp->transit;
+		if (d < 0)
+			d = -d;
+		rtcp->jitter += d - ((rtcp->jitter + 8) >> 4);
+	}
+	rtcp->transit = transit;
+	if (rtcp->wallclock > 0)
+		rtcp->delay = arrival - (rtcp->wallclock +
+				(int32_t)(timestamp - rtcp->timestamp) * (RTP_HEARTBEAT_TIMELAPS / 1000000));
+	if (arrival >= rtcp->reporttime + RTCP_INTERVAL * 1000)
+		_demux_rtcpreport(ctx, arrival);
+}
+
+static void _demux_rtcp(demux_ctx_t *ctx, const unsigned char *input, size_t len, uint64_t arrival)
+{
+	demux_rtcp_t *rtcp = &ctx->rtcp;
+	while (len >= sizeof(rtcpheader_t))
+	{
+		const rtcpheader_t *header = (const rtcpheader_t *)input;
+		size_t length = (ntohs(header->length) + 1) * sizeof(uint32_t);
+		if (length > len)
+			break;
+		if (header->pt == RTCP_SR && length >= sizeof(*header) + sizeof(rtcpsender_t) &&
+			(!rtcp->started || ntohl(header->ssrc) == rtcp->sender))
+		{
+			const rtcpsender_t *sender = (const rtcpsender_t *)(header + 1);
+			uint32_t ntpsec = ntohl(sender->ntpsec);
+			uint32_t ntpfrac = ntohl(sender->ntpfrac);
+			rtcp->lsr = (ntpsec << 16) | (ntpfrac >> 16);
+			rtcp->lsrarrival = arrival;
+			rtcp->wallclock = (uint64_t)(ntpsec - RTCP_NTPOFFSET) * 1000 + (((uint64_t)ntpfrac * 1000) >> 32);
+			rtcp->timestamp = ntohl(sender->timestamp);
+			demux_dbg("demux: rtcp sender %u packets %u octets", ntohl(sender->packets), ntohl(sender->octets));
+		}
+		input += length;
+		len -= length;
+	}
+}
+#endif
+
+#ifdef DEMUX_RTP_PLAYOUT
+static int _demux_push(demux_ctx_t *ctx, demux_out_t *out, const char *input, size_t len, uint32_t pulses)
+{
+	while (len > 0)
+	{
+		size_t length = len;
+		if (length > out->jitter->ctx->size)
+		{
+			err("demux: udp packet has not to overflow 1500 bytes (%ld)", len);
+			length = out->jitter->ctx->size;
+		}
+		out->data = out->jitter->ops->pull(out->jitter->ctx);
+		if (out->data == NULL)
+			return -1;
+		if (input != NULL)
+			memcpy(out->data, input, length);
+		else
+			memset(out->data, 0, length);
+#ifdef DEMUX_DUMP
+		if (ctx->dumpfd > 0)
+		{
+			write(ctx->dumpfd, out->data, length);
+		}
+#endif
+		demux_dbg("demux: push %ld", length);
+		beat_t beat = {0};
+#ifdef DEMUX_HEARTBEAT
+		beat.pulse.pulses = pulses;
+#endif
+		out->jitter->ops->push(out->jitter->ctx, length, &beat);
+		out->data = NULL;
+		pulses = 0;
+		len -= length;
+		if (input != NULL)
+			input += length;
+	}
+	return 0;
+}
+
+static void _demux_conceal(demux_ctx_t *ctx, demux_out_t *out, uint16_t nmissing)
+{
+	ctx->missing += nmissing;
+	warn("demux: %lu packets missing, %lu late, %lu duplicated over %lu",
+			ctx->missing, ctx->late, ctx->duplicate, ctx->npackets);
+#ifdef DEMUX_RTP_FEC
+	warn("demux: %lu packets recovered", ctx->recovered);
+#endif
+	if (out->lastlen == 0)
+		return;
+	uint16_t i;
+	for (i = 0; i < nmissing; i++)
+	{
+		if (out->conceal == PLAYOUT_SILENCE)
+			_demux_push(ctx, out, NULL, out->lastlen, 0);
+		else if (out->conceal == PLAYOUT_REPEAT)
+			_demux_push(ctx, out, out->last, out->lastlen, 0);
+	}
+}
+
+static void _demux_store(demux_ctx_t *ctx, demux_out_t *out, uint16_t seqnum, uint32_t timestamp,
+			const unsigned char *input, size_t len, uint64_t arrival)
+{
+	demux_playout_t *slot = &out->playout[seqnum % ctx->nbbuffers];
+	if (len > sizeof(slot->buffer))
+	{
+		err("demux: udp packet has not to overflow 1500 bytes (%ld)", len);
+		len = sizeof(slot->buffer);
+	}
+	memcpy(slot->buffer, input, len);
+	slot->len = len;
+	slot->timestamp = timestamp;
+	slot->arrival = arrival;
+	slot->seqnum = seqnum;
+	slot->ready = 1;
+}
+
+#ifdef DEMUX_RTP_FEC
+/**
+ * the released packets stay into the playout buffer
+ * until the slot is used again, they are available for the recovery.
+ */
+static demux_playout_t *_demux_received(demux_ctx_t *ctx, demux_out_t *out, uint16_t seqnum)
+{
+	demux_playout_t *slot = &out->playout[seqnum % ctx->nbbuffers];
+	if (slot->seqnum == seqnum && slot->len > 0)
+		return slot;
+	return NULL;
+}
+
+static int _demux_fecrecover(demux_ctx_t *ctx, demux_out_t *out, demux_fec_t *fec, uint64_t arrival)
+{
+	uint16_t snbase = ntohs(fec->header.snbase);
+	uint16_t missing = 0;
+	int nmissing = 0;
+	int i;
+	for (i = 0; i < fec->header.na; i++)
+	{
+		uint16_t seqnum = snbase + i * fec->header.offset;
+		if (_demux_received(ctx, out, seqnum) == NULL)
+		{
+			missing = seqnum;
+			nmissing++;
+		}
+	}
+	if (nmissing == 0 || (int16_t)(snbase + (fec->header.na - 1) * fec->header.offset - out->seqnext) < 0)
+	{
+		/// the group is complete or too old
+		fec->ready = 0;
+		return 0;
+	}
+	if (nmissing > 1 || (int16_t)(missing - out->seqnext) < 0)
+		return 0;
+
+	unsigned char buffer[BUFFERSIZE];
+	size_t len = ntohs(fec->header.lenrecovery);
+	uint32_t timestamp = fec->header.tsrecovery;
+	memcpy(buffer, fec->buffer, fec->len);
+	for (i = 0; i < fec->header.na; i++)
+	{
+		uint16_t seqnum = snbase + i * fec->header.offset;
+		demux_playout_t *slot = _demux_received(ctx, out, seqnum);
+		if (slot == NULL)
+			continue;
+		len ^= slot->len;
+		timestamp ^= slot->timestamp;
+		size_t j;
+		for (j = 0; j < slot->len && j < fec->len; j++)
+			buffer[j] ^= slot->buffer[j];
+	}
+	fec->ready = 0;
+	if (len > fec->len)
+	{
+		warn("demux: rtp fec corrupted");
+		return 0;
+	}
+	_demux_store(ctx, out, missing, timestamp, buffer, len, arrival);
+	ctx->recovered++;
+	demux_dbg("demux: rtp packet %u recovered", missing);
+	return 1;
+}
+
+/**
+ * a recovered packet may complete an other group (row and column)
+ */
+static int _demux_fecretry(demux_ctx_t *ctx, demux_out_t *out, uint64_t arrival)
+{
+	int ret = 0;
+	int again = 1;
+	while (again)
+	{
+		again = 0;
+		int i;
+		for (i = 0; i < FEC_PENDING; i++)
+		{
+			if (out->fec[i].ready && _demux_fecrecover(ctx, out, &out->fec[i], arrival))
+				again = 1;
+		}
+		ret += again;
+	}
+	return ret;
+}
+
+static void _demux_fecstore(demux_ctx_t *ctx, demux_out_t *out, const unsigned char *input, size_t len, uint64_t arrival)
+{
+	if (len < sizeof(rtpfec_t) || !out->started)
+		return;
+	demux_fec_t *fec = &out->fec[out->fecnext % FEC_PENDING];
+	out->fecnext++;
+	memcpy(&fec->header, input, sizeof(fec->header));
+	len -= sizeof(fec->header);
+	if (len > sizeof(fec->buffer))
+		len = sizeof(fec->buffer);
+	memcpy(fec->buffer, input + sizeof(fec->header), len);
+	fec->len = len;
+	fec->ready = 1;
+	_demux_fecretry(ctx, out, arrival);
+}
+#endif
+
+/**
+ * release the packets in order of sequence number
+ * when their target delay expires. A hole is concealed when
+ * the following packet has to be released.
+ */
+static void _demux_release(demux_ctx_t *ctx, demux_out_t *out, uint64_t now, int flush)
+{
+	if (!out->started)
+		return;
+	while (1)
+	{
+		uint16_t i;
+		demux_playout_t *slot = NULL;
+		for (i = 0; i < ctx->nbbuffers; i++)
+		{
+			uint16_t seqnum = out->seqnext + i;
+			slot = &out->playout[seqnum % ctx->nbbuffers];
+			if (slot->ready && slot->seqnum == seqnum)
+				break;
+		}
+		if (i == ctx->nbbuffers)
+			break;
+		if (!flush && slot->arrival + ctx->delay > now)
+			break;
+#ifdef DEMUX_RTP_FEC
+		if (i > 0 && _demux_fecretry(ctx, out, now))
+			continue;
+#endif
+		if (i > 0)
+			_demux_conceal(ctx, out, i);
+		_demux_push(ctx, out, slot->buffer, slot->len, slot->timestamp - out->lasttimestamp);
+		memcpy(out->last, slot->buffer, slot->len);
+		out->lastlen = slot->len;
+		out->lasttimestamp = slot->timestamp;
+		slot->ready = 0;
+		out->seqnext = slot->seqnum + 1;
+	}
+}
+
+static void _demux_playout(demux_ctx_t *ctx, demux_out_t *out, uint16_t seqnum, uint32_t timestamp,
+			const unsigned char *input, size_t len, uint64_t arrival)
+{
+	ctx->npackets++;
+	if (!out->started)
+	{
+		out->seqnext = seqnum;
+		out->lasttimestamp = timestamp;
+		out->started = 1;
+	}
+	int16_t diff = seqnum - out->seqnext;
+	if (diff < 0)
+	{
+		/// the packet is already released or concealed
+		ctx->late++;
+		warn("demux: rtp packet %u late", seqnum);
+		return;
+	}
+	if (diff >= ctx->nbbuffers)
+	{
+		/// the buffer is too short, the old packets are released now
+		_demux_release(ctx, out, arrival, 1);
+		diff = seqnum - out->seqnext;
+		if (diff >= ctx->nbbuffers || diff < 0)
+		{
+			warn("demux: rtp stream resynchronized on %u", seqnum);
+			out->seqnext = seqnum;
+		}
+	}
+	demux_playout_t *slot = &out->playout[seqnum % ctx->nbbuffers];
+	if (slot->ready && slot->seqnum == seqnum)
+	{
+		ctx->duplicate++;
+		return;
+	}
+	_demux_store(ctx, out, seqnum, timestamp, input, len, arrival);
+	_demux_release(ctx, out, arrival, 0);
+}
+#endif
+
+static size_t demux_parseheader(demux_ctx_t *ctx, unsigned char *input, size_t len, uint64_t arrival)
 {
 	size_t orig = len;
+#ifdef RTP_RTCP
+	if (len >= sizeof(rtcpheader_t) && input[1] >= RTCP_PT_MIN && input[1] <= RTCP_PT_MAX)
+	{
+		_demux_rtcp(ctx, input, len, arrival);
+		return orig;
+	}
+#endif
 	rtpheader_t *header = (rtpheader_t *)input;
 	uint16_t seqnum = __bswap_16(header->b.seqnum);
 	//dbg("demux: rtp seqnum %#x %#x", header->b.seqnum, seqnum);
@@ -341,8 +959,21 @@ static size_t demux_parseheader(demux_ctx_t *ctx, unsigned char *input, size_t l
 		input += extheader->extlength;
 		len -= extheader->extlength;
 	}
-	/// player currently support only one session
-	if (ctx->sessionid != 0 && ctx->sessionid != ssrc && ctx->sessionid2 != ssrc)
+	/// the parities are not a stream
+	if (header->b.pt == RTP_PT_FEC)
+	{
+#ifdef DEMUX_RTP_FEC
+		demux_out_t *out = _demux_session(ctx, ssrc - 2);
+		if (out != NULL && out->jitter != NULL)
+			_demux_fecstore(ctx, out, input, len, arrival);
+#endif
+		return orig;
+	}
+	int other = (ctx->sessionid != 0 && ctx->sessionid != ssrc && ctx->sessionid2 != ssrc);
+	/// the other senders are decoded until the limit of sessions
+	if (ctx->maxsessions > 1 && ctx->nsessions > 0)
+		other = (_demux_session(ctx, ssrc) == NULL && ctx->nsessions == ctx->maxsessions);
+	if (other)
 	{
 		demux_profile_t *it = ctx->sessionlist;
 		while(it != NULL)
@@ -380,46 +1011,37 @@ static size_t demux_parseheader(demux_ctx_t *ctx, unsigned char *input, size_t l
 		rtpext_putvctrl_cmd_t *cmd = &putvctrl->cmd;
 		dbg("demu: rtp ctl %u %u", cmd->id, cmd->data);
 		if (cmd->id == PUTVCTRL_ID_STATE && cmd->data == STATE_STOP)
+		{
+#ifdef DEMUX_RTP_PLAYOUT
+			demux_out_t *out;
+			for (out = ctx->out; out != NULL; out = out->next)
+				_demux_release(ctx, out, arrival, 1);
+#endif
 			ctx->sessionid = 0;
+		}
 		if (cmd->id == PUTVCTRL_ID_VOLUME)
 			player_volume(ctx->player, cmd->data % 100);
 		return orig - len;
 	}
+#ifndef DEMUX_RTP_PLAYOUT
 	if (ctx->sessionid2 == ssrc && ctx->seqnum >= seqnum)
 		return orig;
+#endif
 	demux_out_t *out = _demux_getout(ctx, ssrc, header, extheader);
+#ifdef RTP_RTCP
+	/// the duplicated stream and the other sessions are not counted
+	if (out != NULL && out->index == 0 && ssrc != out->sessionid + 1)
+		_demux_rtcpupdate(ctx, ssrc, seqnum, header->timestamp, arrival);
+#endif
 	/// if the stream is duplicated the sequnum is received twice
-#ifdef DEMUX_RTP_REORDER
-	demux_reorder_t *reorder = &ctx->reorder[seqnum % ctx->nbbuffers];
-	int id = seqnum % (ctx->nbbuffers * NB_LOOPS);
-
-	if (out && out->jitter != NULL && reorder->ready && reorder->id != id)
-	{
-		if (out->data == NULL)
-			out->data = out->jitter->ops->pull(out->jitter->ctx);
-		char *buffer = reorder->buffer;
-		size_t len = reorder->len;
-		while (len > out->jitter->ctx->size)
-		{
-			memcpy(out->data, buffer, out->jitter->ctx->size);
-			out->jitter->ops->push(out->jitter->ctx, out->jitter->ctx->size, NULL);
-			len -= out->jitter->ctx->size;
-			buffer += out->jitter->ctx->size;
-		}
-		memcpy(out->data, buffer, len);
-		out->jitter->ops->push(out->jitter->ctx, len, NULL);
-		out->data = NULL;
-		reorder->ready = 0;
-	}
-	if (!reorder->ready)
+#ifdef DEMUX_RTP_PLAYOUT
+	if (out && out->jitter != NULL)
 	{
-		if (len > 0)
-		{
-			memcpy(reorder->buffer, input, len);
-			reorder->ready = 1;
-			reorder->id = id;
-		}
+		_demux_playout(ctx, out, seqnum, header->timestamp, input, len, arrival);
+		len = 0;
 	}
+	else
+		return -1;
 #else
 	if (out && out->jitter != NULL)
 	{
@@ -510,7 +1132,8 @@ static void *demux_thread(void *arg)
 			sleep(1);
 			continue;
 		}
-		input = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		beat_t *beat = NULL;
+		input = ctx->in->ops->peer(ctx->in->ctx, (void **)&beat);
 		if (input == NULL)
 		{
 			run = 0;
@@ -518,8 +1141,12 @@ static void *demux_thread(void *arg)
 		else
 		{
 			size_t ret = 0;
+			uint64_t arrival = 0;
+#if defined(DEMUX_RTP_PLAYOUT) || defined(RTP_RTCP)
+			arrival = _demux_arrival(beat);
+#endif
 			len = ctx->in->ops->length(ctx->in->ctx);
-			if ((ret = demux_parseheader(ctx, input, len)) == (size_t) -1)
+			if ((ret = demux_parseheader(ctx, input, len, arrival)) == (size_t) -1)
 			{
 				demux_dbg("demux: rtp stream unknown");
 			}
@@ -530,6 +1157,10 @@ static void *demux_thread(void *arg)
 	demux_out_t *out = ctx->out;
 	while (out != NULL)
 	{
+#ifdef DEMUX_RTP_PLAYOUT
+		if (out->jitter != NULL)
+			_demux_release(ctx, out, 0, 1);
+#endif
 		const src_t src = { .ops = demux_rtp, .ctx = ctx};
 		event_end_es_t event = {.pid = out->ssrc, .src = &src, .decoder = out->estream};
 		event_listener_t *listener = ctx->listener;
@@ -631,7 +1262,7 @@ static int demux_attach(demux_ctx_t *ctx, long index, decoder_t *decoder)
 		out->estream = decoder;
 		out->jitter = out->estream->ops->jitter(out->estream->ctx, ctx->jitte);
 #ifdef DEMUX_HEARTBEAT
-		if (ctx->heartbeat.ops == NULL)
+		if (out->jitter != NULL && ctx->heartbeat.ops == NULL)
 		{
 			heartbeat_pulse_t config;
 			config.ms = RTP_HEARTBEAT_TIMELAPS / 1000000;
@@ -667,6 +1298,12 @@ static void demux_destroy(demux_ctx_t *ctx)
 		out = out->next;
 		if (old->estream != NULL)
 			old->estream->ops->destroy(old->estream->ctx);
+#ifdef DEMUX_RTP_PLAYOUT
+		free(old->playout);
+#endif
+#ifdef DEMUX_RTP_FEC
+		free(old->fec);
+#endif
 		free(old);
 	}
 	event_listener_t *listener = ctx->listener;
@@ -688,6 +1325,10 @@ static void demux_destroy(demux_ctx_t *ctx)
 #ifdef DEMUX_DUMP
 	if (ctx->dumpfd > 0)
 		close(ctx->dumpfd);
+#endif
+#ifdef RTP_RTCP
+	if (ctx->rtcp.sock >= 0)
+		close(ctx->rtcp.sock);
 #endif
 	free(ctx);
 }
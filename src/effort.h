@@ -0,0 +1,34 @@
+#ifndef __EFFORT_H__
+#define __EFFORT_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * The effort is a ladder of presets of the encoder.
+ * The level 0 is the fastest one, the level nlevels - 1 the best one.
+ * In adaptive mode the level is moved at the frame boundaries to keep
+ * the encoding time under (100 - margin)% of the audio duration.
+ */
+typedef struct encoder_effort_s encoder_effort_t;
+struct encoder_effort_s
+{
+	int level;
+	int nlevels;
+	/// level requested by the user, -1 if not
+	int request;
+	int adaptive;
+	/// percent of the realtime kept free
+	int margin;
+	/// percent of the realtime used by the last measure
+	int load;
+	struct timespec start;
+	uint64_t busy;
+	uint64_t audio;
+};
+
+void encoder_effort_init(encoder_effort_t *effort, int nlevels, int level);
+void encoder_effort_start(encoder_effort_t *effort);
+int encoder_effort_stop(encoder_effort_t *effort, unsigned int nsamples, unsigned int samplerate);
+
+#endif
@@ -2,6 +2,7 @@
 #define __ENCODER_H__
 
 #include "player.h"
+#include "effort.h"
 
 typedef struct jitter_s jitter_t;
 typedef struct sink_s sink_t;
@@ -21,6 +22,10 @@ struct encoder_ops_s
 	const char *(*mime)(encoder_ctx_t *);
 	int (*samplerate)(encoder_ctx_t *);
 	jitter_format_t (*format)(encoder_ctx_t *);
+	/**
+	 * optional: the effort presets of the encoder
+	 */
+	encoder_effort_t *(*effort)(encoder_ctx_t *);
 	void (*destroy)(encoder_ctx_t *);
 };
 
@@ -37,4 +42,7 @@ extern const encoder_ops_t *encoder_passthrough;
 extern const encoder_ops_t *encoder_lame;
 extern const encoder_ops_t *encoder_flac;
 extern const encoder_ops_t *encoder_faac;
+extern const encoder_ops_t *encoder_l16;
+extern const encoder_ops_t *encoder_l24;
+extern const encoder_ops_t *encoder_opus;
 #endif
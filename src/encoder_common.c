@@ -27,6 +27,8 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "encoder.h"
 #include "media.h"
@@ -39,6 +41,14 @@
 #define dbg(...)
 #endif
 
+/**
+ * the name ends on the query of the URL
+ */
+static int _encoder_match(const char *name, int len, const char *ref)
+{
+	return (len == strlen(ref) && !strncmp(name, ref, len));
+}
+
 const encoder_ops_t *encoder_check(const char *path)
 {
 	const encoder_ops_t *encoder = ENCODER;
@@ -48,36 +58,133 @@ const encoder_ops_t *encoder_check(const char *path)
 	int len = pathend - path;
 	if (pathend == NULL)
 		len = strlen(path);
+	/**
+	 * without name, as null:// or null://?speed=2, every comparison
+	 * on 0 bytes would match
+	 */
+	if (len == 0)
+		return encoder;
 	const char *ext = strrchr(path, '.');
+	/// the dot of the query (speed=1.5) is not an extension
+	if (ext != NULL && ext >= path + len)
+		ext = NULL;
 	if (ext != NULL)
 	{
 #ifdef ENCODER_LAME
-		if (!strncmp(ext, ".mp3", len))
+		if (_encoder_match(ext, path + len - ext, ".mp3"))
 			encoder = encoder_lame;
 #endif
 #ifdef ENCODER_FLAC
-		if (!strncmp(ext, ".flac", len))
+		if (_encoder_match(ext, path + len - ext, ".flac"))
 			encoder = encoder_flac;
 #endif
 #ifdef ENCODER_FAAC
-		if (!strncmp(ext, ".aac", len))
+		if (_encoder_match(ext, path + len - ext, ".aac"))
 			encoder = encoder_faac;
+#endif
+#ifdef ENCODER_OPUS
+		if (_encoder_match(ext, path + len - ext, ".opus"))
+			encoder = encoder_opus;
 #endif
 	}
 	else
 	{
 #ifdef ENCODER_LAME
-		if (!strncmp(path, mime_audiomp3, len))
+		if (_encoder_match(path, len, mime_audiomp3))
 			encoder = encoder_lame;
 #endif
 #ifdef ENCODER_FLAC
-		if (!strncmp(path, mime_audioflac, len))
+		if (_encoder_match(path, len, mime_audioflac))
 			encoder = encoder_flac;
 #endif
 #ifdef ENCODER_FAAC
-		if (!strncmp(path, mime_audioaac, len))
+		if (_encoder_match(path, len, mime_audioaac))
 			encoder = encoder_flac;
+#endif
+#ifdef ENCODER_LPCM
+		if (_encoder_match(path, len, mime_audiol16))
+			encoder = encoder_l16;
+		if (_encoder_match(path, len, mime_audiol24))
+			encoder = encoder_l24;
+#endif
+#ifdef ENCODER_OPUS
+		if (_encoder_match(path, len, mime_audioopus))
+			encoder = encoder_opus;
 #endif
 	}
 	return encoder;
 }
+
+#ifdef ENCODER_EFFORT
+#ifndef ENCODER_EFFORT_MARGIN
+#define ENCODER_EFFORT_MARGIN 30
+#endif
+/// the load is measured on 2 seconds of audio
+#define ENCODER_EFFORT_WINDOW 2000000000ULL
+
+void encoder_effort_init(encoder_effort_t *effort, int nlevels, int level)
+{
+	memset(effort, 0, sizeof(*effort));
+	effort->nlevels = nlevels;
+	effort->level = level;
+	effort->request = -1;
+	effort->margin = ENCODER_EFFORT_MARGIN;
+#ifdef ENCODER_EFFORT_AUTO
+	effort->adaptive = 1;
+#endif
+}
+
+void encoder_effort_start(encoder_effort_t *effort)
+{
+	clock_gettime(CLOCK_MONOTONIC, &effort->start);
+}
+
+/**
+ * return the new level to set or -1 to keep the current one
+ */
+int encoder_effort_stop(encoder_effort_t *effort, unsigned int nsamples, unsigned int samplerate)
+{
+	struct timespec stop;
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	int64_t busy = (stop.tv_sec - effort->start.tv_sec) * 1000000000LL;
+	busy += stop.tv_nsec - effort->start.tv_nsec;
+	if (busy > 0)
+		effort->busy += busy;
+	if (samplerate > 0)
+		effort->audio += (uint64_t)nsamples * 1000000000ULL / samplerate;
+
+	int level = -1;
+	int request = effort->request;
+	if (request >= 0)
+	{
+		effort->request = -1;
+		effort->adaptive = 0;
+		if (request >= effort->nlevels)
+			request = effort->nlevels - 1;
+		if (request != effort->level)
+			level = request;
+	}
+	if (effort->audio < ENCODER_EFFORT_WINDOW)
+		return level;
+
+	effort->load = effort->busy * 100 / effort->audio;
+	effort->busy = 0;
+	effort->audio = 0;
+	if (level < 0 && effort->adaptive)
+	{
+		int budget = 100 - effort->margin;
+		/**
+		 * the next level may cost twice the current one
+		 */
+		if (effort->load > budget && effort->level > 0)
+			level = effort->level - 1;
+		else if (effort->load * 2 < budget && effort->level < effort->nlevels - 1)
+			level = effort->level + 1;
+		if (level >= 0)
+			dbg("encoder: load %d%% effort %d => %d", effort->load, effort->level, level);
+	}
+	if (level >= 0)
+		effort->level = level;
+	return level;
+}
+#endif
@@ -190,7 +190,7 @@ warn("samplesize %u", samplesize);
 static encoder_ctx_t *encoder_init(player_ctx_t *player)
 {
 	encoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
-	ctx->ops = encoder_lame;
+	ctx->ops = encoder_faac;
 	ctx->player = player;
 
 	encoder_faac_init(ctx, DEFAULT_SAMPLERATE, FORMAT_SAMPLESIZE(INPUT_FORMAT), FORMAT_NCHANNELS(INPUT_FORMAT));
@@ -200,7 +200,11 @@ static encoder_ctx_t *encoder_init(player_ctx_t *player)
 #if ENCODER_DUMP == 2
 	ctx->dumpfd = open("lame_dump.wav", O_RDWR | O_CREAT, 0644);
 #endif
-	unsigned long buffsize = ctx->samplesframe * ctx->samplesize * ctx->nchannels;
+	/**
+	 * faac counts the samples of all the channels,
+	 * one buffer of the jitter is exactly one frame of faac
+	 */
+	unsigned long buffsize = ctx->samplesframe * ctx->samplesize;
 	warn("samples size %u", ctx->samplesize);
 	warn("samples frame %lu", ctx->samplesframe);
 	warn("buffer size %lu", buffsize);
@@ -249,9 +253,9 @@ static void *faac_thread(void *arg)
 		ctx->inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
 		unsigned int inlength = ctx->in->ops->length(ctx->in->ctx);
 		dbg("inlength %d", inlength);
-		inlength /= ctx->samplesize * ctx->nchannels;
+		inlength /= ctx->samplesize;
 		dbg("samples %d", inlength);
-		nsamples += inlength;
+		nsamples += inlength / ctx->nchannels;
 		if (inlength < ctx->samplesframe)
 			warn("encoder: frame too small %d %ld", inlength, ctx->in->ctx->size);
 		if (ctx->in->ctx->frequence != ctx->samplerate)
@@ -267,7 +271,7 @@ static void *faac_thread(void *arg)
 		{
 #if ENCODER_DUMP == 2
 			if (ctx->dumpfd > 0)
-				write(ctx->dumpfd, ctx->inbuffer, inlength * ctx->samplesize * ctx->nchannels);
+				write(ctx->dumpfd, ctx->inbuffer, inlength * ctx->samplesize);
 #endif
 			dbg("outlength %d", ctx->out->ctx->size);
 			ret = faacEncEncode(ctx->encoder,
@@ -279,7 +283,7 @@ static void *faac_thread(void *arg)
 				write(ctx->dumpfd, ctx->outbuffer, ret);
 #endif
 			//ctx->in->ops->pop(ctx->in->ctx, ctx->in->ctx->size);
-			ctx->in->ops->pop(ctx->in->ctx, inlength * ctx->samplesize * ctx->nchannels);
+			ctx->in->ops->pop(ctx->in->ctx, inlength * ctx->samplesize);
 		}
 		else
 		{
@@ -63,6 +63,7 @@ struct encoder_ctx_s
 	unsigned char *outbuffer;
 	heartbeat_t heartbeat;
 	size_t maxsize;
+	unsigned int nthreads;
 };
 #define ENCODER_CTX
 #include "encoder.h"
@@ -98,6 +99,18 @@ struct encoder_ctx_s
 #define MAX_SAMPLES (DEFAULT_SAMPLERATE * 60 * 2) // 2 minutes
 #define HEARTBEAT_RATIO 1 // big samples_frame may contains a lot of blank and are sent too late
 
+/**
+ * libFLAC 1.5 encodes the frames on a pool of threads
+ * and calls the write callback in the order of the frames.
+ * 0 uses one thread by online CPU.
+ */
+#if FLAC_API_VERSION_CURRENT >= 14
+#define ENCODER_FLAC_MT
+#endif
+#ifndef ENCODER_FLAC_THREADS
+#define ENCODER_FLAC_THREADS 0
+#endif
+
 static const char *jitter_name = "flac encoder";
 
 static size_t encoder_output(encoder_ctx_t *ctx, const unsigned char *buffer, size_t bytes, unsigned samples)
@@ -191,6 +204,17 @@ static int encoder_flac_init(encoder_ctx_t *ctx, jitter_format_t format)
 	FLAC__stream_encoder_set_blocksize(ctx->encoder, ctx->samplesframe);
 	FLAC__stream_encoder_set_max_lpc_order(ctx->encoder, 12);
 	FLAC__stream_encoder_set_max_residual_partition_order(ctx->encoder, 8);
+#ifdef ENCODER_FLAC_MT
+	if (ctx->nthreads > 1)
+	{
+		uint32_t status = FLAC__stream_encoder_set_num_threads(ctx->encoder, ctx->nthreads);
+		if (status != FLAC__STREAM_ENCODER_SET_NUM_THREADS_OK)
+		{
+			warn("encoder: flac %u threads not available (%u)", ctx->nthreads, status);
+			ctx->nthreads = 1;
+		}
+	}
+#endif
 
 	ctx->framescnt = 0;
 	dbg("flac: initialized");
@@ -216,6 +240,16 @@ static encoder_ctx_t *encoder_init(player_ctx_t *player)
 	// otherwise
 	// MAX_SAMPLES / SAMPLES_FRAME
 
+	ctx->nthreads = 1;
+#ifdef ENCODER_FLAC_MT
+	ctx->nthreads = ENCODER_FLAC_THREADS;
+	if (ctx->nthreads == 0)
+		ctx->nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	if (ENCODER_FLAC_THREADS > 1)
+		warn("encoder: flac multithreading requires libFLAC 1.5");
+#endif
+
 	ctx->encoder = FLAC__stream_encoder_new();
 
 	if (encoder_flac_init(ctx, format) < 0)
@@ -234,12 +268,14 @@ static encoder_ctx_t *encoder_init(player_ctx_t *player)
 		"\tsamples frame %u\n" \
 		"\tsample rate %d\n" \
 		"\tsample size %d\n" \
-		"\tnchannels %u",
+		"\tnchannels %u\n" \
+		"\tthreads %u",
 		buffsize,
 		ctx->samplesframe,
 		ctx->samplerate,
 		ctx->samplesize,
-		ctx->nchannels);
+		ctx->nchannels,
+		ctx->nthreads);
 	jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, NB_BUFFERS, buffsize);
 	ctx->in = jitter;
 	jitter->format = format;
@@ -288,6 +324,7 @@ static void *_encoder_thread(void *arg)
 		{
 #ifdef ENCODER_CHANGE_FRAMERATE
 			ctx->samplerate = ctx->in->ctx->frequence;
+			FLAC__stream_encoder_finish(ctx->encoder);
 			encoder_flac_init(ctx, ctx->in->format);
 
 			FLAC__StreamEncoderInitStatus init_status;
@@ -309,6 +346,7 @@ static void *_encoder_thread(void *arg)
 		if (ctx->maxframes && ctx->framescnt > ctx->maxframes)
 		{
 			warn("encoder: max flac frames");
+			FLAC__stream_encoder_finish(ctx->encoder);
 			encoder_flac_init(ctx, ctx->in->format);
 
 			FLAC__StreamEncoderInitStatus init_status;
@@ -40,6 +40,7 @@
 #include "player.h"
 #include "jitter.h"
 #include "heartbeat.h"
+#include "effort.h"
 #include "media.h"
 
 typedef struct encoder_ops_s encoder_ops_t;
@@ -60,6 +61,7 @@ struct encoder_ctx_s
 	jitter_t *out;
 	unsigned char *outbuffer;
 	heartbeat_t heartbeat;
+	encoder_effort_t effort;
 };
 #define ENCODER_CTX
 #include "encoder.h"
@@ -123,6 +125,26 @@ struct encoder_ctx_s
 #endif
 
 static const char *jitter_name = "lame encoder";
+
+/**
+ * the lame quality changes only the complexity and the time of compression
+ */
+typedef struct encoder_preset_s encoder_preset_t;
+struct encoder_preset_s
+{
+	int quality;
+	vbr_mode vbr;
+};
+static const encoder_preset_t encoder_presets[] =
+{
+	{ .quality = 9, .vbr = vbr_mtrh},
+	{ .quality = 7, .vbr = vbr_mtrh},
+	{ .quality = 5, .vbr = vbr_mtrh},
+	{ .quality = 3, .vbr = vbr_mtrh},
+	{ .quality = 2, .vbr = vbr_rh},
+};
+#define NB_PRESETS (sizeof(encoder_presets) / sizeof(encoder_preset_t))
+#define DEFAULT_PRESET 2
 static void error_report(const char *format, va_list ap)
 {
 	fprintf(stderr, format, ap);
@@ -139,9 +161,13 @@ static int encoder_lame_init(encoder_ctx_t *ctx, int samplerate, int samplesize,
 	lame_set_num_channels(ctx->encoder, nchannels);
 	ctx->nchannels = nchannels;
 	ctx->samplesize = samplesize / 8;
+	const encoder_preset_t *preset = &encoder_presets[DEFAULT_PRESET];
+#ifdef ENCODER_EFFORT
+	preset = &encoder_presets[ctx->effort.level];
+#endif
 	// this value change the complexity and the time of compression
 	// nothing else
-	lame_set_quality(ctx->encoder, 5);
+	lame_set_quality(ctx->encoder, preset->quality);
 	lame_set_mode(ctx->encoder, LAME_NCHANNELS);
 	lame_set_errorf(ctx->encoder, error_report);
 
@@ -151,7 +177,7 @@ static int encoder_lame_init(encoder_ctx_t *ctx, int samplerate, int samplesize,
 	// 48000Hz the output buffer is between 1008 and 1344 for brate to 112
 	lame_set_out_samplerate(ctx->encoder, DEFAULT_SAMPLERATE);
 #ifdef ENCODER_VBR
-	lame_set_VBR(ctx->encoder, vbr_default);
+	lame_set_VBR(ctx->encoder, preset->vbr);
 	lame_set_VBR_q(ctx->encoder, DEFAULT_BITRATE);
 #else
 	lame_set_VBR(ctx->encoder, vbr_off);
@@ -169,6 +195,7 @@ static int encoder_lame_init(encoder_ctx_t *ctx, int samplerate, int samplesize,
 	warn("\tsample rate %d", ctx->samplerate);
 	warn("\tsample size %d", ctx->samplesize);
 	warn("\tnchannels %u", LAME_NCHANNELS);
+	warn("\tquality %d", preset->quality);
 #ifdef ENCODER_VBR
 	warn("\tvariatic bitrate %d\n", DEFAULT_BITRATE);
 #else
@@ -183,6 +210,9 @@ static encoder_ctx_t *encoder_init(player_ctx_t *player)
 	encoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
 	ctx->ops = encoder_lame;
 	ctx->player = player;
+#ifdef ENCODER_EFFORT
+	encoder_effort_init(&ctx->effort, NB_PRESETS, DEFAULT_PRESET);
+#endif
 
 	encoder_lame_init(ctx, DEFAULT_SAMPLERATE, FORMAT_SAMPLESIZE(INPUT_FORMAT), FORMAT_NCHANNELS(INPUT_FORMAT));
 #if ENCODER_DUMP == 1
@@ -221,6 +251,29 @@ static void encoder_message(const char *format, va_list ap)
 }
 #endif
 
+#ifdef ENCODER_EFFORT
+/**
+ * the samples kept by lame are flushed before to change the preset,
+ * the stream continues on a frame boundary.
+ */
+static int encoder_lame_effort(encoder_ctx_t *ctx)
+{
+	int ret = 0;
+	if (ctx->outbuffer == NULL)
+		ctx->outbuffer = ctx->out->ops->pull(ctx->out->ctx);
+	if (ctx->outbuffer == NULL)
+		return -1;
+	ret = lame_encode_flush_nogap(ctx->encoder, ctx->outbuffer, ctx->out->ctx->size);
+	if (ret > 0)
+	{
+		ctx->out->ops->push(ctx->out->ctx, ret, NULL);
+		ctx->outbuffer = NULL;
+	}
+	warn("encoder lame: effort %d load %d%%", ctx->effort.level, ctx->effort.load);
+	return encoder_lame_init(ctx, ctx->samplerate, ctx->samplesize * 8, ctx->nchannels);
+}
+#endif
+
 static void *lame_thread(void *arg)
 {
 	int result = 0;
@@ -245,6 +298,9 @@ static void *lame_thread(void *arg)
 	while (run)
 	{
 		int ret = 0;
+#ifdef ENCODER_EFFORT
+		int level = -1;
+#endif
 
 		ctx->inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
 		unsigned int inlength = ctx->in->ops->length(ctx->in->ctx);
@@ -266,10 +322,16 @@ static void *lame_thread(void *arg)
 #if ENCODER_DUMP == 2
 			if (ctx->dumpfd > 0)
 				write(ctx->dumpfd, ctx->inbuffer, inlength * ctx->samplesize * ctx->nchannels);
+#endif
+#ifdef ENCODER_EFFORT
+			encoder_effort_start(&ctx->effort);
 #endif
 			ret = lame_encode_buffer_interleaved(ctx->encoder,
 					(short int *)ctx->inbuffer, inlength,
 					ctx->outbuffer, ctx->out->ctx->size);
+#ifdef ENCODER_EFFORT
+			level = encoder_effort_stop(&ctx->effort, inlength, ctx->samplerate);
+#endif
 #if ENCODER_DUMP == 1
 			if (ctx->dumpfd > 0 && ret > 0)
 				write(ctx->dumpfd, ctx->outbuffer, ret);
@@ -305,6 +367,10 @@ static void *lame_thread(void *arg)
 			ctx->out->ops->push(ctx->out->ctx, ret, &beat);
 			ctx->outbuffer = NULL;
 		}
+#ifdef ENCODER_EFFORT
+		if (ret >= 0 && level >= 0 && encoder_lame_effort(ctx) < 0)
+			run = 0;
+#endif
 		if (ret < 0)
 		{
 			if (ret == -1)
@@ -368,6 +434,13 @@ static jitter_format_t encoder_format(encoder_ctx_t *ctx)
 	return MPEG2_3_MP3;
 }
 
+#ifdef ENCODER_EFFORT
+static encoder_effort_t *encoder_effort(encoder_ctx_t *ctx)
+{
+	return &ctx->effort;
+}
+#endif
+
 static void encoder_destroy(encoder_ctx_t *ctx)
 {
 #ifdef ENCODER_DUMP
@@ -395,5 +468,8 @@ const encoder_ops_t *encoder_lame = &(encoder_ops_t)
 	.mime = encoder_mime,
 	.samplerate = encoder_samplerate,
 	.format = encoder_format,
+#ifdef ENCODER_EFFORT
+	.effort = encoder_effort,
+#endif
 	.destroy = encoder_destroy,
 };
@@ -0,0 +1,269 @@
+/*****************************************************************************
+ * encoder_lpcm.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "player.h"
+#include "jitter.h"
+#include "heartbeat.h"
+#include "media.h"
+
+typedef struct encoder_ops_s encoder_ops_t;
+typedef struct encoder_ctx_s encoder_ctx_t;
+struct encoder_ctx_s
+{
+	const encoder_ops_t *ops;
+	/// size of one sample into the RTP payload: 2 for L16, 3 for L24
+	unsigned char samplesize;
+	unsigned char nchannels;
+	pthread_t thread;
+	player_ctx_t *player;
+	jitter_t *in;
+	jitter_t *out;
+	unsigned char *outbuffer;
+	size_t outlength;
+	heartbeat_t heartbeat;
+	int run;
+};
+#define ENCODER_CTX
+#include "encoder.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define encoder_dbg(...)
+
+#ifdef HEARTBEAT
+#define ENCODER_HEARTBEAT
+#endif
+
+#define NB_BUFFERS 6
+/// 10 ms of audio by input buffer
+#define INPUT_NSAMPLES (DEFAULT_SAMPLERATE / 100)
+#ifndef DEFAULT_NCHANNELS
+# define DEFAULT_NCHANNELS 2
+#endif
+
+static const char *jitter_name = "lpcm encoder";
+
+static encoder_ctx_t *_encoder_init(const encoder_ops_t *ops, player_ctx_t *player, unsigned char samplesize, jitter_format_t format)
+{
+	encoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->ops = ops;
+	ctx->player = player;
+	ctx->samplesize = samplesize;
+	ctx->nchannels = DEFAULT_NCHANNELS;
+
+	unsigned long buffsize = INPUT_NSAMPLES * FORMAT_SAMPLESIZE(format) / 8 * ctx->nchannels;
+	jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, NB_BUFFERS, buffsize);
+	if (jitter == NULL)
+	{
+		free(ctx);
+		return NULL;
+	}
+	ctx->in = jitter;
+	jitter->format = format;
+	jitter->ctx->frequence = 0; // automatic freq
+	jitter->ctx->thredhold = 1;
+	return ctx;
+}
+
+static encoder_ctx_t *encoder_l16_init(player_ctx_t *player)
+{
+	return _encoder_init(encoder_l16, player, 2, PCM_16bits_LE_stereo);
+}
+
+static encoder_ctx_t *encoder_l24_init(player_ctx_t *player)
+{
+	return _encoder_init(encoder_l24, player, 3, PCM_24bits4_LE_stereo);
+}
+
+static jitter_t *encoder_jitter(encoder_ctx_t *ctx)
+{
+	return ctx->in;
+}
+
+static int _encoder_push(encoder_ctx_t *ctx)
+{
+	beat_t beat = {0};
+#ifdef ENCODER_HEARTBEAT
+	beat.samples.nsamples = ctx->outlength / (ctx->samplesize * ctx->nchannels);
+#endif
+	ctx->out->ops->push(ctx->out->ctx, ctx->outlength, &beat);
+	ctx->outbuffer = NULL;
+	ctx->outlength = 0;
+	return 0;
+}
+
+/**
+ * RFC 3551: the samples are in network byte order
+ * and a packet contains only whole sample frames.
+ */
+static void *lpcm_thread(void *arg)
+{
+	encoder_ctx_t *ctx = (encoder_ctx_t *)arg;
+	unsigned int insize = FORMAT_SAMPLESIZE(ctx->in->format) / 8;
+	unsigned int framesize = ctx->samplesize * ctx->nchannels;
+	size_t payload = ctx->out->ctx->size / framesize * framesize;
+
+#ifdef ENCODER_HEARTBEAT
+	ctx->heartbeat.ops->start(ctx->heartbeat.ctx);
+#endif
+	encoder_dbg("encoder: lpcm thread start");
+	while (ctx->run)
+	{
+		unsigned char *inbuffer = ctx->in->ops->peer(ctx->in->ctx, NULL);
+		if (inbuffer == NULL)
+		{
+			/**
+			 * the stream is broken, the last packet is sent
+			 */
+			if (ctx->outlength > 0)
+				_encoder_push(ctx);
+			continue;
+		}
+		size_t inlength = ctx->in->ops->length(ctx->in->ctx);
+		size_t i;
+		for (i = 0; i + insize <= inlength; i += insize)
+		{
+			if (ctx->outbuffer == NULL)
+			{
+				ctx->outbuffer = ctx->out->ops->pull(ctx->out->ctx);
+				if (ctx->outbuffer == NULL)
+					break;
+			}
+			unsigned char *out = ctx->outbuffer + ctx->outlength;
+			if (ctx->samplesize == 3)
+			{
+				out[0] = inbuffer[i + 2];
+				out[1] = inbuffer[i + 1];
+				out[2] = inbuffer[i];
+			}
+			else
+			{
+				out[0] = inbuffer[i + 1];
+				out[1] = inbuffer[i];
+			}
+			ctx->outlength += ctx->samplesize;
+			if (ctx->outlength + framesize > payload && (ctx->outlength % framesize) == 0)
+				_encoder_push(ctx);
+		}
+		ctx->in->ops->pop(ctx->in->ctx, inlength);
+	}
+	encoder_dbg("encoder: lpcm thread end");
+	return NULL;
+}
+
+static int encoder_run(encoder_ctx_t *ctx, jitter_t *jitter)
+{
+	ctx->out = jitter;
+#ifdef ENCODER_HEARTBEAT
+	heartbeat_samples_t config;
+	config.samplerate = DEFAULT_SAMPLERATE;
+	config.format = ctx->in->format;
+	config.nchannels = ctx->nchannels;
+	ctx->heartbeat.ops = heartbeat_samples;
+	ctx->heartbeat.ctx = ctx->heartbeat.ops->init(&config);
+	jitter->ops->heartbeat(jitter->ctx, &ctx->heartbeat);
+#endif
+	ctx->run = 1;
+	pthread_create(&ctx->thread, NULL, lpcm_thread, ctx);
+	return 0;
+}
+
+static const char *encoder_l16_mime(encoder_ctx_t *ctx)
+{
+	return mime_audiol16;
+}
+
+static const char *encoder_l24_mime(encoder_ctx_t *ctx)
+{
+	return mime_audiol24;
+}
+
+static int encoder_samplerate(encoder_ctx_t *ctx)
+{
+	if (ctx->in->ctx->frequence)
+		return ctx->in->ctx->frequence;
+	return DEFAULT_SAMPLERATE;
+}
+
+static jitter_format_t encoder_format(encoder_ctx_t *ctx)
+{
+	if (ctx->samplesize == 3)
+		return PCM_24bits3_BE_stereo;
+	return PCM_16bits_BE_stereo;
+}
+
+static void encoder_destroy(encoder_ctx_t *ctx)
+{
+	ctx->run = 0;
+	ctx->in->ops->flush(ctx->in->ctx);
+	if (ctx->thread)
+		pthread_join(ctx->thread, NULL);
+#ifdef ENCODER_HEARTBEAT
+	if (ctx->heartbeat.ctx)
+		ctx->heartbeat.ops->destroy(ctx->heartbeat.ctx);
+#endif
+	jitter_destroy(ctx->in);
+	free(ctx);
+}
+
+const encoder_ops_t *encoder_l16 = &(encoder_ops_t)
+{
+	.name = "l16",
+	.init = encoder_l16_init,
+	.type = ES_AUDIO,
+	.jitter = encoder_jitter,
+	.run = encoder_run,
+	.mime = encoder_l16_mime,
+	.samplerate = encoder_samplerate,
+	.format = encoder_format,
+	.destroy = encoder_destroy,
+};
+
+const encoder_ops_t *encoder_l24 = &(encoder_ops_t)
+{
+	.name = "l24",
+	.init = encoder_l24_init,
+	.type = ES_AUDIO,
+	.jitter = encoder_jitter,
+	.run = encoder_run,
+	.mime = encoder_l24_mime,
+	.samplerate = encoder_samplerate,
+	.format = encoder_format,
+	.destroy = encoder_destroy,
+};
@@ -0,0 +1,378 @@
+/*****************************************************************************
+ * encoder_opus.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2025
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <opus.h>
+
+#include "player.h"
+#include "jitter.h"
+#include "heartbeat.h"
+#include "effort.h"
+#include "media.h"
+
+typedef struct encoder_ops_s encoder_ops_t;
+typedef struct encoder_ctx_s encoder_ctx_t;
+struct encoder_ctx_s
+{
+	const encoder_ops_t *ops;
+	OpusEncoder *encoder;
+	unsigned char nchannels;
+	/// number of samples by opus frame at OPUS_SAMPLERATE
+	unsigned int framesize;
+	pthread_t thread;
+	player_ctx_t *player;
+	jitter_t *in;
+	jitter_t *out;
+	unsigned char *outbuffer;
+	/// resampler from the input samplerate to OPUS_SAMPLERATE
+	unsigned int inrate;
+	uint32_t step;
+	uint32_t position;
+	opus_int16 last[2];
+	opus_int16 *pcm;
+	unsigned int pcmlength;
+	heartbeat_t heartbeat;
+	encoder_effort_t effort;
+	int run;
+};
+#define ENCODER_CTX
+#include "encoder.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define encoder_dbg(...)
+
+#ifdef HEARTBEAT
+#define ENCODER_HEARTBEAT
+#endif
+
+#ifndef DEFAULT_SAMPLERATE
+#define DEFAULT_SAMPLERATE 44100
+#endif
+
+/**
+ * RFC 7587: the RTP clock of opus is always 48kHz
+ */
+#define OPUS_SAMPLERATE 48000
+#ifndef ENCODER_OPUS_FRAMEMS
+#define ENCODER_OPUS_FRAMEMS 20
+#endif
+#if ENCODER_OPUS_FRAMEMS != 10 && ENCODER_OPUS_FRAMEMS != 20
+#error "ENCODER_OPUS_FRAMEMS must be 10 or 20"
+#endif
+#define NB_BUFFERS 6
+
+static const char *jitter_name = "opus encoder";
+
+/**
+ * the complexity may change on each frame without reset of the stream
+ */
+static const int encoder_presets[] = { 0, 2, 4, 6, 8, 10};
+#define NB_PRESETS (sizeof(encoder_presets) / sizeof(int))
+#define DEFAULT_PRESET 3
+
+static encoder_ctx_t *encoder_init(player_ctx_t *player)
+{
+	int error = OPUS_OK;
+	encoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->ops = encoder_opus;
+	ctx->player = player;
+
+	jitter_format_t format = PCM_16bits_LE_stereo;
+	ctx->nchannels = FORMAT_NCHANNELS(format);
+	ctx->framesize = OPUS_SAMPLERATE * ENCODER_OPUS_FRAMEMS / 1000;
+
+	/**
+	 * the restricted low delay mode removes the speech modes
+	 * and keeps the algorithmic delay to 2.5 ms
+	 */
+	ctx->encoder = opus_encoder_create(OPUS_SAMPLERATE, ctx->nchannels,
+				OPUS_APPLICATION_RESTRICTED_LOWDELAY, &error);
+	if (ctx->encoder == NULL)
+	{
+		err("encoder: DISABLE opus error %s", opus_strerror(error));
+		free(ctx);
+		return NULL;
+	}
+#ifdef ENCODER_OPUS_BITRATE
+	opus_encoder_ctl(ctx->encoder, OPUS_SET_BITRATE(ENCODER_OPUS_BITRATE));
+#endif
+#ifdef ENCODER_EFFORT
+	encoder_effort_init(&ctx->effort, NB_PRESETS, DEFAULT_PRESET);
+#endif
+	opus_encoder_ctl(ctx->encoder, OPUS_SET_COMPLEXITY(encoder_presets[DEFAULT_PRESET]));
+	ctx->pcm = calloc(ctx->framesize * ctx->nchannels, sizeof(*ctx->pcm));
+
+	/**
+	 * one opus frame by buffer, at 48kHz the buffers are encoded in place
+	 */
+	unsigned long buffsize = ctx->framesize * FORMAT_SAMPLESIZE(format) / 8 * ctx->nchannels;
+	warn("encoder OPUS config :\n" \
+		"\tbuffer size %lu\n" \
+		"\tframe %d ms\n" \
+		"\tsample rate %d\n" \
+		"\tnchannels %u",
+		buffsize,
+		ENCODER_OPUS_FRAMEMS,
+		OPUS_SAMPLERATE,
+		ctx->nchannels);
+	jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, NB_BUFFERS, buffsize);
+	if (jitter == NULL)
+	{
+		opus_encoder_destroy(ctx->encoder);
+		free(ctx->pcm);
+		free(ctx);
+		return NULL;
+	}
+	ctx->in = jitter;
+	jitter->format = format;
+	jitter->ctx->frequence = 0; // automatic freq
+	jitter->ctx->thredhold = 1;
+
+	return ctx;
+}
+
+static jitter_t *encoder_jitter(encoder_ctx_t *ctx)
+{
+	return ctx->in;
+}
+
+/**
+ * one opus packet by buffer, the muxer must not aggregate them
+ */
+static int _encoder_frame(encoder_ctx_t *ctx, const opus_int16 *pcm)
+{
+	if (ctx->outbuffer == NULL)
+		ctx->outbuffer = ctx->out->ops->pull(ctx->out->ctx);
+	if (ctx->outbuffer == NULL)
+	{
+		warn("encoder: jitter out closed");
+		return -1;
+	}
+#ifdef ENCODER_EFFORT
+	encoder_effort_start(&ctx->effort);
+#endif
+	opus_int32 length = opus_encode(ctx->encoder, pcm, ctx->framesize,
+				ctx->outbuffer, ctx->out->ctx->size);
+#ifdef ENCODER_EFFORT
+	int level = encoder_effort_stop(&ctx->effort, ctx->framesize, OPUS_SAMPLERATE);
+	if (level >= 0)
+	{
+		warn("encoder opus: effort %d load %d%%", ctx->effort.level, ctx->effort.load);
+		opus_encoder_ctl(ctx->encoder, OPUS_SET_COMPLEXITY(encoder_presets[level]));
+	}
+#endif
+	ctx->pcmlength = 0;
+	if (length < 0)
+	{
+		err("encoder: opus error %s", opus_strerror(length));
+		return 0;
+	}
+	beat_t beat = {0};
+#ifdef ENCODER_HEARTBEAT
+	beat.samples.nsamples = ctx->framesize;
+#endif
+	encoder_dbg("encoder: opus push %d bytes", length);
+	ctx->out->ops->push(ctx->out->ctx, length, &beat);
+	ctx->outbuffer = NULL;
+	return 0;
+}
+
+/**
+ * linear interpolation between the samples, enough for a low latency path.
+ * The position is in 16.16 fixed point, 0 is the last sample of
+ * the previous buffer.
+ */
+static int _encoder_resample(encoder_ctx_t *ctx, const opus_int16 *in, unsigned int nframes)
+{
+	if (nframes == 0)
+		return 0;
+	unsigned int index;
+	while ((index = ctx->position >> 16) < nframes)
+	{
+		int32_t fraction = ctx->position & 0xFFFF;
+		int i;
+		for (i = 0; i < ctx->nchannels; i++)
+		{
+			int32_t first = (index == 0)? ctx->last[i]: in[(index - 1) * ctx->nchannels + i];
+			int32_t second = in[index * ctx->nchannels + i];
+			ctx->pcm[ctx->pcmlength * ctx->nchannels + i] =
+				first + (((int64_t)(second - first) * fraction) >> 16);
+		}
+		ctx->pcmlength++;
+		if (ctx->pcmlength == ctx->framesize && _encoder_frame(ctx, ctx->pcm) < 0)
+			return -1;
+		ctx->position += ctx->step;
+	}
+	ctx->position -= nframes << 16;
+	memcpy(ctx->last, &in[(nframes - 1) * ctx->nchannels], ctx->nchannels * sizeof(*in));
+	return 0;
+}
+
+static int _encoder_copy(encoder_ctx_t *ctx, const opus_int16 *in, unsigned int nframes)
+{
+	while (ctx->pcmlength == 0 && nframes >= ctx->framesize)
+	{
+		if (_encoder_frame(ctx, in) < 0)
+			return -1;
+		in += ctx->framesize * ctx->nchannels;
+		nframes -= ctx->framesize;
+	}
+	while (nframes > 0)
+	{
+		unsigned int length = ctx->framesize - ctx->pcmlength;
+		if (length > nframes)
+			length = nframes;
+		memcpy(ctx->pcm + ctx->pcmlength * ctx->nchannels, in, length * ctx->nchannels * sizeof(*in));
+		ctx->pcmlength += length;
+		in += length * ctx->nchannels;
+		nframes -= length;
+		if (ctx->pcmlength == ctx->framesize && _encoder_frame(ctx, ctx->pcm) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void *_encoder_thread(void *arg)
+{
+	encoder_ctx_t *ctx = (encoder_ctx_t *)arg;
+	unsigned int framesize = FORMAT_SAMPLESIZE(ctx->in->format) / 8 * ctx->nchannels;
+#ifdef ENCODER_HEARTBEAT
+	ctx->heartbeat.ops->start(ctx->heartbeat.ctx);
+#endif
+	encoder_dbg("encoder: opus thread start");
+	while (ctx->run)
+	{
+		const opus_int16 *inbuffer = (const opus_int16 *)ctx->in->ops->peer(ctx->in->ctx, NULL);
+		if (inbuffer == NULL)
+			continue;
+		size_t inlength = ctx->in->ops->length(ctx->in->ctx);
+		unsigned int rate = ctx->in->ctx->frequence;
+		if (rate == 0)
+			rate = DEFAULT_SAMPLERATE;
+		if (rate != ctx->inrate)
+		{
+			dbg("encoder: opus resamples %u to %u", rate, OPUS_SAMPLERATE);
+			ctx->inrate = rate;
+			ctx->step = ((uint64_t)rate << 16) / OPUS_SAMPLERATE;
+			ctx->position = 0;
+		}
+		int ret;
+		if (ctx->inrate == OPUS_SAMPLERATE)
+			ret = _encoder_copy(ctx, inbuffer, inlength / framesize);
+		else
+			ret = _encoder_resample(ctx, inbuffer, inlength / framesize);
+		ctx->in->ops->pop(ctx->in->ctx, inlength);
+		if (ret < 0)
+			ctx->run = 0;
+	}
+	encoder_dbg("encoder: opus thread end");
+	return NULL;
+}
+
+static int encoder_run(encoder_ctx_t *ctx, jitter_t *jitter)
+{
+	ctx->out = jitter;
+#ifdef ENCODER_HEARTBEAT
+	heartbeat_samples_t config;
+	config.samplerate = OPUS_SAMPLERATE;
+	config.format = ctx->in->format;
+	config.nchannels = ctx->nchannels;
+	ctx->heartbeat.ops = heartbeat_samples;
+	ctx->heartbeat.ctx = ctx->heartbeat.ops->init(&config);
+	dbg("set heart %s %dms", jitter->ctx->name, ENCODER_OPUS_FRAMEMS);
+	jitter->ops->heartbeat(jitter->ctx, &ctx->heartbeat);
+#endif
+	ctx->run = 1;
+	pthread_create(&ctx->thread, NULL, _encoder_thread, ctx);
+	return 0;
+}
+
+static const char *encoder_mime(encoder_ctx_t *ctx)
+{
+	return mime_audioopus;
+}
+
+static int encoder_samplerate(encoder_ctx_t *ctx)
+{
+	return OPUS_SAMPLERATE;
+}
+
+static jitter_format_t encoder_format(encoder_ctx_t *ctx)
+{
+	return OPUS;
+}
+
+#ifdef ENCODER_EFFORT
+static encoder_effort_t *encoder_effort(encoder_ctx_t *ctx)
+{
+	return &ctx->effort;
+}
+#endif
+
+static void encoder_destroy(encoder_ctx_t *ctx)
+{
+	ctx->run = 0;
+	ctx->in->ops->flush(ctx->in->ctx);
+	if (ctx->thread)
+		pthread_join(ctx->thread, NULL);
+#ifdef ENCODER_HEARTBEAT
+	if (ctx->heartbeat.ctx)
+		ctx->heartbeat.ops->destroy(ctx->heartbeat.ctx);
+#endif
+	opus_encoder_destroy(ctx->encoder);
+	jitter_destroy(ctx->in);
+	free(ctx->pcm);
+	free(ctx);
+}
+
+const encoder_ops_t *encoder_opus = &(encoder_ops_t)
+{
+	.name = "opus",
+	.init = encoder_init,
+	.type = ES_AUDIO,
+	.jitter = encoder_jitter,
+	.run = encoder_run,
+	.mime = encoder_mime,
+	.samplerate = encoder_samplerate,
+	.format = encoder_format,
+#ifdef ENCODER_EFFORT
+	.effort = encoder_effort,
+#endif
+	.destroy = encoder_destroy,
+};
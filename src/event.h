@@ -28,6 +28,8 @@ struct event_new_es_s
 	const char * mime;
 	jitte_t jitte;
 	decoder_t *decoder;
+	/// output of the stream, the sources with several sessions set it
+	int index;
 };
 
 typedef struct event_decode_es_s event_end_es_t;
@@ -37,6 +39,7 @@ struct event_decode_es_s
 	uint32_t pid;
 	const src_t *src;
 	decoder_t *decoder;
+	int index;
 };
 
 typedef struct event_sink_state_s event_sink_state_t;
@@ -295,7 +295,7 @@ static filter_t *_filter_build_pcm(const char *query, jitter_t *jitter, const ch
 	{
 		warn("filter: install boost filter %ddB", replaygain);
 		boost_t *boost = boost_init(&filter->boost, replaygain);
-		filter->ops->set(filter->ctx, FILTER_SAMPLED, boost_cb, boost);
+		filter->ops->set(filter->ctx, FILTER_SAMPLED, boost_cb, boost, 0);
 	}
 
 #ifdef FILTER_STATS
@@ -303,7 +303,7 @@ static filter_t *_filter_build_pcm(const char *query, jitter_t *jitter, const ch
 	{
 		warn("filter: install statistics filter");
 		stats_t *stats = stats_init(&filter->stats);
-		filter->ops->set(filter->ctx, FILTER_SAMPLED, stats_cb, stats);
+		filter->ops->set(filter->ctx, FILTER_SAMPLED, stats_cb, stats, 0);
 	}
 #endif
 
@@ -311,12 +311,12 @@ static filter_t *_filter_build_pcm(const char *query, jitter_t *jitter, const ch
 	if (query && strstr(query, "mono=left") != NULL)
 	{
 		mono_t *mono = mono_init(&filter->mono, 0);
-		filter->ops->set(filter->ctx, FILTER_SAMPLED, mono_cb, mono);
+		filter->ops->set(filter->ctx, FILTER_SAMPLED, mono_cb, mono, 0);
 	}
 	if (query && strstr(query, "mono=right") != NULL)
 	{
 		mono_t *mono = mono_init(&filter->mono, 1);
-		filter->ops->set(filter->ctx, FILTER_SAMPLED, mono_cb, mono);
+		filter->ops->set(filter->ctx, FILTER_SAMPLED, mono_cb, mono, 0);
 	}
 #endif
 #ifdef FILTER_MIXED
@@ -328,7 +328,7 @@ static filter_t *_filter_build_pcm(const char *query, jitter_t *jitter, const ch
 			mixed = mixed_init(&filter->mixed, 2);
 		else
 			mixed = mixed_init(&filter->mixed, 1);
-		filter->ops->set(filter->ctx, FILTER_SAMPLED, mixed_cb, mixed);
+		filter->ops->set(filter->ctx, FILTER_SAMPLED, mixed_cb, mixed, 0);
 	}
 #endif
 
@@ -363,12 +363,35 @@ sample_t filter_maxvalue(int bitspersample)
 	return max;
 }
 
+/**
+ * the buffer in progress stays on the jitter between two decoders,
+ * several decoders may run at the same time on different jitters.
+ */
+typedef struct filter_output_s filter_output_t;
+struct filter_output_s
+{
+	unsigned char *outbuffer;
+	int outbufferlen;
+#ifdef DECODER_HEARTBEAT
+	beat_samples_t beat;
+#endif
+};
+static filter_output_t _outputs[MAXJITTERS] = {0};
+
+void filter_flushoutput(jitter_t *out)
+{
+	filter_output_t *output = &_outputs[out->ctx->id];
+	if (output->outbuffer != NULL)
+		out->ops->push(out->ctx, output->outbufferlen, NULL);
+	output->outbuffer = NULL;
+	output->outbufferlen = 0;
+}
+
 int filter_filloutput(filter_t *filter, filter_audio_t *audio, jitter_t *out)
 {
-	static char *outbuffer = NULL;
-	static int outbufferlen = 0;
+	filter_output_t *output = &_outputs[out->ctx->id];
 #ifdef DECODER_HEARTBEAT
-	static beat_samples_t beat;
+	beat_samples_t *beat = &output->beat;
 #endif
 	int pcm_length = audio->nsamples;
 
@@ -382,40 +405,40 @@ int filter_filloutput(filter_t *filter, filter_audio_t *audio, jitter_t *out)
 		err("filter: samplerate %d not supported", jitter_samplerate(out));
 	}
 
-	if (outbuffer == NULL)
+	if (output->outbuffer == NULL)
 	{
-		outbuffer = out->ops->pull(out->ctx);
+		output->outbuffer = out->ops->pull(out->ctx);
 		/**
 		 * the pipe is broken. close the src and the decoder
 		 */
-		if (outbuffer == NULL)
+		if (output->outbuffer == NULL)
 		{
 			return -1;
 		}
 	}
 
-	outbufferlen += filter->ops->run(filter->ctx, audio,
-			outbuffer + outbufferlen, out->ctx->size - outbufferlen);
+	output->outbufferlen += filter->ops->run(filter->ctx, audio,
+			output->outbuffer + output->outbufferlen, out->ctx->size - output->outbufferlen);
 
-	if (outbufferlen >= out->ctx->size)
+	if (output->outbufferlen >= out->ctx->size)
 	{
-		if (outbufferlen > out->ctx->size)
-			err("decoder: out %d %ld", outbufferlen, out->ctx->size);
+		if (output->outbufferlen > out->ctx->size)
+			err("decoder: out %d %ld", output->outbufferlen, out->ctx->size);
 #ifdef DECODER_HEARTBEAT
-		beat.nsamples += pcm_length - audio->nsamples;
-		beat.nloops++;
-		if (beat.nloops == out->ctx->count + 1)
+		beat->nsamples += pcm_length - audio->nsamples;
+		beat->nloops++;
+		if (beat->nloops == out->ctx->count + 1)
 		{
-			decoder_dbg("decoder: heart boom %d", beat.nsamples);
-			out->ops->push(out->ctx, out->ctx->size, &beat);
-			beat.nsamples = 0;
-			beat.nloops = 0;
+			decoder_dbg("decoder: heart boom %d", beat->nsamples);
+			out->ops->push(out->ctx, out->ctx->size, beat);
+			beat->nsamples = 0;
+			beat->nloops = 0;
 		}
 		else
 #endif
 			out->ops->push(out->ctx, out->ctx->size, NULL);
-		outbuffer = NULL;
-		outbufferlen = 0;
+		output->outbuffer = NULL;
+		output->outbufferlen = 0;
 	}
 #ifdef DECODER_HEARTBEAT
 	else
@@ -423,6 +446,6 @@ int filter_filloutput(filter_t *filter, filter_audio_t *audio, jitter_t *out)
 		beat->nsamples += pcm_length;
 	}
 #endif
-	return outbufferlen;
+	return output->outbufferlen;
 }
 
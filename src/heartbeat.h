@@ -44,6 +44,14 @@ struct heartbeat_pulse_s
 	unsigned int ms;
 };
 
+typedef struct beat_timestamp_s beat_timestamp_t;
+struct beat_timestamp_s
+{
+	/// the arrival time of a packet (CLOCK_REALTIME)
+	uint32_t sec;
+	uint32_t nsec;
+};
+
 typedef union beat_s beat_t;
 union beat_s
 {
@@ -51,6 +59,7 @@ union beat_s
 	struct beat_bitrate_s bitrate;
 	struct beat_samples_s samples;
 	struct beat_pulse_s pulse;
+	struct beat_timestamp_s timestamp;
 };
 
 #ifndef HEARTBEAT_CTX
@@ -2,6 +2,8 @@
 #define __JITTER_H__
 
 extern int __jitter_dbg__;
+/// the heartbeats are not attached, the streams run as fast as possible
+extern int __jitter_freerun__;
 
 #ifndef JITTER_DBG
 #define JITTER_DBG "none"
@@ -31,6 +33,8 @@ typedef enum jitte_s {
 typedef int (*consume_t)(void *consumer, unsigned char *buffer, size_t size);
 typedef int (*produce_t)(void *producter, unsigned char *buffer, size_t size);
 typedef struct jitter_ctx_s jitter_ctx_t;
+/// called by the producer when a buffer becomes ready to peer
+typedef void (*ready_t)(void *observer, jitter_ctx_t *jitter);
 struct jitter_ctx_s
 {
 	int id;
@@ -42,6 +46,8 @@ struct jitter_ctx_s
 	void *consumer;
 	produce_t produce;
 	void *producter;
+	ready_t ready;
+	void *observer;
 	unsigned int frequence;
 	heartbeat_t *heartbeat;
 	void *private;
@@ -103,9 +109,12 @@ typedef enum jitter_format_e
 	PCM_24bits4_LE_stereo = JITTER_24BITS_INTERLEAVED | JITTER_INT_EXTRA | JITTER_CHANNEL_2,
 	PCM_32bits_LE_stereo = JITTER_32BITS_INTERLEAVED | JITTER_CHANNEL_2,
 	PCM_32bits_BE_stereo = JITTER_AUDIO | JITTER_AUDIO_INTERLEAVED | JITTER_INT_32 | JITTER_CHANNEL_2,
+	PCM_16bits_BE_stereo = JITTER_AUDIO | JITTER_AUDIO_INTERLEAVED | JITTER_INT_16 | JITTER_CHANNEL_2,
+	PCM_24bits3_BE_stereo = JITTER_AUDIO | JITTER_AUDIO_INTERLEAVED | JITTER_INT_24 | JITTER_CHANNEL_2,
 	MPEG2_3_MP3 = JITTER_AUDIO | JITTER_AUDIO_COMPRESSED,
 	FLAC,
 	MPEG4_AAC,
+	OPUS,
 	MPEG2_1 = JITTER_VIDEO | JITTER_VIDEO_COMPRESSED,
 	MPEG2_2,
 	DVB_frame,
@@ -128,10 +137,22 @@ struct jitter_s
 	jitter_format_t format;
 };
 
+/**
+ * each output uses up to 4 jitters (encoder, cache, mux, sink)
+ * for MAX_ESTREAM outputs, plus the tee, the decoders and the source cache
+ */
+#define MAXJITTERS 32
+
 #define JITTER_TYPE_SG 0x01
 #define JITTER_TYPE_RING 0x02
+#define JITTER_TYPE_TEE 0x03
 jitter_t *jitter_init(int type, const char *name, unsigned count, size_t size);
 void jitter_destroy(jitter_t *jitter);
+/**
+ * the jitter of a consumer reads the buffers of the tee in place
+ */
+int jitter_tee_attach(jitter_t *tee, jitter_t *jitter);
+int jitter_tee_check(jitter_t *jitter);
 inline int jitter_samplerate(jitter_t *jitter) {return jitter->ctx->frequence;};
 
 #endif
@@ -41,10 +41,11 @@
 
 extern jitter_t *jitter_scattergather_init(const char *name, unsigned count, size_t size);
 extern jitter_t *jitter_ringbuffer_init(const char *name, unsigned count, size_t size);
+extern jitter_t *jitter_tee_init(const char *name, unsigned count, size_t size);
 
-#define MAXJITTERS 10
 static jitter_t *_jitters[MAXJITTERS] = {0};
 int __jitter_dbg__ = -1;
+int __jitter_freerun__ = 0;
 
 static pthread_mutex_t jitter_lock = PTHREAD_MUTEX_INITIALIZER;;
 
@@ -54,11 +55,14 @@ jitter_t *jitter_init(int type, const char *name, unsigned count, size_t size)
 	int id = 0;
 
 	pthread_mutex_lock(&jitter_lock);
-	jitter_t *jit = _jitters[id];
-	while (jit != NULL && id < MAXJITTERS)
-		jit = _jitters[++id];
+	while (id < MAXJITTERS && _jitters[id] != NULL)
+		id++;
 	if (id == MAXJITTERS)
+	{
+		pthread_mutex_unlock(&jitter_lock);
+		err("jitter: too many jitters for %s", name);
 		return NULL;
+	}
 	if (!strcmp(name, JITTER_DBG))
 	{
 		__jitter_dbg__ = id;
@@ -69,6 +73,10 @@ jitter_t *jitter_init(int type, const char *name, unsigned count, size_t size)
 		jitter = jitter_scattergather_init(name, count, size);
 	else if (type == JITTER_TYPE_RING)
 		jitter = jitter_ringbuffer_init(name, count, size);
+#ifdef JITTER_TEE
+	else if (type == JITTER_TYPE_TEE)
+		jitter = jitter_tee_init(name, count, size);
+#endif
 	if (jitter != NULL)
 		jitter->ctx->id = id;
 	_jitters[id] = jitter;
@@ -139,7 +139,7 @@ static void jitter_ringbuffer_destroy(jitter_t *jitter)
 static heartbeat_t *jitter_heartbeat(jitter_ctx_t *ctx, heartbeat_t *new)
 {
 	heartbeat_t *old = ctx->heartbeat;
-	if (new != NULL)
+	if (new != NULL && !__jitter_freerun__)
 		ctx->heartbeat = new;
 	return old;
 }
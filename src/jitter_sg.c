@@ -178,7 +178,7 @@ static void _jitter_init(jitter_ctx_t *jitter)
 static heartbeat_t *jitter_heartbeat(jitter_ctx_t *ctx, heartbeat_t *new)
 {
 	heartbeat_t *old = ctx->heartbeat;
-	if (new != NULL)
+	if (new != NULL && !__jitter_freerun__)
 		ctx->heartbeat = new;
 	return old;
 }
@@ -263,6 +263,10 @@ static void jitter_push(jitter_ctx_t *jitter, size_t len, void *beat)
 		private->in->state = SCATTER_FREE;
 		private->state = JITTER_COMPLETE;
 		pthread_mutex_unlock(&private->mutex);
+		/**
+		 * the consumer may wait on an empty jitter
+		 */
+		pthread_cond_broadcast(&private->condpeer);
 	}
 	else
 	{
@@ -345,6 +349,12 @@ static void jitter_push(jitter_ctx_t *jitter, size_t len, void *beat)
 		 */
 		private->state = JITTER_RUNNING;
 	}
+	/**
+	 * The observer waits on several jitters and must be woken up
+	 * as soon as one of them may be peered without blocking.
+	 */
+	if (jitter->ready != NULL && private->state != JITTER_FILLING)
+		jitter->ready(jitter->observer, jitter);
 }
 
 static unsigned char *jitter_peer(jitter_ctx_t *jitter, void **beat)
@@ -376,23 +386,35 @@ static unsigned char *jitter_peer_channel(jitter_ctx_t *jitter, int channel, voi
 				 * the running, otherwise the peer will block.
 				 */
 				int len = 0;
+				/**
+				 * the buffer is filled in place like after a pull
+				 */
+				private->in->state = SCATTER_PULL;
 				do
 				{
 					int ret;
 					ret = jitter->produce(jitter->producter,
 						private->in->data + len, jitter->size - len);
-					if (ret > 0)
-						len += ret;
 					if (ret <= 0)
-					{
-						len = ret;
 						break;
-					}
+					len += ret;
 				} while (len < jitter->size);
 				if (len > 0)
 					jitter_push(jitter, len, NULL);
 				else
 				{
+					private->in->state = SCATTER_FREE;
+					if (private->level > 0)
+					{
+						/**
+						 * the end of the stream is shorter than the thredhold,
+						 * the buffers already produced are consumed before.
+						 */
+						pthread_mutex_lock(&private->mutex);
+						private->state = JITTER_RUNNING;
+						pthread_mutex_unlock(&private->mutex);
+						break;
+					}
 					dbg("produce nothing");
 					return NULL;
 				}
@@ -419,6 +441,16 @@ static unsigned char *jitter_peer_channel(jitter_ctx_t *jitter, int channel, voi
 		 * The scatter gather is empty and the producer fills.
 		 * The consumer is waiting that the thredhold is reached.
 		 */
+		if (private->state == JITTER_COMPLETE &&
+			private->out->state == SCATTER_FREE)
+		{
+			/**
+			 * The stream ended during the waiting
+			 */
+			pthread_mutex_unlock(&private->mutex);
+			jitter_dbg(jitter, "peer empty on %p", private->out);
+			return NULL;
+		}
 		jitter_dbg(jitter, "peer block on %p %d %d", private->out, private->state, private->out->state);
 		pthread_cond_wait(&private->condpeer, &private->mutex);
 		if (private->out->channel != channel)
@@ -426,6 +458,12 @@ static unsigned char *jitter_peer_channel(jitter_ctx_t *jitter, int channel, voi
 	}
 	private->out->state = SCATTER_POP;
 	pthread_mutex_unlock(&private->mutex);
+	/**
+	 * without heartbeat, the beat is only an information
+	 * of the producer for the consumer (i.e. the arrival time)
+	 */
+	if (beat != NULL && private->out->beat.isset && jitter->heartbeat == NULL)
+		*beat = &private->out->beat;
 #ifdef HEARTBEAT
 	while (private->out->beat.isset && jitter->heartbeat != NULL)
 	{
@@ -493,7 +531,8 @@ static void jitter_pop(jitter_ctx_t *jitter, size_t len)
 	private->out->state = SCATTER_FREE;
 	private->level--;
 	private->out = private->out->next;
-	if (private->level == 0 && jitter->thredhold > 0)
+	if (private->level == 0 && jitter->thredhold > 0 &&
+		private->state != JITTER_COMPLETE)
 	{
 		/**
 		 * The producer empties the jitter. It requests to the producer
@@ -522,6 +561,8 @@ static void jitter_flush(jitter_ctx_t *jitter)
 
 	pthread_cond_broadcast(&private->condpush);
 	pthread_cond_broadcast(&private->condpeer);
+	if (jitter->ready != NULL)
+		jitter->ready(jitter->observer, jitter);
 }
 
 static size_t jitter_length(jitter_ctx_t *jitter)
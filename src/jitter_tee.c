@@ -0,0 +1,704 @@
+/*****************************************************************************
+ * jitter_tee.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2024
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "jitter.h"
+#include "heartbeat.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+/**
+ * The tee shares its buffers between several consumers.
+ * A buffer is free when all the readers popped it, the producer
+ * fills it once and the readers use it in place.
+ */
+#define TEE_MAXREADERS 4
+
+typedef struct slot_s slot_t;
+struct slot_s
+{
+	enum
+	{
+		SLOT_FREE,
+		SLOT_PULL,
+		SLOT_READY,
+	} state;
+	unsigned char *data;
+	size_t len;
+	/// mask of the readers which have to pop the buffer
+	unsigned int refs;
+	beat_t beat;
+};
+
+typedef struct reader_s reader_t;
+typedef struct jitter_private_s jitter_private_t;
+struct jitter_private_s
+{
+	unsigned char *buffer;
+	slot_t *slots;
+	unsigned int in;
+	reader_t *readers[TEE_MAXREADERS];
+	pthread_mutex_t mutex;
+	pthread_cond_t condpush;
+	pthread_cond_t condpeer;
+	enum
+	{
+		JITTER_RUNNING,
+		JITTER_FLUSH,
+		JITTER_COMPLETE,
+	} state;
+	int pause;
+};
+
+/**
+ * the jitter of a consumer becomes a reader of the tee.
+ * Its own buffers are kept to convert the samples when the format
+ * of the consumer is not the format of the tee, and to rechunk
+ * the stream when the consumer needs buffers of another size.
+ */
+struct reader_s
+{
+	jitter_t *tee;
+	jitter_t *jitter;
+	int index;
+	unsigned int out;
+	unsigned char *convert;
+	size_t convertlen;
+	size_t len;
+	/// the buffers of the consumer are filled from several slots
+	int rechunk;
+	/// bytes of the current slot already copied
+	size_t offset;
+	beat_t beat;
+	const jitter_ops_t *ops;
+	void *private;
+	void (*destroy)(jitter_t *);
+};
+
+static const jitter_ops_t *jitter_tee;
+static const jitter_ops_t *jitter_reader;
+
+static void jitter_tee_destroy(jitter_t *jitter);
+
+jitter_t *jitter_tee_init(const char *name, unsigned int count, size_t size)
+{
+	jitter_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->count = count;
+	ctx->size = size;
+	ctx->name = name;
+	jitter_private_t *private = calloc(1, sizeof(*private));
+	private->buffer = malloc(ctx->count * ctx->size);
+	private->slots = calloc(ctx->count, sizeof(*private->slots));
+	if (private->buffer == NULL || private->slots == NULL)
+	{
+		err("jitter %s not enought memory %lu", name, ctx->count * ctx->size);
+		free(private->buffer);
+		free(private->slots);
+		free(private);
+		free(ctx);
+		return NULL;
+	}
+	for (int i = 0; i < ctx->count; i++)
+		private->slots[i].data = private->buffer + (i * ctx->size);
+	pthread_mutex_init(&private->mutex, NULL);
+	pthread_cond_init(&private->condpush, NULL);
+	pthread_cond_init(&private->condpeer, NULL);
+
+	ctx->private = private;
+	jitter_t *jitter = calloc(1, sizeof(*jitter));
+	jitter->ctx = ctx;
+	jitter->ops = jitter_tee;
+	jitter->destroy = &jitter_tee_destroy;
+	dbg("jitter %s create tee (%d*%ld)", name, ctx->count, ctx->size);
+	return jitter;
+}
+
+int jitter_tee_check(jitter_t *jitter)
+{
+	return (jitter->ops == jitter_tee);
+}
+
+static int _jitter_convertible(jitter_format_t format)
+{
+	switch (format)
+	{
+	case PCM_16bits_LE_stereo:
+	case PCM_24bits4_LE_stereo:
+	case PCM_32bits_LE_stereo:
+		return 1;
+	default:
+		break;
+	}
+	return 0;
+}
+
+int jitter_tee_attach(jitter_t *tee, jitter_t *jitter)
+{
+	jitter_private_t *private = (jitter_private_t *)tee->ctx->private;
+	size_t convertlen = 0;
+	int rechunk = 0;
+	if (jitter->format != tee->format)
+	{
+		if (!_jitter_convertible(jitter->format) || !_jitter_convertible(tee->format))
+			return -1;
+		convertlen = tee->ctx->size / FORMAT_SAMPLESIZE(tee->format) * FORMAT_SAMPLESIZE(jitter->format);
+	}
+	else
+		convertlen = tee->ctx->size;
+	/**
+	 * the encoders read whole frames of their codec
+	 */
+	if (jitter->ctx->size != convertlen)
+	{
+		if (!_jitter_convertible(jitter->format) || !_jitter_convertible(tee->format))
+			return -1;
+		rechunk = 1;
+		convertlen = jitter->ctx->size;
+	}
+	else if (jitter->format == tee->format)
+		convertlen = 0;
+	pthread_mutex_lock(&private->mutex);
+	int index = 0;
+	while (index < TEE_MAXREADERS && private->readers[index] != NULL)
+		index++;
+	if (index == TEE_MAXREADERS)
+	{
+		pthread_mutex_unlock(&private->mutex);
+		return -1;
+	}
+	reader_t *reader = calloc(1, sizeof(*reader));
+	reader->tee = tee;
+	reader->jitter = jitter;
+	reader->index = index;
+	reader->out = private->in;
+	if (convertlen > 0)
+	{
+		reader->convert = malloc(convertlen);
+		reader->convertlen = convertlen;
+	}
+	reader->rechunk = rechunk;
+	reader->ops = jitter->ops;
+	reader->private = jitter->ctx->private;
+	reader->destroy = jitter->destroy;
+	jitter->ops = jitter_reader;
+	jitter->ctx->private = reader;
+	jitter->destroy = &jitter_tee_destroy;
+	private->readers[index] = reader;
+	pthread_mutex_unlock(&private->mutex);
+	dbg("jitter %s read %s", tee->ctx->name, jitter->ctx->name);
+	return index;
+}
+
+static void _jitter_release(jitter_private_t *private, slot_t *slot, unsigned int mask)
+{
+	slot->refs &= ~mask;
+	if (slot->refs == 0 && slot->state == SLOT_READY)
+		slot->state = SLOT_FREE;
+}
+
+static void _jitter_detach(reader_t *reader)
+{
+	jitter_t *tee = reader->tee;
+	jitter_private_t *private = (jitter_private_t *)tee->ctx->private;
+
+	pthread_mutex_lock(&private->mutex);
+	for (int i = 0; i < tee->ctx->count; i++)
+		_jitter_release(private, &private->slots[i], 1 << reader->index);
+	private->readers[reader->index] = NULL;
+	pthread_mutex_unlock(&private->mutex);
+	pthread_cond_broadcast(&private->condpush);
+}
+
+static void jitter_tee_destroy(jitter_t *jitter)
+{
+	if (jitter->ops == jitter_reader)
+	{
+		/**
+		 * the consumer destroys its jitter, the tee forgets it
+		 * and the jitter gets its own operations back.
+		 */
+		reader_t *reader = (reader_t *)jitter->ctx->private;
+		if (reader->tee)
+			_jitter_detach(reader);
+		jitter->ops = reader->ops;
+		jitter->ctx->private = reader->private;
+		jitter->destroy = reader->destroy;
+		free(reader->convert);
+		free(reader);
+		jitter->destroy(jitter);
+		return;
+	}
+	jitter_ctx_t *ctx = jitter->ctx;
+	jitter_private_t *private = (jitter_private_t *)ctx->private;
+	for (int i = 0; i < TEE_MAXREADERS; i++)
+	{
+		if (private->readers[i] != NULL)
+			private->readers[i]->tee = NULL;
+	}
+	pthread_cond_destroy(&private->condpush);
+	pthread_cond_destroy(&private->condpeer);
+	pthread_mutex_destroy(&private->mutex);
+	free(private->buffer);
+	free(private->slots);
+	free(private);
+	free(ctx);
+	free(jitter);
+}
+
+static heartbeat_t *jitter_heartbeat(jitter_ctx_t *ctx, heartbeat_t *new)
+{
+	heartbeat_t *old = ctx->heartbeat;
+	if (new != NULL && !__jitter_freerun__)
+		ctx->heartbeat = new;
+	return old;
+}
+
+/**
+ * the heartbeat of the producer paces all the readers
+ */
+static heartbeat_t *jitter_tee_heartbeat(jitter_ctx_t *jitter, heartbeat_t *new)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	heartbeat_t *old = jitter_heartbeat(jitter, new);
+	for (int i = 0; i < TEE_MAXREADERS; i++)
+	{
+		reader_t *reader = private->readers[i];
+		if (reader != NULL)
+			jitter_heartbeat(reader->jitter->ctx, new);
+	}
+	return old;
+}
+
+static unsigned char *jitter_pull(jitter_ctx_t *jitter)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	unsigned char *ret = NULL;
+
+	pthread_mutex_lock(&private->mutex);
+	if (private->state == JITTER_COMPLETE)
+		private->state = JITTER_RUNNING;
+	slot_t *slot = &private->slots[private->in];
+	while (slot->state != SLOT_FREE && private->state != JITTER_FLUSH)
+	{
+		/**
+		 * the slowest reader keeps the buffer
+		 */
+		jitter_dbg(jitter, "pull block on %u", private->in);
+		pthread_cond_wait(&private->condpush, &private->mutex);
+	}
+	if (private->state != JITTER_FLUSH)
+	{
+		slot->state = SLOT_PULL;
+		ret = slot->data;
+	}
+	pthread_mutex_unlock(&private->mutex);
+	return ret;
+}
+
+static unsigned char *jitter_pull_channel(jitter_ctx_t *jitter, int channel)
+{
+	return jitter_pull(jitter);
+}
+
+static void jitter_push(jitter_ctx_t *jitter, size_t len, void *beat)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	slot_t *slot = &private->slots[private->in];
+
+	pthread_mutex_lock(&private->mutex);
+	if (slot->state != SLOT_PULL)
+	{
+		pthread_mutex_unlock(&private->mutex);
+		pthread_cond_broadcast(&private->condpeer);
+		return;
+	}
+	if (len == 0)
+	{
+		/**
+		 * the producer push empty buffer to end the stream
+		 */
+		slot->state = SLOT_FREE;
+		private->state = JITTER_COMPLETE;
+	}
+	else
+	{
+		slot->len = len;
+		memset(&slot->beat, 0, sizeof(slot->beat));
+		if (beat)
+			memcpy(&slot->beat, beat, sizeof(slot->beat));
+		slot->refs = 0;
+		for (int i = 0; i < TEE_MAXREADERS; i++)
+		{
+			reader_t *reader = private->readers[i];
+			if (reader == NULL)
+				continue;
+			slot->refs |= 1 << i;
+			/// the readers check the samplerate of the stream
+			reader->jitter->ctx->frequence = jitter->frequence;
+		}
+		slot->state = (slot->refs)? SLOT_READY: SLOT_FREE;
+		private->in = (private->in + 1) % jitter->count;
+	}
+	pthread_mutex_unlock(&private->mutex);
+	pthread_cond_broadcast(&private->condpeer);
+}
+
+static unsigned char *jitter_peer(jitter_ctx_t *jitter, void **beat)
+{
+	return NULL;
+}
+
+static void jitter_pop(jitter_ctx_t *jitter, size_t len)
+{
+}
+
+static void jitter_flush(jitter_ctx_t *jitter)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	pthread_mutex_lock(&private->mutex);
+	private->state = JITTER_FLUSH;
+	pthread_mutex_unlock(&private->mutex);
+	pthread_cond_broadcast(&private->condpush);
+	pthread_cond_broadcast(&private->condpeer);
+}
+
+static size_t jitter_length(jitter_ctx_t *jitter)
+{
+	return -1;
+}
+
+static void jitter_reset(jitter_ctx_t *jitter)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	pthread_mutex_lock(&private->mutex);
+	for (int i = 0; i < jitter->count; i++)
+	{
+		private->slots[i].state = SLOT_FREE;
+		private->slots[i].refs = 0;
+	}
+	private->in = 0;
+	for (int i = 0; i < TEE_MAXREADERS; i++)
+	{
+		if (private->readers[i] != NULL)
+		{
+			private->readers[i]->out = 0;
+			private->readers[i]->offset = 0;
+			private->readers[i]->len = 0;
+		}
+	}
+	private->state = JITTER_RUNNING;
+	pthread_mutex_unlock(&private->mutex);
+	pthread_cond_broadcast(&private->condpush);
+	pthread_cond_broadcast(&private->condpeer);
+}
+
+static int jitter_empty(jitter_ctx_t *jitter)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	for (int i = 0; i < jitter->count; i++)
+	{
+		if (private->slots[i].state == SLOT_READY)
+			return 0;
+	}
+	return 1;
+}
+
+static void jitter_pause(jitter_ctx_t *jitter, int enable)
+{
+	jitter_private_t *private = (jitter_private_t *)jitter->private;
+	pthread_mutex_lock(&private->mutex);
+	private->pause = enable;
+	if (private->state == JITTER_FLUSH && !enable)
+		private->state = JITTER_RUNNING;
+	pthread_mutex_unlock(&private->mutex);
+	pthread_cond_broadcast(&private->condpeer);
+}
+
+static unsigned int jitter_nbchannels(jitter_ctx_t *jitter)
+{
+	return 1;
+}
+
+static const jitter_ops_t *jitter_tee = &(jitter_ops_t)
+{
+	.heartbeat = jitter_tee_heartbeat,
+	.reset = jitter_reset,
+	.pull = jitter_pull,
+	.pull_channel = jitter_pull_channel,
+	.push = jitter_push,
+	.peer = jitter_peer,
+	.pop = jitter_pop,
+	.flush = jitter_flush,
+	.length = jitter_length,
+	.empty = jitter_empty,
+	.pause = jitter_pause,
+	.nbchannels = jitter_nbchannels,
+};
+
+/**
+ * the samples are read as 32 bits and written with the size of the reader
+ */
+static size_t _jitter_convert(reader_t *reader, unsigned char *out, const unsigned char *data, size_t len)
+{
+	int insize = FORMAT_SAMPLESIZE(reader->tee->format) / 8;
+	int outsize = FORMAT_SAMPLESIZE(reader->jitter->format) / 8;
+	int inshift = 32 - FORMAT_SHIFT(reader->tee->format);
+	int outshift = 32 - FORMAT_SHIFT(reader->jitter->format);
+	size_t nsamples = len / insize;
+	if (reader->jitter->format == reader->tee->format)
+	{
+		memcpy(out, data, nsamples * insize);
+		return nsamples * insize;
+	}
+	for (size_t i = 0; i < nsamples; i++)
+	{
+		int32_t sample = 0;
+		if (insize == 2)
+			sample = ((int16_t *)data)[i];
+		else
+			sample = ((int32_t *)data)[i];
+		sample = (int32_t)((uint32_t)sample << inshift) >> outshift;
+		if (outsize == 2)
+			((int16_t *)out)[i] = sample;
+		else
+			((int32_t *)out)[i] = sample;
+	}
+	return nsamples * outsize;
+}
+
+static slot_t *_jitter_reader_wait(jitter_ctx_t *jitter, reader_t *reader)
+{
+	jitter_private_t *private = (jitter_private_t *)reader->tee->ctx->private;
+	unsigned int mask = 1 << reader->index;
+
+	pthread_mutex_lock(&private->mutex);
+	slot_t *slot = &private->slots[reader->out];
+	while (!(slot->state == SLOT_READY && (slot->refs & mask)) || private->pause)
+	{
+		if (private->state == JITTER_COMPLETE && !private->pause)
+		{
+			/**
+			 * the reader is on the end of the stream
+			 */
+			pthread_mutex_unlock(&private->mutex);
+			return NULL;
+		}
+		jitter_dbg(jitter, "peer block on %u", reader->out);
+		pthread_cond_wait(&private->condpeer, &private->mutex);
+	}
+	pthread_mutex_unlock(&private->mutex);
+	return slot;
+}
+
+static void _jitter_reader_beat(jitter_ctx_t *jitter, beat_t *slotbeat, void **beat)
+{
+#ifdef HEARTBEAT
+	/**
+	 * each reader runs with its own heartbeat
+	 */
+	if (slotbeat->isset && jitter->heartbeat != NULL)
+	{
+		if (beat != NULL)
+			*beat = slotbeat;
+		else
+		{
+			beat_t copy = *slotbeat;
+			heartbeat_t *heartbeat = jitter->heartbeat;
+			if (heartbeat->ops->wait(heartbeat->ctx, &copy) == -1)
+				heartbeat->ops->start(heartbeat->ctx);
+		}
+	}
+#endif
+}
+
+static void _jitter_reader_next(reader_t *reader, slot_t *slot)
+{
+	jitter_private_t *private = (jitter_private_t *)reader->tee->ctx->private;
+	pthread_mutex_lock(&private->mutex);
+	if (slot->refs & (1 << reader->index))
+	{
+		_jitter_release(private, slot, 1 << reader->index);
+		reader->out = (reader->out + 1) % reader->tee->ctx->count;
+	}
+	pthread_mutex_unlock(&private->mutex);
+	pthread_cond_broadcast(&private->condpush);
+}
+
+/**
+ * the buffer of the consumer is filled with the samples of
+ * the next slots, only the last buffer of the stream may be shorter.
+ */
+static unsigned char *_jitter_reader_rechunk(jitter_ctx_t *jitter, reader_t *reader, void **beat)
+{
+	int insize = FORMAT_SAMPLESIZE(reader->tee->format) / 8;
+	int outsize = FORMAT_SAMPLESIZE(reader->jitter->format) / 8;
+	unsigned int framesize = outsize * FORMAT_NCHANNELS(reader->jitter->format);
+	if (framesize == 0)
+		framesize = outsize;
+	size_t chunk = reader->convertlen / framesize * framesize;
+
+	while (reader->len < chunk)
+	{
+		slot_t *slot = _jitter_reader_wait(jitter, reader);
+		if (slot == NULL)
+			break;
+		if (reader->len == 0)
+			reader->beat = slot->beat;
+		if (reader->offset == 0 && beat == NULL)
+			_jitter_reader_beat(jitter, &slot->beat, NULL);
+		size_t length = slot->len - reader->offset;
+		if (length > (chunk - reader->len) / outsize * insize)
+			length = (chunk - reader->len) / outsize * insize;
+		reader->len += _jitter_convert(reader, reader->convert + reader->len,
+					slot->data + reader->offset, length);
+		reader->offset += length;
+		if (reader->offset + insize > slot->len)
+		{
+			reader->offset = 0;
+			_jitter_reader_next(reader, slot);
+		}
+	}
+	if (reader->len == 0)
+		return NULL;
+	if (beat != NULL)
+		_jitter_reader_beat(jitter, &reader->beat, beat);
+	return reader->convert;
+}
+
+static unsigned char *jitter_reader_peer(jitter_ctx_t *jitter, void **beat)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee == NULL)
+		return NULL;
+	if (reader->rechunk)
+		return _jitter_reader_rechunk(jitter, reader, beat);
+
+	slot_t *slot = _jitter_reader_wait(jitter, reader);
+	if (slot == NULL)
+		return NULL;
+	_jitter_reader_beat(jitter, &slot->beat, beat);
+	if (reader->convert)
+	{
+		reader->len = _jitter_convert(reader, reader->convert, slot->data, slot->len);
+		return reader->convert;
+	}
+	return slot->data;
+}
+
+static unsigned char *jitter_reader_peer_channel(jitter_ctx_t *jitter, int channel, void **beat)
+{
+	return jitter_reader_peer(jitter, beat);
+}
+
+static size_t jitter_reader_length(jitter_ctx_t *jitter)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee == NULL)
+		return -1;
+	if (reader->rechunk)
+		return reader->len;
+	jitter_private_t *private = (jitter_private_t *)reader->tee->ctx->private;
+	slot_t *slot = &private->slots[reader->out];
+	if (slot->state != SLOT_READY)
+		return -1;
+	if (reader->convert)
+		return reader->len;
+	return slot->len;
+}
+
+static void jitter_reader_pop(jitter_ctx_t *jitter, size_t len)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee == NULL)
+		return;
+	if (reader->rechunk)
+	{
+		/// the slots are already released during the filling
+		reader->len = 0;
+		return;
+	}
+	jitter_private_t *private = (jitter_private_t *)reader->tee->ctx->private;
+	_jitter_reader_next(reader, &private->slots[reader->out]);
+}
+
+static void jitter_reader_flush(jitter_ctx_t *jitter)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee != NULL)
+		jitter_flush(reader->tee->ctx);
+}
+
+static void jitter_reader_reset(jitter_ctx_t *jitter)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee != NULL)
+		jitter_reset(reader->tee->ctx);
+}
+
+static int jitter_reader_empty(jitter_ctx_t *jitter)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee == NULL)
+		return 1;
+	if (reader->rechunk && reader->len > 0)
+		return 0;
+	jitter_private_t *private = (jitter_private_t *)reader->tee->ctx->private;
+	slot_t *slot = &private->slots[reader->out];
+	return !(slot->state == SLOT_READY && (slot->refs & (1 << reader->index)));
+}
+
+static void jitter_reader_pause(jitter_ctx_t *jitter, int enable)
+{
+	reader_t *reader = (reader_t *)jitter->private;
+	if (reader->tee != NULL)
+		jitter_pause(reader->tee->ctx, enable);
+}
+
+static const jitter_ops_t *jitter_reader = &(jitter_ops_t)
+{
+	.heartbeat = jitter_heartbeat,
+	.reset = jitter_reader_reset,
+	.peer = jitter_reader_peer,
+	.peer_channel = jitter_reader_peer_channel,
+	.pop = jitter_reader_pop,
+	.flush = jitter_reader_flush,
+	.length = jitter_reader_length,
+	.empty = jitter_reader_empty,
+	.pause = jitter_reader_pause,
+	.nbchannels = jitter_nbchannels,
+};
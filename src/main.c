@@ -62,9 +62,16 @@
 #include "player.h"
 #include "encoder.h"
 #include "sink.h"
+#include "src.h"
 #include "media.h"
 #include "cmds.h"
 #include "daemonize.h"
+#ifdef TRANSCODE
+#include "transcode.h"
+#endif
+#ifdef TRANSCACHE
+#include "transcache.h"
+#endif
 
 #define STINGIFY(text) #text
 
@@ -102,10 +109,20 @@ void help(const char *name)
 	fprintf(stderr, "%s [-R <websocketdir>][-m <media>][-o <output>][-p <pidfile>]\n", name);
 	fprintf(stderr, "\t...[-f <filtername>][-x][-D][-a][-r][-l][-L <logfile>]\n");
 	fprintf(stderr, "\t...[-d <directory>][-R <directory>]\n");
-	fprintf(stderr, "\t...[-P [0-99]]\n");
+	fprintf(stderr, "\t...[-P [0-99]][-S]\n");
+#ifdef TRANSCODE
+	fprintf(stderr, "%s -T <jobs> -o <output> [-f <filtername>] <file> ...\n", name);
+#endif
 	fprintf(stderr, "\n");
 	fprintf(stderr, "\t -m <media>\tSet the media supporting audio files\n");
 	fprintf(stderr, "\t -o <output>\tSet the sink URL (default: alsa:default)\n");
+#ifdef SINK_NULL
+	fprintf(stderr, "\t\t\tnull://[<encoder>][?speed=<N>] consumes without device at N x realtime\n");
+#endif
+#ifdef JITTER_TEE
+	fprintf(stderr, "\t\t\tseveral outputs share the same decoding\n");
+	fprintf(stderr, "\t -S\t\tEach output plays its own stream (rtp://...?sessions=<N>)\n");
+#endif
 	fprintf(stderr, "\t -a\t\tAuto play enabled\n");
 	fprintf(stderr, "\t -r\t\tShuffle enabled\n");
 	fprintf(stderr, "\t -l\t\tLoop enabled\n");
@@ -114,6 +131,10 @@ void help(const char *name)
 	fprintf(stderr, "\t -d <directory>\tSet the working directory\n");
 	fprintf(stderr, "\t -P <priority>\tSet the process priority\n");
 	fprintf(stderr, "\t -f <filter>\tSet a filter and its features (default: pcm\n");
+#ifdef TRANSCODE
+	fprintf(stderr, "\t -T <jobs>\tTranscode the files as fast as possible with <jobs> processes (0: one per cpu)\n");
+	fprintf(stderr, "\t\t\tthe output is a sink URL where %%s is replaced by the file name\n");
+#endif
 	fprintf(stderr, "\n");
 	fprintf(stderr, "\t filters:\n");
 	fprintf(stderr, "\t pcm\tstereo interleaved stream\n");
@@ -146,12 +167,32 @@ static encoder_t *main_encoder(player_ctx_t *player, sink_t *sink)
 	int index = sink->ops->attach(sink->ctx, encoder);
 	jitter_t *sink_jitter;
 	sink_jitter = sink->ops->jitter(sink->ctx, index);
+	if (sink_jitter == NULL)
+	{
+		err("output not available for the encoder");
+		encoder->ops->destroy(encoder->ctx);
+		sink->ops->destroy(sink->ctx);
+		free(encoder);
+		return NULL;
+	}
+	if (player_subscribe(player, encoder) < 0)
+	{
+		err("output not available for the player");
+		encoder->ops->destroy(encoder->ctx);
+		sink->ops->destroy(sink->ctx);
+		free(encoder);
+		return NULL;
+	}
+#ifdef TRANSCACHE
+	// the encoded stream passes through the cache
+	transcache_t *cache = transcache_init(player, encoder, sink_jitter);
+	if (cache != NULL)
+		sink_jitter = transcache_jitter(cache);
+#endif
 
 	// start encoder
 	encoder->ops->run(encoder->ctx, sink_jitter);
 
-	player_subscribe(player, encoder);
-
 	return encoder;
 }
 
@@ -162,11 +203,17 @@ static encoder_t *main_encoder(player_ctx_t *player, sink_t *sink)
 #define RANDOM 0x10
 #define KILLDAEMON 0x20
 #define MDNS 0x40
+#define TRANSCODE_MODE 0x80
 int main(int argc, char **argv)
 {
 	int priority = 0;
 	const char *mediapath = NULL;
 	const char *outarg = "default";
+#ifdef JITTER_TEE
+	const char *outargs[MAX_ESTREAM] = {0};
+	int noutargs = 0;
+	int split = 0;
+#endif
 	pthread_t thread;
 	const char *root = "/tmp";
 	int mode = 0;
@@ -176,11 +223,12 @@ int main(int argc, char **argv)
 	const char *filtername = "pcm";
 	const char *logfile = NULL;
 	const char *cwd = NULL;
+	int njobs = 0;
 
 	int opt;
 	do
 	{
-		opt = getopt(argc, argv, "R:n:m:o:u:p:f:hDKVxalrL:d:P:B");
+		opt = getopt(argc, argv, "R:n:m:o:u:p:f:hDKVxalrL:d:P:BT:S");
 		switch (opt)
 		{
 			case 'R':
@@ -194,6 +242,10 @@ int main(int argc, char **argv)
 			break;
 			case 'o':
 				outarg = optarg;
+#ifdef JITTER_TEE
+				if (noutargs < MAX_ESTREAM)
+					outargs[noutargs++] = optarg;
+#endif
 			break;
 			case 'u':
 				user = optarg;
@@ -238,6 +290,15 @@ int main(int argc, char **argv)
 			case 'B':
 				mode |= MDNS;
 			break;
+			case 'T':
+				mode |= TRANSCODE_MODE;
+				njobs = strtol(optarg, NULL, 10);
+			break;
+#ifdef JITTER_TEE
+			case 'S':
+				split = 1;
+			break;
+#endif
 		}
 	} while(opt != -1);
 
@@ -292,9 +353,19 @@ int main(int argc, char **argv)
 #endif
 	}
 
+#ifdef TRANSCODE
+	if (mode & TRANSCODE_MODE)
+	{
+		return transcode_run(filtername, outarg, argv + optind, argc - optind, njobs);
+	}
+#endif
+
 	player_ctx_t *player = player_init(filtername);
 	if (player == NULL)
 		return -1;
+#ifdef JITTER_TEE
+	player_split(player, split);
+#endif
 
 	uid_t pw_uid = getuid();
 	gid_t pw_gid = getgid();
@@ -397,6 +468,10 @@ int main(int argc, char **argv)
 
 	sink_t *sink = NULL;
 
+#ifdef JITTER_TEE
+	if (noutargs > 0)
+		outarg = outargs[0];
+#endif
 	sink = sink_build(player, outarg);
 
 	if (sink == NULL)
@@ -405,6 +480,35 @@ int main(int argc, char **argv)
 		goto end;
 	}
 	encoder_t *encoder = main_encoder(player, sink);
+	if (encoder == NULL)
+	{
+		/// the sink is already destroyed by main_encoder
+		err("output %s not set", outarg);
+		goto end;
+	}
+#ifdef JITTER_TEE
+	/**
+	 * the other outputs share the stream of the first one,
+	 * each encoder runs on its own thread
+	 */
+	sink_t *sinks[MAX_ESTREAM] = {0};
+	encoder_t *encoders[MAX_ESTREAM] = {0};
+	for (int j = 1; j < noutargs; j++)
+	{
+		sinks[j] = sink_build(player, outargs[j]);
+		if (sinks[j] != NULL)
+			encoders[j] = main_encoder(player, sinks[j]);
+		/// main_encoder destroys the sink on error
+		if (encoders[j] == NULL)
+		{
+			err("output %s not set", outargs[j]);
+			sinks[j] = NULL;
+		}
+	}
+#endif
+#ifdef TRANSCACHE
+	transcache_run(player);
+#endif
 
 	if (setegid(pw_gid))
 		err("main: change group %s", strerror(errno));
@@ -444,8 +548,29 @@ int main(int argc, char **argv)
 
 	ret = player_run(player);
 
+#ifdef TRANSCACHE
+	transcache_stop(player);
+#endif
 	encoder->ops->destroy(encoder->ctx);
+#ifdef JITTER_TEE
+	for (int j = 1; j < noutargs; j++)
+	{
+		if (encoders[j] != NULL)
+			encoders[j]->ops->destroy(encoders[j]->ctx);
+	}
+#endif
+#ifdef TRANSCACHE
+	// the cache forwards to the sinks until the end of the encoders
+	transcache_destroy(player);
+#endif
 	sink->ops->destroy(sink->ctx);
+#ifdef JITTER_TEE
+	for (int j = 1; j < noutargs; j++)
+	{
+		if (sinks[j] != NULL)
+			sinks[j]->ops->destroy(sinks[j]->ctx);
+	}
+#endif
 	player_destroy(player);
 
 end:
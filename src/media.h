@@ -12,6 +12,9 @@ extern const char* const mime_audioflac;
 extern const char* const mime_audioalac;
 extern const char* const mime_audioaac;
 extern const char* const mime_audiopcm;
+extern const char* const mime_audiol16;
+extern const char* const mime_audiol24;
+extern const char* const mime_audioopus;
 extern const char* const mime_directory;
 
 extern const char* const str_title;
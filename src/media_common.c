@@ -70,6 +70,9 @@ const char* const mime_audioflac = "audio/flac";
 const char* const mime_audioalac = "audio/alac";
 const char* const mime_audioaac = "audio/aac";
 const char* const mime_audiopcm = "audio/pcm";
+const char* const mime_audiol16 = "audio/L16";
+const char* const mime_audiol24 = "audio/L24";
+const char* const mime_audioopus = "audio/opus";
 const char* const mime_imagejpg = "image/jpg";
 const char* const mime_imagepng = "image/png";
 const char* const mime_directory = "inode/directory";
@@ -274,6 +277,15 @@ const char *utils_mime2mime(const char *mime)
 		length = strlen(mime_audioaac);
 		if (!strncmp(mime, mime_audioaac, length))
 			return mime_audioaac;
+		length = strlen(mime_audiol16);
+		if (!strncmp(mime, mime_audiol16, length))
+			return mime_audiol16;
+		length = strlen(mime_audiol24);
+		if (!strncmp(mime, mime_audiol24, length))
+			return mime_audiol24;
+		length = strlen(mime_audioopus);
+		if (!strncmp(mime, mime_audioopus, length))
+			return mime_audioopus;
 		length = strlen(mime_imagejpg);
 		if (!strncmp(mime, mime_imagejpg, length))
 			return mime_imagejpg;
@@ -299,6 +311,8 @@ const char *utils_format2mime(jitter_format_t format)
 		return mime_audiomp3;
 	case FLAC:
 		return mime_audioflac;
+	case OPUS:
+		return mime_audioopus;
 	case MPEG2_1:
 	case MPEG2_2:
 		return mime_octetstream;
@@ -51,17 +51,24 @@ mux_t *mux_build(player_ctx_t *player, const char *protocol, const char *search)
 	mux_t *mux = NULL;
 	const mux_ops_t *ops = NULL;
 	mux_ctx_t *ctx = NULL;
-#ifdef MUX_RTP
-	if (protocol && !strcmp(protocol, mux_rtp->protocol))
+#ifdef MUX_MPEGTS
+	/**
+	 * mux=mpegts sends the transport stream over udp,
+	 * mux=mpegts/rtp encapsulates it into rtp.
+	 */
+	const char *string = NULL;
+	if (search)
+		string = strstr(search, "mux=");
+	if (string && !strncmp(string + 4, mux_mpegts->protocol, strlen(mux_mpegts->protocol)))
 	{
-		ops = mux_rtp;
+		ops = mux_mpegts;
 	}
 	else
 #endif
-#ifdef MUX_DVB
-	if (protocol && !strcmp(protocol, mux_dvb->protocol))
+#ifdef MUX_RTP
+	if (protocol && !strcmp(protocol, mux_rtp->protocol))
 	{
-		ops = mux_dvb;
+		ops = mux_rtp;
 	}
 	else
 #endif
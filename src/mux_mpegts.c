@@ -0,0 +1,702 @@
+/*****************************************************************************
+ * mux_mpegts.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <byteswap.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "player.h"
+#include "encoder.h"
+#include "jitter.h"
+#include "rtp.h"
+typedef struct mux_s mux_t;
+typedef struct mux_ops_s mux_ops_t;
+typedef struct mux_ctx_s mux_ctx_t;
+typedef struct mux_estream_s
+{
+	const char *mime;
+	jitter_t *in;
+	uint16_t pid;
+	/// stream_type of the PMT
+	uint8_t type;
+	/// stream_id of the PES header
+	uint8_t streamid;
+	uint8_t counter;
+} mux_estream_t;
+#define MAX_ESTREAM 2
+
+struct mux_ctx_s
+{
+	player_ctx_t *player;
+	mux_estream_t estreams[MAX_ESTREAM];
+	jitter_t *out;
+	pthread_t thread;
+	/// the thread sleeps until one input jitter is ready
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int nready;
+	int run;
+	struct timespec start;
+	uint16_t tsid;
+	uint16_t program;
+	uint16_t pmtpid;
+	uint16_t pcrpid;
+	uint8_t version;
+	uint8_t patcounter;
+	uint8_t pmtcounter;
+	uint8_t nullcounter;
+	int psichanged;
+	/// 27MHz clock of the last PSI and PCR
+	uint64_t psitime;
+	uint64_t pcrtime;
+	/// the datagram under construction is the pulled sink buffer
+	unsigned char *outbuffer;
+	uint64_t outtime;
+	unsigned int npackets;
+	unsigned int maxpackets;
+	size_t headerlen;
+	int rtp;
+	rtpheader_t header;
+	uint16_t seqnum;
+};
+#define MUX_CTX
+#include "mux.h"
+#include "media.h"
+#include "dvb.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define mux_dbg(...)
+
+#define TS_SYNC 0x47
+#define TS_PACKETSIZE 188
+#define TS_HEADERSIZE 4
+#define TS_PAYLOADSIZE (TS_PACKETSIZE - TS_HEADERSIZE)
+/// 7 packets fill an ethernet frame, it is the IPTV standard
+#define TS_NPACKETS 7
+#define TS_PATPID 0x0000
+#define TS_NULLPID 0x1FFF
+#define TS_PMTPID 0x1000
+#define TS_ESPID 0x0100
+/// 27MHz clock
+#define TS_CLOCK 27000000ull
+#define TS_MS(ms) ((ms) * (TS_CLOCK / 1000))
+/// ISO/IEC 13818-1 requires a PCR at least every 100ms, DVB every 40ms
+#define TS_PCRINTERVAL 30
+#define TS_PSIINTERVAL 100
+/// the datagram is completed with null packets after this delay
+#define TS_MAXDELAY 40
+/// the decoder presents the audio after this delay behind the PCR
+#define TS_PTSDELAY 200
+/// RFC 2250: the RTP header is sent without CSRC
+#define TS_RTPHEADERSIZE 12
+#define PES_HEADERSIZE 14
+#define PES_MAXHEADERSIZE 64
+#define MUXJITTER_SIZE 8
+
+static const char *jitter_name = "mpegts muxer";
+
+static mux_ctx_t *mux_init(player_ctx_t *player, const char *search)
+{
+	mux_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->player = player;
+	ctx->tsid = 1;
+	ctx->program = 1;
+	ctx->pmtpid = TS_PMTPID;
+	uint16_t pid = TS_ESPID;
+	if (search)
+	{
+		const char *string = strstr(search, "mux=mpegts/rtp");
+		if (string != NULL)
+			ctx->rtp = 1;
+		string = strstr(search, "program=");
+		if (string != NULL)
+			ctx->program = atoi(string + 8);
+		string = strstr(search, "pid=");
+		if (string != NULL)
+			pid = strtol(string + 4, NULL, 0);
+	}
+	for (int i = 0; i < MAX_ESTREAM; i++)
+		ctx->estreams[i].pid = pid + i;
+	/// the first stream carries the PCR
+	ctx->pcrpid = pid;
+	ctx->psichanged = 1;
+
+	if (ctx->rtp)
+	{
+		uint32_t ssrc = random();
+		ctx->header.b.v = 2;
+		ctx->header.b.pt = RTP_PT_MP2T;
+		ctx->seqnum = random();
+		ctx->header.ssrc = __bswap_32(ssrc);
+		ctx->headerlen = TS_RTPHEADERSIZE;
+	}
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->cond, NULL);
+	warn("mux: mpegts program %u pmt %#x pcr %#x%s", ctx->program, ctx->pmtpid, ctx->pcrpid, ctx->rtp?" over rtp":"");
+	return ctx;
+}
+
+static jitter_t *mux_jitter(mux_ctx_t *ctx, unsigned int index)
+{
+	if (index < MAX_ESTREAM)
+		return ctx->estreams[index].in;
+	return NULL;
+}
+
+static uint64_t _mux_clock(mux_ctx_t *ctx)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t clock = (now.tv_sec - ctx->start.tv_sec) * TS_CLOCK;
+	clock += ((int64_t)now.tv_nsec - ctx->start.tv_nsec) * 27 / 1000;
+	return clock;
+}
+
+/**
+ * ISO/IEC 13818-1 annex A: CRC32 without reflection
+ */
+static uint32_t _mux_crc32(const unsigned char *data, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < len; i++)
+	{
+		crc ^= (uint32_t)data[i] << 24;
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+	}
+	return crc;
+}
+
+static void _mux_pcr(unsigned char *offset, uint64_t clock)
+{
+	uint64_t base = (clock / 300) & 0x1FFFFFFFFull;
+	uint16_t ext = clock % 300;
+	offset[0] = base >> 25;
+	offset[1] = base >> 17;
+	offset[2] = base >> 9;
+	offset[3] = base >> 1;
+	offset[4] = ((base & 0x01) << 7) | 0x7E | (ext >> 8);
+	offset[5] = ext;
+}
+
+static void _mux_pts(unsigned char *offset, uint64_t pts)
+{
+	offset[0] = 0x21 | ((pts >> 29) & 0x0E);
+	offset[1] = pts >> 22;
+	offset[2] = ((pts >> 14) & 0xFE) | 0x01;
+	offset[3] = pts >> 7;
+	offset[4] = ((pts << 1) & 0xFE) | 0x01;
+}
+
+/**
+ * set the TS header and the adaptation field of size "adaption"
+ * (length byte included) and return the payload pointer.
+ */
+static unsigned char *_mux_tsheader(unsigned char *packet, uint16_t pid, int start, uint8_t *counter, int payload, size_t adaption)
+{
+	ts_packet_header_t *header = (ts_packet_header_t *)packet;
+	header->decoded.sync = TS_SYNC;
+	header->decoded.transport_error = 0;
+	header->decoded.start_payload = start;
+	header->decoded.priority = 0;
+	header->decoded.hpid = pid >> 8;
+	header->decoded.lpid = pid & 0xFF;
+	header->decoded.scrambling = 0;
+	header->decoded.adaption = (adaption > 0);
+	header->decoded.payload = payload;
+	/// the counter is incremented only with a payload
+	if (payload)
+		header->decoded.counter = (*counter)++ & 0x0F;
+	else
+		header->decoded.counter = (*counter - 1) & 0x0F;
+	packet += TS_HEADERSIZE;
+	if (adaption > 0)
+	{
+		ts_packet_adaption_t *field = (ts_packet_adaption_t *)packet;
+		field->decoded.length = adaption - 1;
+		if (adaption > 1)
+		{
+			packet[1] = 0;
+			memset(packet + 2, 0xFF, adaption - 2);
+		}
+		packet += adaption;
+	}
+	return packet;
+}
+
+static unsigned char *_mux_packet(mux_ctx_t *ctx, uint64_t now)
+{
+	if (ctx->outbuffer == NULL)
+	{
+		ctx->outbuffer = ctx->out->ops->pull(ctx->out->ctx);
+		if (ctx->outbuffer == NULL)
+			return NULL;
+		ctx->npackets = 0;
+		ctx->outtime = now;
+		if (ctx->rtp)
+		{
+			/// RFC 2250: 90kHz timestamp of the first byte
+			ctx->header.b.seqnum = __bswap_16(ctx->seqnum);
+			ctx->header.timestamp = __bswap_32((uint32_t)(now / 300));
+			ctx->seqnum++;
+			memcpy(ctx->outbuffer, &ctx->header, ctx->headerlen);
+		}
+	}
+	return ctx->outbuffer + ctx->headerlen + ctx->npackets * TS_PACKETSIZE;
+}
+
+static void _mux_send(mux_ctx_t *ctx)
+{
+	ctx->npackets++;
+	if (ctx->npackets < ctx->maxpackets)
+		return;
+	ctx->out->ops->push(ctx->out->ctx, ctx->headerlen + ctx->npackets * TS_PACKETSIZE, NULL);
+	ctx->outbuffer = NULL;
+	ctx->npackets = 0;
+}
+
+/**
+ * the receivers expect constant datagrams, the end is filled with
+ * null packets.
+ */
+static void _mux_flush(mux_ctx_t *ctx)
+{
+	while (ctx->outbuffer != NULL)
+	{
+		unsigned char *packet = ctx->outbuffer + ctx->headerlen + ctx->npackets * TS_PACKETSIZE;
+		unsigned char *payload = _mux_tsheader(packet, TS_NULLPID, 0, &ctx->nullcounter, 1, 0);
+		memset(payload, 0xFF, TS_PAYLOADSIZE);
+		_mux_send(ctx);
+	}
+}
+
+static int _mux_section(mux_ctx_t *ctx, uint16_t pid, uint8_t *counter, unsigned char *section, size_t len, uint64_t now)
+{
+	uint32_t crc = _mux_crc32(section, len);
+	section[len++] = crc >> 24;
+	section[len++] = crc >> 16;
+	section[len++] = crc >> 8;
+	section[len++] = crc;
+
+	unsigned char *packet = _mux_packet(ctx, now);
+	if (packet == NULL)
+		return -1;
+	unsigned char *payload = _mux_tsheader(packet, pid, 1, counter, 1, 0);
+	/// pointer field
+	*payload++ = 0;
+	memcpy(payload, section, len);
+	memset(payload + len, 0xFF, TS_PAYLOADSIZE - 1 - len);
+	_mux_send(ctx);
+	return 0;
+}
+
+static int _mux_psi(mux_ctx_t *ctx, uint64_t now)
+{
+	unsigned char section[TS_PAYLOADSIZE];
+	size_t len = 0;
+
+	if (ctx->psichanged)
+	{
+		ctx->version = (ctx->version + 1) & 0x1F;
+		ctx->psichanged = 0;
+	}
+	/// PAT with one program
+	section[len++] = 0x00;
+	len += 2;
+	section[len++] = ctx->tsid >> 8;
+	section[len++] = ctx->tsid;
+	section[len++] = 0xC1 | (ctx->version << 1);
+	section[len++] = 0;
+	section[len++] = 0;
+	section[len++] = ctx->program >> 8;
+	section[len++] = ctx->program;
+	section[len++] = 0xE0 | (ctx->pmtpid >> 8);
+	section[len++] = ctx->pmtpid;
+	section[1] = 0xB0 | ((len + 1) >> 8);
+	section[2] = len + 1;
+	if (_mux_section(ctx, TS_PATPID, &ctx->patcounter, section, len, now) < 0)
+		return -1;
+
+	/// PMT of the elementary streams
+	len = 0;
+	section[len++] = 0x02;
+	len += 2;
+	section[len++] = ctx->program >> 8;
+	section[len++] = ctx->program;
+	section[len++] = 0xC1 | (ctx->version << 1);
+	section[len++] = 0;
+	section[len++] = 0;
+	section[len++] = 0xE0 | (ctx->pcrpid >> 8);
+	section[len++] = ctx->pcrpid;
+	section[len++] = 0xF0;
+	section[len++] = 0;
+	for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
+	{
+		mux_estream_t *estream = &ctx->estreams[i];
+		section[len++] = estream->type;
+		section[len++] = 0xE0 | (estream->pid >> 8);
+		section[len++] = estream->pid;
+		if (estream->mime == mime_audioopus)
+		{
+			/// ETSI TS 102 366: registration and extension descriptors
+			section[len++] = 0xF0;
+			section[len++] = 10;
+			section[len++] = 0x05;
+			section[len++] = 4;
+			memcpy(section + len, "Opus", 4);
+			len += 4;
+			section[len++] = 0x7F;
+			section[len++] = 2;
+			section[len++] = 0x80;
+			section[len++] = 0x02;
+		}
+		else
+		{
+			section[len++] = 0xF0;
+			section[len++] = 0;
+		}
+	}
+	section[1] = 0xB0 | ((len + 1) >> 8);
+	section[2] = len + 1;
+	if (_mux_section(ctx, ctx->pmtpid, &ctx->pmtcounter, section, len, now) < 0)
+		return -1;
+	ctx->psitime = now;
+	return 0;
+}
+
+/**
+ * the PCR stream is idle, the clock is sent alone
+ */
+static int _mux_pcronly(mux_ctx_t *ctx, uint64_t now)
+{
+	mux_estream_t *estream = &ctx->estreams[0];
+	unsigned char *packet = _mux_packet(ctx, now);
+	if (packet == NULL)
+		return -1;
+	_mux_tsheader(packet, ctx->pcrpid, 0, &estream->counter, 0, TS_PAYLOADSIZE);
+	ts_packet_adaption_t *field = (ts_packet_adaption_t *)(packet + TS_HEADERSIZE);
+	field->decoded.pcr = 1;
+	_mux_pcr(packet + TS_HEADERSIZE + 2, now);
+	ctx->pcrtime = now;
+	_mux_send(ctx);
+	return 0;
+}
+
+static void _mux_gather(unsigned char *dest, size_t size, const struct iovec *iov, size_t offset)
+{
+	while (size > 0)
+	{
+		if (offset >= iov->iov_len)
+		{
+			offset -= iov->iov_len;
+			iov++;
+			continue;
+		}
+		size_t chunk = iov->iov_len - offset;
+		if (chunk > size)
+			chunk = size;
+		memcpy(dest, (unsigned char *)iov->iov_base + offset, chunk);
+		dest += chunk;
+		size -= chunk;
+		offset = 0;
+		iov++;
+	}
+}
+
+/**
+ * One encoder buffer makes one PES packet. The PES header and the
+ * encoder buffer are gathered directly into the TS packets.
+ */
+static int _mux_pes(mux_ctx_t *ctx, mux_estream_t *estream, unsigned char *buffer, size_t len, uint64_t now)
+{
+	unsigned char pes[PES_MAXHEADERSIZE];
+	size_t peslen = PES_HEADERSIZE;
+	if (estream->mime == mime_audioopus)
+	{
+		/// ETSI TS 102 366: opus_control_header before each access unit
+		if (len / 255 + 3 > PES_MAXHEADERSIZE - PES_HEADERSIZE)
+			return -1;
+		pes[peslen++] = 0x7F;
+		pes[peslen++] = 0xE0;
+		size_t ausize = len;
+		while (ausize >= 255)
+		{
+			pes[peslen++] = 0xFF;
+			ausize -= 255;
+		}
+		pes[peslen++] = ausize;
+	}
+	size_t pespacketlength = peslen - 6 + len;
+	if (pespacketlength > UINT16_MAX)
+		pespacketlength = 0;
+	pes[0] = 0x00;
+	pes[1] = 0x00;
+	pes[2] = 0x01;
+	pes[3] = estream->streamid;
+	pes[4] = pespacketlength >> 8;
+	pes[5] = pespacketlength;
+	pes[6] = 0x80;
+	/// PTS only
+	pes[7] = 0x80;
+	pes[8] = 5;
+	_mux_pts(pes + 9, ((now / 300) + TS_PTSDELAY * 90) & 0x1FFFFFFFFull);
+
+	const struct iovec iov[] = {{pes, peslen}, {buffer, len}};
+	size_t total = peslen + len;
+	size_t offset = 0;
+	int start = 1;
+	while (offset < total)
+	{
+		unsigned char *packet = _mux_packet(ctx, now);
+		if (packet == NULL)
+			return -1;
+		int pcr = (start && estream->pid == ctx->pcrpid &&
+				(now - ctx->pcrtime) >= TS_MS(TS_PCRINTERVAL));
+		size_t adaption = 0;
+		if (pcr)
+			adaption = 8;
+		size_t chunk = TS_PAYLOADSIZE - adaption;
+		if (total - offset < chunk)
+		{
+			/// the last packet is stuffed by the adaptation field
+			chunk = total - offset;
+			adaption = TS_PAYLOADSIZE - chunk;
+		}
+		unsigned char *payload = _mux_tsheader(packet, estream->pid, start, &estream->counter, 1, adaption);
+		if (adaption > 1)
+		{
+			ts_packet_adaption_t *field = (ts_packet_adaption_t *)(packet + TS_HEADERSIZE);
+			/// each audio frame is an access point
+			field->decoded.random = start;
+			field->decoded.pcr = pcr;
+		}
+		if (pcr)
+		{
+			_mux_pcr(packet + TS_HEADERSIZE + 2, now);
+			ctx->pcrtime = now;
+		}
+		_mux_gather(payload, chunk, iov, offset);
+		offset += chunk;
+		start = 0;
+		_mux_send(ctx);
+	}
+	return 0;
+}
+
+static int _mux_run(mux_ctx_t *ctx, mux_estream_t *estream)
+{
+	jitter_t *in = estream->in;
+	unsigned char *inbuffer = in->ops->peer(in->ctx, NULL);
+	if (inbuffer == NULL)
+		return 0;
+	size_t len = in->ops->length(in->ctx);
+	/**
+	 * the encoder jitter releases the buffers with its heartbeat,
+	 * the clock at the peer gives the PCR and the PTS.
+	 */
+	int ret = _mux_pes(ctx, estream, inbuffer, len, _mux_clock(ctx));
+	in->ops->pop(in->ctx, len);
+	return (ret == 0);
+}
+
+static void _mux_ready(void *arg, jitter_ctx_t *jitter)
+{
+	mux_ctx_t *ctx = (mux_ctx_t *)arg;
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->nready++;
+	pthread_mutex_unlock(&ctx->mutex);
+	pthread_cond_signal(&ctx->cond);
+}
+
+static void _mux_wait(mux_ctx_t *ctx, unsigned int ms)
+{
+	struct timespec timeout;
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_nsec += ms * 1000000;
+	timeout.tv_sec += timeout.tv_nsec / 1000000000;
+	timeout.tv_nsec %= 1000000000;
+	pthread_mutex_lock(&ctx->mutex);
+	int ret = 0;
+	while (ctx->nready == 0 && ctx->run && ret == 0)
+		ret = pthread_cond_timedwait(&ctx->cond, &ctx->mutex, &timeout);
+	ctx->nready = 0;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static void *mux_thread(void *arg)
+{
+	mux_ctx_t *ctx = (mux_ctx_t *)arg;
+	mux_dbg("mux: mpegts thread start");
+	clock_gettime(CLOCK_MONOTONIC, &ctx->start);
+	/// the first PCR is set on the first packet
+	ctx->pcrtime = -TS_MS(TS_PCRINTERVAL);
+	while (ctx->run)
+	{
+		uint64_t now = _mux_clock(ctx);
+		if (ctx->psichanged || (now - ctx->psitime) >= TS_MS(TS_PSIINTERVAL))
+			_mux_psi(ctx, now);
+		int run = 0;
+		for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
+		{
+			jitter_t *in = ctx->estreams[i].in;
+			if (!in->ops->empty(in->ctx))
+				run += _mux_run(ctx, &ctx->estreams[i]);
+		}
+		now = _mux_clock(ctx);
+		if ((now - ctx->pcrtime) >= TS_MS(TS_PCRINTERVAL))
+			_mux_pcronly(ctx, now);
+		if (ctx->outbuffer != NULL && (now - ctx->outtime) >= TS_MS(TS_MAXDELAY))
+			_mux_flush(ctx);
+		if (run == 0)
+		{
+			/// wake up for the next PCR
+			uint64_t elapsed = (now - ctx->pcrtime) / TS_MS(1);
+			_mux_wait(ctx, (elapsed < TS_PCRINTERVAL)? TS_PCRINTERVAL - elapsed : 1);
+		}
+	}
+	_mux_flush(ctx);
+	mux_dbg("mux: mpegts thread end");
+	return NULL;
+}
+
+static int mux_run(mux_ctx_t *ctx, jitter_t *sink_jitter)
+{
+	ctx->out = sink_jitter;
+	ctx->maxpackets = (sink_jitter->ctx->size - ctx->headerlen) / TS_PACKETSIZE;
+	if (ctx->maxpackets > TS_NPACKETS)
+		ctx->maxpackets = TS_NPACKETS;
+	if (ctx->maxpackets == 0)
+	{
+		err("mux: mpegts sink buffer too small %lu", sink_jitter->ctx->size);
+		return -1;
+	}
+	ctx->run = 1;
+	pthread_create(&ctx->thread, NULL, mux_thread, ctx);
+	return 0;
+}
+
+static unsigned int mux_attach(mux_ctx_t *ctx, encoder_t *encoder)
+{
+	const char *mime = encoder->ops->mime(encoder->ctx);
+	if (ctx->out == NULL)
+		return (unsigned int)-1;
+	int i;
+	for (i = 0; i < MAX_ESTREAM; i++)
+	{
+		if (ctx->estreams[i].mime == NULL)
+			break;
+		if (!strcmp(ctx->estreams[i].mime, mime))
+			return i;
+	}
+	if (i == MAX_ESTREAM)
+		return (unsigned int)-1;
+
+	mux_estream_t *estream = &ctx->estreams[i];
+	unsigned int jitterdepth = MUXJITTER_SIZE;
+	if (mime == mime_audiomp3)
+	{
+		estream->type = 0x03;
+		estream->streamid = 0xC0;
+	}
+	else if (mime == mime_audioaac)
+	{
+		/// ADTS stream
+		estream->type = 0x0F;
+		estream->streamid = 0xC0;
+	}
+	else
+	{
+		/// opus, flac and lpcm are private data
+		if (mime == mime_audioflac)
+			jitterdepth *= 15;
+		estream->type = 0x06;
+		estream->streamid = 0xBD;
+	}
+	estream->mime = mime;
+	jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, jitterdepth, ctx->out->ctx->size);
+	if (jitter == NULL)
+	{
+		estream->mime = NULL;
+		return (unsigned int)-1;
+	}
+	jitter->ctx->frequence = encoder->ops->samplerate(encoder->ctx);
+	jitter->ctx->thredhold = jitterdepth / 2;
+	jitter->format = encoder->ops->format(encoder->ctx);
+	jitter->ctx->ready = _mux_ready;
+	jitter->ctx->observer = ctx;
+	estream->in = jitter;
+	ctx->psichanged = 1;
+	warn("mux: mpegts attach %s to pid %#x type %#x", mime, estream->pid, estream->type);
+	return i;
+}
+
+static const char *mux_mime(mux_ctx_t *ctx, unsigned int index)
+{
+	if (index < MAX_ESTREAM)
+		return ctx->estreams[index].mime;
+	return NULL;
+}
+
+static void mux_destroy(mux_ctx_t *ctx)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->run = 0;
+	pthread_mutex_unlock(&ctx->mutex);
+	pthread_cond_broadcast(&ctx->cond);
+	for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
+		ctx->estreams[i].in->ops->flush(ctx->estreams[i].in->ctx);
+	if (ctx->thread)
+		pthread_join(ctx->thread, NULL);
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->mutex);
+	for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
+		jitter_destroy(ctx->estreams[i].in);
+	free(ctx);
+}
+
+const mux_ops_t *mux_mpegts = &(mux_ops_t)
+{
+	.init = mux_init,
+	.jitter = mux_jitter,
+	.run = mux_run,
+	.attach = mux_attach,
+	.mime = mux_mime,
+	.protocol = "mpegts",
+	.destroy = mux_destroy,
+};
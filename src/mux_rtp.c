@@ -47,10 +47,24 @@ typedef struct mux_estream_s
 	const char *mime;
 	jitter_t *in;
 	unsigned char pt;
+	/// one encoder buffer by RTP packet
+	unsigned char oneframe;
 	void *ext;
 	uint16_t extlen;
 } mux_estream_t;
 #define MAX_ESTREAM 2
+
+#ifdef MUX_RTP_FEC
+typedef struct mux_fec_s mux_fec_t;
+struct mux_fec_s
+{
+	rtpfec_t header;
+	unsigned char *buffer;
+	/// length of the longest payload of the group
+	size_t len;
+};
+#endif
+
 struct mux_ctx_s
 {
 	player_ctx_t *ctx;
@@ -61,11 +75,31 @@ struct mux_ctx_s
 	rtpheader_t header;
 	rtpext_putvctrl_t *putvctrl;
 	pthread_t thread;
+	/// the thread sleeps until one input jitter is ready
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int nready;
+	int run;
 	uint32_t ssrc;
 	uint16_t seqnum;
 	struct timespec timestamp;
 	uint16_t volume;
 	int mode;
+#ifdef MUX_RTP_FEC
+	/// number of packets by row parity
+	unsigned char feccolumns;
+	/// number of rows by column parity, 0 without column
+	unsigned char fecrows;
+	unsigned int fecindex;
+	uint16_t fecseqnum;
+	mux_fec_t fecrow;
+	mux_fec_t *feccolumn;
+#endif
+#ifdef RTP_RTCP
+	uint32_t npackets;
+	uint32_t noctets;
+	time_t rtcptime;
+#endif
 };
 #define MUX_CTX
 #include "mux.h"
@@ -83,7 +117,6 @@ struct mux_ctx_s
 
 #define mux_dbg(...)
 
-#define LATENCE_MS 5
 #define MUXJITTER_SIZE 8
 #define MUX_DOUBLESSRC 0x01
 
@@ -145,6 +178,24 @@ static mux_ctx_t *mux_init(player_ctx_t *player, const char *search)
 		{
 			ctx->mode |= MUX_DOUBLESSRC;
 		}
+#ifdef MUX_RTP_FEC
+		/**
+		 * fec=K: one parity packet every K packets
+		 * fec=KxL: and one parity packet by column of L rows
+		 * against the burst losses.
+		 */
+		string = strstr(search, "fec=");
+		if (string != NULL)
+		{
+			string += 4;
+			sscanf(string, "%hhux%hhu", &ctx->feccolumns, &ctx->fecrows);
+			if (ctx->feccolumns < 2)
+				ctx->feccolumns = 0;
+			if (ctx->feccolumns == 0 || ctx->fecrows < 2)
+				ctx->fecrows = 0;
+			warn("mux: rtp fec %ux%u", ctx->feccolumns, ctx->fecrows);
+		}
+#endif
 	}
 	int i;
 	while (search)
@@ -181,12 +232,17 @@ static mux_ctx_t *mux_init(player_ctx_t *player, const char *search)
 	ctx->header.b.m = 1;
 	ctx->seqnum = random();
 	ctx->header.b.seqnum = __bswap_16(ctx->seqnum);
+#ifdef MUX_RTP_FEC
+	ctx->fecseqnum = random();
+#endif
 	ctx->header.timestamp = random();
 	ctx->ssrc = ssrc;
 	ctx->header.ssrc = __bswap_32(ssrc);
 
 	warn("mux: rtp stream ssrc %#04x", ctx->header.ssrc);
 	ctx->volume = 20;
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->cond, NULL);
 	ctx->putvctrl = calloc(1, sizeof(*ctx->putvctrl));
 	ctx->putvctrl->version = PUTVCTRL_VERSION;
 	ctx->putvctrl->ncmds = 1;
@@ -205,17 +261,140 @@ static jitter_t *mux_jitter(mux_ctx_t *ctx, unsigned int index)
 	return NULL;
 }
 
+#ifdef MUX_RTP_FEC
+static void _mux_fecadd(mux_fec_t *fec, const rtpheader_t *header, const unsigned char *payload, size_t len, uint8_t offset)
+{
+	if (fec->header.na == 0)
+	{
+		memset(&fec->header, 0, sizeof(fec->header));
+		fec->header.snbase = header->b.seqnum;
+		fec->header.offset = offset;
+		fec->len = 0;
+	}
+	size_t i;
+	for (i = 0; i < len; i++)
+		fec->buffer[i] = (i < fec->len)? fec->buffer[i] ^ payload[i]: payload[i];
+	if (len > fec->len)
+		fec->len = len;
+	fec->header.lenrecovery ^= htons(len);
+	fec->header.tsrecovery ^= header->timestamp;
+	fec->header.na++;
+}
+
+static void _mux_fecsend(mux_ctx_t *ctx, mux_fec_t *fec)
+{
+	unsigned char *outbuffer = ctx->out->ops->pull(ctx->out->ctx);
+	if (outbuffer == NULL)
+		return;
+	size_t len = sizeof(ctx->header);
+	memcpy(outbuffer, &ctx->header, len);
+	rtpheader_t *header = (rtpheader_t *)outbuffer;
+	header->b.pt = RTP_PT_FEC;
+	header->b.x = 0;
+	header->b.m = 0;
+	header->b.seqnum = __bswap_16(ctx->fecseqnum);
+	header->ssrc = __bswap_32(RTP_FEC_SSRC(ctx->ssrc));
+	ctx->fecseqnum++;
+	memcpy(outbuffer + len, &fec->header, sizeof(fec->header));
+	len += sizeof(fec->header);
+	memcpy(outbuffer + len, fec->buffer, fec->len);
+	len += fec->len;
+	ctx->out->ops->push(ctx->out->ctx, len, NULL);
+	fec->header.na = 0;
+}
+
+/**
+ * add the packet to its row and its column,
+ * and return the number of parities to send
+ */
+static int _mux_fec(mux_ctx_t *ctx, const unsigned char *packet, size_t len, uint16_t extlen)
+{
+	const rtpheader_t *header = (const rtpheader_t *)packet;
+	size_t hlen = sizeof(*header);
+	if (header->b.x)
+		hlen += extlen;
+	int ret = 0;
+	_mux_fecadd(&ctx->fecrow, header, packet + hlen, len - hlen, 1);
+	if (ctx->fecrow.header.na == ctx->feccolumns)
+		ret++;
+	if (ctx->fecrows > 0)
+	{
+		mux_fec_t *column = &ctx->feccolumn[ctx->fecindex % ctx->feccolumns];
+		_mux_fecadd(column, header, packet + hlen, len - hlen, ctx->feccolumns);
+		if (column->header.na == ctx->fecrows)
+			ret++;
+	}
+	ctx->fecindex++;
+	return ret;
+}
+
+static void _mux_fecflush(mux_ctx_t *ctx)
+{
+	if (ctx->fecrow.header.na == ctx->feccolumns)
+		_mux_fecsend(ctx, &ctx->fecrow);
+	int i;
+	for (i = 0; ctx->fecrows > 0 && i < ctx->feccolumns; i++)
+	{
+		if (ctx->feccolumn[i].header.na == ctx->fecrows)
+			_mux_fecsend(ctx, &ctx->feccolumn[i]);
+	}
+}
+#endif
+
+#ifdef RTP_RTCP
+/**
+ * the sender report gives the relation between the wallclock and
+ * the RTP timestamp to the receivers.
+ */
+static void _mux_rtcp(mux_ctx_t *ctx)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (now.tv_sec < ctx->rtcptime + RTCP_INTERVAL)
+		return;
+	unsigned char *outbuffer = ctx->out->ops->pull(ctx->out->ctx);
+	if (outbuffer == NULL)
+		return;
+	ctx->rtcptime = now.tv_sec;
+	size_t len = sizeof(rtcpheader_t) + sizeof(rtcpsender_t);
+	memset(outbuffer, 0, len);
+	rtcpheader_t *header = (rtcpheader_t *)outbuffer;
+	header->v = 2;
+	header->pt = RTCP_SR;
+	header->length = htons(len / sizeof(uint32_t) - 1);
+	header->ssrc = ctx->header.ssrc;
+	rtcpsender_t *sender = (rtcpsender_t *)(outbuffer + sizeof(*header));
+	sender->ntpsec = htonl(now.tv_sec + RTCP_NTPOFFSET);
+	sender->ntpfrac = htonl((uint32_t)(((uint64_t)now.tv_nsec << 32) / 1000000000));
+	sender->timestamp = htonl(ctx->header.timestamp);
+	sender->packets = htonl(ctx->npackets);
+	sender->octets = htonl(ctx->noctets);
+	ctx->out->ops->push(ctx->out->ctx, len, NULL);
+}
+#endif
+
 static int _mux_run(mux_ctx_t *ctx, mux_estream_t *estream)
 {
 	char *inbuffer;
 	jitter_t *in = estream->in;
 	size_t len = 0;
+	size_t size = ctx->out->ctx->size;
+#ifdef MUX_RTP_FEC
+	/// the parity packet must be sent with the same size
+	if (ctx->feccolumns > 0)
+		size -= sizeof(rtpfec_t);
+#endif
+	inbuffer = in->ops->peer(in->ctx, NULL);
+	if (inbuffer == NULL)
+		return 0;
 	char *outbuffer = ctx->buffer;
 	if (!(ctx->mode & MUX_DOUBLESSRC))
 		outbuffer = ctx->out->ops->pull(ctx->out->ctx);
-	inbuffer = in->ops->peer(in->ctx, NULL);
-	if (inbuffer == NULL)
+	if (outbuffer == NULL)
+	{
+		in->ops->pop(in->ctx, 0);
 		return 0;
+	}
 	mux_dbg("mux: rtp seqnum %d", ctx->header.b.seqnum);
 	ctx->header.b.pt = estream->pt;
 	// copy header
@@ -259,7 +438,7 @@ static int _mux_run(mux_ctx_t *ctx, mux_estream_t *estream)
 		fprintf(stderr, "%.2hhx ", outbuffer[i]);
 	fprintf(stderr, "\n");
 #endif
-	while ((len + in->ops->length(in->ctx)) < ctx->out->ctx->size)
+	while ((len + in->ops->length(in->ctx)) <= size)
 	{
 		size_t inlength = in->ops->length(in->ctx);
 		// copy payload
@@ -267,12 +446,27 @@ static int _mux_run(mux_ctx_t *ctx, mux_estream_t *estream)
 		len += inlength;
 
 		in->ops->pop(in->ctx, inlength);
+		/**
+		 * the packet is sent as soon as the encoder is late,
+		 * the other streams must not wait on this one.
+		 */
+		if (estream->oneframe || in->ops->empty(in->ctx))
+		{
+			inbuffer = NULL;
+			break;
+		}
 		inbuffer = in->ops->peer(in->ctx, NULL);
 		if (inbuffer == NULL)
-			return 0;
+			break;
 	}
-	in->ops->pop(in->ctx, 0);
+	if (inbuffer != NULL)
+		in->ops->pop(in->ctx, 0);
 	mux_dbg("udp: packet %lu sent", len);
+#ifdef MUX_RTP_FEC
+	int nfecs = 0;
+	if (ctx->feccolumns > 0)
+		nfecs = _mux_fec(ctx, (unsigned char *)outbuffer, len, estream->extlen);
+#endif
 	if (ctx->mode & MUX_DOUBLESSRC)
 	{
 		outbuffer = ctx->out->ops->pull(ctx->out->ctx);
@@ -284,6 +478,15 @@ static int _mux_run(mux_ctx_t *ctx, mux_estream_t *estream)
 		memcpy(outbuffer, ctx->buffer, len);
 	}
 	ctx->out->ops->push(ctx->out->ctx, len, &beat);
+#ifdef MUX_RTP_FEC
+	if (nfecs > 0)
+		_mux_fecflush(ctx);
+#endif
+#ifdef RTP_RTCP
+	ctx->npackets++;
+	ctx->noctets += len - sizeof(ctx->header);
+	_mux_rtcp(ctx);
+#endif
 
 	if (ctx->putvctrl)
 	{
@@ -309,10 +512,31 @@ static int _mux_run(mux_ctx_t *ctx, mux_estream_t *estream)
 	return 1;
 }
 
+static void _mux_ready(void *arg, jitter_ctx_t *jitter)
+{
+	mux_ctx_t *ctx = (mux_ctx_t *)arg;
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->nready++;
+	pthread_mutex_unlock(&ctx->mutex);
+	pthread_cond_signal(&ctx->cond);
+}
+
+/**
+ * the counter is reset before the next loop on the streams,
+ * a buffer pushed during the loop wakes up the thread again.
+ */
+static void _mux_wait(mux_ctx_t *ctx)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	while (ctx->nready == 0 && ctx->run)
+		pthread_cond_wait(&ctx->cond, &ctx->mutex);
+	ctx->nready = 0;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
 static void *mux_thread(void *arg)
 {
 	int result = 0;
-	int run = 1;
 	mux_ctx_t *ctx = (mux_ctx_t *)arg;
 	for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
 	{
@@ -322,11 +546,12 @@ static void *mux_thread(void *arg)
 #ifdef RTP_TIMESTAMPS
 	clock_gettime(CLOCK_REALTIME, &ctx->timestamp);
 #endif
-	while (run)
+	while (ctx->run)
 	{
-		run = 0;
+		int run = 0;
 		for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
 		{
+			jitter_t *in = ctx->estreams[i].in;
 #ifdef MUX_HEARTBEAT
 			if (ctx->out->ops->heartbeat(ctx->out->ctx, NULL) == NULL)
 			{
@@ -339,14 +564,11 @@ static void *mux_thread(void *arg)
 				ctx->heartbeat.ops->start(ctx->heartbeat.ctx);
 			}
 #endif
-			run = _mux_run(ctx, &ctx->estreams[i]);
+			if (!in->ops->empty(in->ctx))
+				run += _mux_run(ctx, &ctx->estreams[i]);
 		}
 		if (run == 0)
-		{
-			sched_yield();
-			usleep(LATENCE_MS * 1000);
-			run = 1;
-		}
+			_mux_wait(ctx);
 	}
 	mux_dbg("mux: rtp thread end");
 	return (void *)(intptr_t)result;
@@ -358,6 +580,20 @@ static int mux_run(mux_ctx_t *ctx, jitter_t *sink_jitter)
 	if (ctx->buffer)
 		free(ctx->buffer);
 	ctx->buffer = calloc(1, sink_jitter->ctx->size);
+#ifdef MUX_RTP_FEC
+	if (ctx->feccolumns > 0)
+	{
+		ctx->fecrow.buffer = calloc(1, sink_jitter->ctx->size);
+		if (ctx->fecrows > 0)
+		{
+			ctx->feccolumn = calloc(ctx->feccolumns, sizeof(*ctx->feccolumn));
+			int i;
+			for (i = 0; i < ctx->feccolumns; i++)
+				ctx->feccolumn[i].buffer = calloc(1, sink_jitter->ctx->size);
+		}
+	}
+#endif
+	ctx->run = 1;
 	pthread_create(&ctx->thread, NULL, mux_thread, ctx);
 	return 0;
 }
@@ -379,6 +615,10 @@ static unsigned int mux_attach(mux_ctx_t *ctx, encoder_t * encoder)
 	{
 	//	int size = ctx->out->ctx->size - sizeof(ctx->header) - sizeof(uint32_t);
 		int size = ctx->out->ctx->size - sizeof(ctx->header);
+#ifdef MUX_RTP_FEC
+		if (ctx->feccolumns > 0)
+			size -= sizeof(rtpfec_t);
+#endif
 		unsigned int jitterdepth = MUXJITTER_SIZE;
 		unsigned char pt;
 		if (mime == mime_audiomp3)
@@ -399,6 +639,21 @@ static unsigned int mux_attach(mux_ctx_t *ctx, encoder_t * encoder)
 			jitterdepth *= 15;
 			pt = 46;
 		}
+		else if (mime == mime_audiol16)
+		{
+			pt = RTP_PT_L16;
+			if (encoder->ops->samplerate(encoder->ctx) == 44100)
+				pt = 10;
+		}
+		else if (mime == mime_audiol24)
+		{
+			pt = RTP_PT_L24;
+		}
+		else if (mime == mime_audioopus)
+		{
+			pt = RTP_PT_OPUS;
+			ctx->estreams[i].oneframe = 1;
+		}
 		else
 		{
 			pt = 99;
@@ -407,9 +662,17 @@ static unsigned int mux_attach(mux_ctx_t *ctx, encoder_t * encoder)
 			ctx->estreams[i].pt = pt;
 		ctx->estreams[i].mime = mime;
 		jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, jitterdepth, size);
+		if (jitter == NULL)
+		{
+			free(ctx->estreams[i].ext);
+			memset(&ctx->estreams[i], 0, sizeof(ctx->estreams[i]));
+			return (unsigned int)-1;
+		}
 		jitter->ctx->frequence = encoder->ops->samplerate(encoder->ctx);
 		jitter->ctx->thredhold = jitterdepth / 2;
 		jitter->format = encoder->ops->format(encoder->ctx);
+		jitter->ctx->ready = _mux_ready;
+		jitter->ctx->observer = ctx;
 		ctx->estreams[i].in = jitter;
 		warn("mux: rtp attach %s to pt %d", mime, ctx->estreams[i].pt);
 	}
@@ -426,10 +689,27 @@ static const char *mux_mime(mux_ctx_t *ctx, unsigned int index)
 
 static void mux_destroy(mux_ctx_t *ctx)
 {
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->run = 0;
+	pthread_mutex_unlock(&ctx->mutex);
+	pthread_cond_broadcast(&ctx->cond);
+	for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].in != NULL; i++)
+		ctx->estreams[i].in->ops->flush(ctx->estreams[i].in->ctx);
 	if (ctx->thread)
 		pthread_join(ctx->thread, NULL);
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->mutex);
 	if (ctx->buffer)
 		free(ctx->buffer);
+#ifdef MUX_RTP_FEC
+	free(ctx->fecrow.buffer);
+	if (ctx->feccolumn)
+	{
+		for (int i = 0; i < ctx->feccolumns; i++)
+			free(ctx->feccolumn[i].buffer);
+		free(ctx->feccolumn);
+	}
+#endif
 	for (int i = 0; i < MAX_ESTREAM && ctx->estreams[i].pt != 0; i++)
 	{
 		if (ctx->estreams[i].ext)
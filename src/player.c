@@ -41,6 +41,9 @@
 #include "encoder.h"
 #include "sink.h"
 #include "filter.h"
+#ifdef TRANSCACHE
+#include "transcache.h"
+#endif
 
 #define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
 #define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
@@ -72,6 +75,9 @@ struct player_ctx_s
 
 	jitter_t *outstream[MAX_ESTREAM];
 	int noutstreams;
+	encoder_t *encoder[MAX_ESTREAM];
+	int nencoders;
+	int split;
 
 };
 
@@ -177,6 +183,13 @@ void player_destroy(player_ctx_t *ctx)
 {
 	player_state(ctx, STATE_ERROR);
 	sched_yield();
+#ifdef JITTER_TEE
+	for (int i = 0; i < ctx->noutstreams; i++)
+	{
+		if (jitter_tee_check(ctx->outstream[i]))
+			jitter_destroy(ctx->outstream[i]);
+	}
+#endif
 	pthread_cond_destroy(&ctx->cond);
 	pthread_cond_destroy(&ctx->cond_int);
 	pthread_mutex_destroy(&ctx->mutex);
@@ -274,6 +287,11 @@ static void _player_new_es(player_ctx_t *ctx, void *eventarg)
 {
 	event_new_es_t *event_data = (event_new_es_t *)eventarg;
 	const src_t *src = event_data->src;
+	if (event_data->index >= ctx->noutstreams && event_data->index > 0)
+	{
+		warn("player: no output for the stream %d", event_data->index);
+		return;
+	}
 	warn("player: decoder build");
 	decoder_t *decoder;
 	decoder = decoder_build(ctx, event_data->mime);
@@ -286,7 +304,7 @@ static void _player_new_es(player_ctx_t *ctx, void *eventarg)
 		jitter_t *outstream = NULL;
 		filter_t *filter = NULL;
 		int i;
-		for ( i = 0; i < ctx->noutstreams; i++)
+		for ( i = event_data->index; i < ctx->noutstreams; i++)
 		{
 			outstream = ctx->outstream[i];
 			if (decoder->ops->checkout(decoder->ctx, outstream->format))
@@ -294,6 +312,9 @@ static void _player_new_es(player_ctx_t *ctx, void *eventarg)
 				filter = filter_build(ctx->filtername, outstream, src->info);
 				break;
 			}
+			/// the other sessions are bound to their output
+			if (event_data->index > 0)
+				break;
 		}
 		decoder->filter = filter;
 		if (decoder->ops->prepare)
@@ -306,14 +327,16 @@ static void _player_new_es(player_ctx_t *ctx, void *eventarg)
 static void _player_decode_es(player_ctx_t *ctx, void *eventarg)
 {
 	event_decode_es_t *event_data = (event_decode_es_t *)eventarg;
-	if (event_data->decoder != NULL && ctx->noutstreams < MAX_ESTREAM)
+	if (event_data->decoder != NULL && event_data->index < ctx->noutstreams)
 	{
 		int i;
-		for ( i = 0; i < ctx->noutstreams; i++)
+		for ( i = event_data->index; i < ctx->noutstreams; i++)
 		{
 			jitter_t *outstream = ctx->outstream[i];
 			if (event_data->decoder->ops->run(event_data->decoder->ctx, outstream) == 0)
 				break;
+			if (event_data->index > 0)
+				break;
 		}
 	}
 }
@@ -338,7 +361,15 @@ static int _player_play(void* arg, int id, const char *url, const char *info, co
 	src_t *src = NULL;
 
 	dbg("player: prepare %d %s %s", id, url, mime);
-	src = src_build(ctx, url, mime, id, info);
+#ifdef TRANSCACHE
+	src = transcache_src(ctx, id, info);
+#endif
+#ifdef DECODEAHEAD
+	if (src == NULL && ctx->src != NULL && ctx->noutstreams > 0 && src_decodeahead_check(url))
+		src = src_decodeahead_build(ctx, ctx->filtername, ctx->outstream[0], url, mime, id, info);
+#endif
+	if (src == NULL)
+		src = src_build(ctx, url, mime, id, info);
 	if (src != NULL)
 	{
 		if (ctx->nextsrc != NULL && ctx->nextsrc != src)
@@ -384,18 +415,93 @@ int player_play(player_ctx_t *ctx, int id)
 	return ret;
 }
 
+#ifdef JITTER_TEE
+static const char *jitter_name = "player tee";
+
+/**
+ * the decoder and the filter run once for all the encoders:
+ * the first output becomes a tee and the encoders read its buffers.
+ */
+static int _player_tee(player_ctx_t *ctx, jitter_t *encoder_jitter)
+{
+	jitter_t *outstream = ctx->outstream[0];
+	if (!jitter_tee_check(outstream))
+	{
+		jitter_t *tee = jitter_init(JITTER_TYPE_TEE, jitter_name, outstream->ctx->count, outstream->ctx->size);
+		if (tee == NULL)
+			return -1;
+		tee->format = outstream->format;
+		tee->ctx->frequence = outstream->ctx->frequence;
+		if (jitter_tee_attach(tee, outstream) < 0)
+		{
+			jitter_destroy(tee);
+			return -1;
+		}
+		ctx->outstream[0] = tee;
+	}
+	return jitter_tee_attach(ctx->outstream[0], encoder_jitter);
+}
+#endif
+
 int player_subscribe(player_ctx_t *ctx, encoder_t *encoder)
 {
+	if (ctx->nencoders == MAX_ESTREAM)
+		return -1;
 	if (encoder->ops->type == ES_AUDIO)
 	{
 		jitter_t *encoder_jitter = NULL;
 		encoder_jitter = encoder->ops->jitter(encoder->ctx);
-		ctx->outstream[ctx->noutstreams] = encoder_jitter;
-		ctx->noutstreams++;
+		int shared = 0;
+#ifdef JITTER_TEE
+		/**
+		 * the decoder fills only the first output,
+		 * the other ones have to read it.
+		 */
+		if (!ctx->split && ctx->noutstreams > 0)
+		{
+			if (_player_tee(ctx, encoder_jitter) < 0)
+			{
+				err("player: %s cannot share the stream", encoder->ops->name);
+				return -1;
+			}
+			warn("player: %s shares the stream", encoder->ops->name);
+			shared = 1;
+		}
+#endif
+		if (!shared)
+			ctx->outstream[ctx->noutstreams++] = encoder_jitter;
 	}
+	ctx->encoder[ctx->nencoders++] = encoder;
 	return 0;
 }
 
+void player_split(player_ctx_t *ctx, int split)
+{
+	ctx->split = split;
+}
+
+jitter_t *player_outstream(player_ctx_t *ctx, jitter_t *encoder_jitter)
+{
+	int i;
+	for (i = 0; i < ctx->noutstreams; i++)
+	{
+		if (ctx->outstream[i] == encoder_jitter)
+			return encoder_jitter;
+	}
+#ifdef JITTER_TEE
+	if (ctx->noutstreams > 0 && jitter_tee_check(ctx->outstream[0]))
+		return ctx->outstream[0];
+#endif
+	return NULL;
+}
+
+encoder_t *player_encoder(player_ctx_t *ctx, int index)
+{
+	if (index < 0 || index >= ctx->nencoders)
+		return NULL;
+	return ctx->encoder[index];
+}
+
 static int _player_stateengine(player_ctx_t *ctx, int state, int pause)
 {
 	int i;
@@ -42,6 +42,16 @@ player_ctx_t *player_init();
 int player_change(player_ctx_t *ctx, const char *mediapath, int random, int loop, int now);
 media_t *player_media(player_ctx_t *ctx);
 int player_subscribe(player_ctx_t *userdata, encoder_t *encoder);
+/**
+ * each output of the next subscriptions receives its own stream,
+ * to play several sessions of a source together
+ */
+void player_split(player_ctx_t *ctx, int split);
+encoder_t *player_encoder(player_ctx_t *ctx, int index);
+/**
+ * return the jitter filled by the decoders for the input of an encoder
+ */
+jitter_t *player_outstream(player_ctx_t *ctx, jitter_t *encoder_jitter);
 int player_run(player_ctx_t *userdata);
 void player_destroy(player_ctx_t *ctx);
 int player_waiton(player_ctx_t *ctx, int state);
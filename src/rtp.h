@@ -44,6 +44,42 @@ struct rtpext_pcm_s
 	uint16_t samplerate;
 };
 
+/**
+ * RFC 3551: L16 stereo 44100Hz has the static payload type 10,
+ * the other rates and L24 use dynamic types
+ */
+#define RTP_PT_L16 96
+#define RTP_PT_L24 97
+/**
+ * RFC 7587: opus uses a dynamic type with a 48kHz clock
+ */
+#define RTP_PT_OPUS 98
+/**
+ * RFC 2250: MPEG2 transport stream with the static payload type 33
+ */
+#define RTP_PT_MP2T 33
+
+/**
+ * RFC 5109: the XOR parity of a group of packets of the same ssrc
+ * is sent with a dynamic type. The parity covers the timestamp,
+ * the length and the payload (without extension) of the packets
+ * snbase, snbase + offset, ... snbase + (na - 1) * offset.
+ * The parities are sent on their own ssrc, the ssrc of the stream + 2,
+ * with their own sequence numbers.
+ */
+#define RTP_PT_FEC 100
+#define RTP_FEC_SSRC(ssrc) ((ssrc) + 2)
+typedef struct rtpfec_s rtpfec_t;
+struct rtpfec_s
+{
+	uint16_t snbase;
+	uint8_t offset;
+	uint8_t na;
+	uint16_t lenrecovery;
+	uint16_t reserved;
+	uint32_t tsrecovery;
+};
+
 #define PUTVCTRL_PT 0x76
 #define PUTVCTRL_VERSION 0x01
 #define PUTVCTRL_ID_STATE	0x01
@@ -64,5 +100,65 @@ struct rtpext_putvctrl_s
 	rtpext_putvctrl_cmd_t cmd;
 };
 
+/**
+ * RFC 3550: the sender reports are sent with the RTP packets
+ * and recognized by their type (RFC 5761), the receiver reports are sent
+ * to the port + 1 of the group or to the "rtcp=" address.
+ */
+#define RTCP_SR 200
+#define RTCP_RR 201
+#define RTCP_PT_MIN 192
+#define RTCP_PT_MAX 223
+/// seconds between two reports
+#define RTCP_INTERVAL 5
+/// seconds between 1900 and 1970
+#define RTCP_NTPOFFSET 2208988800UL
+
+typedef struct rtcpheader_s rtcpheader_t;
+struct rtcpheader_s
+{
+	uint8_t rc:5;            // number of report blocks
+	uint8_t p:1;
+	uint8_t v:2;             // version: 2
+	uint8_t pt;
+	uint16_t length;         // number of 32 bits words - 1
+	uint32_t ssrc;
+};
+
+typedef struct rtcpsender_s rtcpsender_t;
+struct rtcpsender_s
+{
+	uint32_t ntpsec;
+	uint32_t ntpfrac;
+	uint32_t timestamp;
+	uint32_t packets;
+	uint32_t octets;
+};
+
+typedef struct rtcpreport_s rtcpreport_t;
+struct rtcpreport_s
+{
+	uint32_t ssrc;
+	/// fraction lost on 8 bits and cumulative number lost on 24 bits
+	uint32_t lost;
+	uint32_t highest;
+	uint32_t jitter;
+	uint32_t lsr;
+	uint32_t dlsr;
+};
+
+/**
+ * profile extension of the receiver report
+ * the timestamps of putv run at 100Hz, too slow for the jitter.
+ */
+typedef struct rtcpext_putv_s rtcpext_putv_t;
+struct rtcpext_putv_s
+{
+	/// delay between the sending and the arrival (clocks synchronized), in ms
+	int32_t delay;
+	/// interarrival jitter in us
+	uint32_t jitter;
+};
+
 extern const char *rtp_service;// _rtp._udp
 #endif
@@ -6,11 +6,39 @@ typedef struct jitter_s jitter_t;
 typedef struct encoder_s encoder_t;
 typedef struct encoder_ops_s encoder_ops_t;
 
+#include <stdint.h>
+#include <time.h>
+
 #include "cmds.h"
 
 #ifndef SINK_CTX
 typedef void sink_ctx_t;
 #endif
+
+/// maximum number of receivers followed by a sink
+#define SINK_MAXRECEIVERS 256
+typedef struct sink_receiver_s sink_receiver_t;
+/**
+ * statistics of a receiver from its RTCP reports
+ */
+struct sink_receiver_s
+{
+	uint32_t ssrc;
+	char address[16];
+	/// fraction lost since the previous report, on 256
+	uint8_t fraction;
+	int32_t lost;
+	uint32_t highest;
+	/// interarrival jitter in us
+	uint32_t jitter;
+	/// round trip time in ms
+	uint32_t rtt;
+	/// delay between the sending and the arrival in ms
+	int32_t delay;
+	/// time of the last report
+	time_t last;
+};
+
 typedef struct sink_ops_s sink_ops_t;
 struct sink_ops_s
 {
@@ -24,6 +52,7 @@ struct sink_ops_s
 	service_cb service;
 	const encoder_ops_t *(*encoder)(sink_ctx_t *);
 	void (*eventlistener)(sink_ctx_t *ctx, event_listener_cb_t listener, void *arg);
+	int (*receivers)(sink_ctx_t *ctx, sink_receiver_t *receivers, int max);
 };
 
 typedef struct sink_s sink_t;
@@ -24,6 +24,7 @@ extern const sink_ops_t *sink_udp;
 extern const sink_ops_t *sink_rtp;
 extern const sink_ops_t *sink_unix;
 extern const sink_ops_t *sink_pulse;
+extern const sink_ops_t *sink_null;
 
 static sink_t _sink = {0};
 sink_t *sink_build(player_ctx_t *player, const char *arg)
@@ -47,6 +48,9 @@ sink_t *sink_build(player_ctx_t *player, const char *arg)
 #endif
 #ifdef HAVE_PULSE
 		sink_pulse,
+#endif
+#ifdef SINK_NULL
+		sink_null,
 #endif
 		NULL
 	};
@@ -36,6 +36,9 @@
 
 #include "player.h"
 #include "encoder.h"
+#ifdef SINK_FILE_URING
+#include "uring.h"
+#endif
 typedef struct sink_s sink_t;
 typedef struct sink_ctx_s sink_ctx_t;
 struct sink_ctx_s
@@ -49,6 +52,9 @@ struct sink_ctx_s
 	char *path;
 	const encoder_ops_t *encoder;
 	int fd;
+#ifdef SINK_FILE_URING
+	uring_t *uring;
+#endif
 };
 #define SINK_CTX
 #include "sink.h"
@@ -64,6 +70,7 @@ struct sink_ctx_s
 #define sink_dbg(...)
 
 #define BUFFERSIZE ENCODER_FRAME_SIZE
+#define URING_DEPTH 8
 
 static const char *jitter_name = "file output";
 
@@ -74,7 +81,15 @@ static int sink_write(sink_ctx_t *ctx, unsigned char *buff, int len)
 	{
 		dbg("sink: reopen file %s", ctx->path);
 		ctx->fd = open(ctx->path, O_RDWR | O_CREAT, 0644);
+#ifdef SINK_FILE_URING
+		ctx->uring = uring_init(ctx->fd, URING_DEPTH, BUFFERSIZE);
+#endif
 	}
+#ifdef SINK_FILE_URING
+	if (ctx->uring != NULL)
+		ret = uring_write(ctx->uring, buff, len);
+	else
+#endif
 	if (ctx->fd != 0)
 		ret = write(ctx->fd, buff, len);
 	sink_dbg("sink: write %d", ret);
@@ -95,6 +110,16 @@ static void _sink_playerstate_cb(void *arg, event_t event, void *data)
 	ctx->state = edata->state;
 	if (ctx->fd != 0 && ctx->state == STATE_STOP)
 	{
+#ifdef SINK_FILE_URING
+		if (ctx->uring != NULL)
+		{
+			/// the short writes are completed before to close
+			if (uring_flush(ctx->uring) < 0)
+				err("sink: file write error %s", strerror(errno));
+			uring_destroy(ctx->uring);
+		}
+		ctx->uring = NULL;
+#endif
 		close(ctx->fd);
 		warn("sink: close %s file", ctx->path);
 		ctx->fd = 0;
@@ -118,6 +143,9 @@ static sink_ctx_t *sink_init(player_ctx_t *player, const char *path)
 		ctx->player = player;
 		ctx->encoder = encoder_check(path);
 		ctx->path = strdup(path);
+#ifdef SINK_FILE_URING
+		ctx->uring = uring_init(fd, URING_DEPTH, BUFFERSIZE);
+#endif
 
 		jitter_t *jitter = jitter_init(JITTER_TYPE_RING, jitter_name, 1, BUFFERSIZE);
 		dbg("sink: add consumer to %s", jitter->ctx->name);
@@ -158,6 +186,14 @@ static const encoder_ops_t *sink_encoder(sink_ctx_t *ctx)
 static void sink_destroy(sink_ctx_t *sink)
 {
 	jitter_destroy(sink->in);
+#ifdef SINK_FILE_URING
+	if (sink->uring != NULL)
+	{
+		if (uring_flush(sink->uring) < 0)
+			err("sink: file write error %s", strerror(errno));
+		uring_destroy(sink->uring);
+	}
+#endif
 	if (sink->fd != 0)
 		close(sink->fd);
 	free(sink->path);
@@ -0,0 +1,321 @@
+/*****************************************************************************
+ * sink_null.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "player.h"
+#include "encoder.h"
+#include "heartbeat.h"
+typedef struct sink_s sink_t;
+typedef struct sink_ctx_s sink_ctx_t;
+typedef struct sink_stats_s sink_stats_t;
+struct sink_stats_s
+{
+	uint64_t start;
+	uint64_t nbytes;
+	uint64_t media;
+	unsigned long nbuffers;
+	unsigned long nlates;
+	int64_t latency;
+	int64_t maxlatency;
+};
+struct sink_ctx_s
+{
+	player_ctx_t *player;
+	jitter_t *in;
+	pthread_t thread;
+
+	const encoder_ops_t *encoder;
+	jitter_format_t format;
+	unsigned int samplerate;
+	/// emulated clock at speed x realtime, 0 to consume as fast as possible
+	unsigned int speed;
+
+	uint64_t start;
+	uint64_t media;
+	uint64_t lastarrival;
+	int64_t lasttransit;
+	int64_t jitter;
+	sink_stats_t period;
+	sink_stats_t total;
+};
+#define SINK_CTX
+#include "sink.h"
+#include "jitter.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+#define sink_dbg(...)
+
+#define BUFFERSIZE ENCODER_FRAME_SIZE
+#define NBBUFFERS 6
+/// the statistics are printed every second
+#define STATS_PERIOD 1000000000ULL
+#define NSEC 1000000000ULL
+
+static const char *jitter_name = "null output";
+
+static uint64_t _sink_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * NSEC + now.tv_nsec;
+}
+
+static void _sink_sleep(uint64_t until)
+{
+	struct timespec ts;
+	ts.tv_sec = until / NSEC;
+	ts.tv_nsec = until % NSEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) > 0);
+}
+
+static sink_ctx_t *sink_init(player_ctx_t *player, const char *url)
+{
+	const char *path = url;
+	if (!strncmp(path, "null://", 7))
+		path += 7;
+
+	sink_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->player = player;
+	/**
+	 * the path selects the encoder like with the file sink:
+	 * null://test.flac, null://audio/opus
+	 */
+	ctx->encoder = encoder_check(path);
+	const char *speed = strstr(path, "speed=");
+	if (speed != NULL)
+		ctx->speed = strtoul(speed + 6, NULL, 10);
+
+	jitter_t *jitter = jitter_init(JITTER_TYPE_SG, jitter_name, NBBUFFERS, BUFFERSIZE);
+	if (jitter == NULL)
+	{
+		free(ctx);
+		return NULL;
+	}
+	jitter->ctx->frequence = 0;
+	jitter->ctx->thredhold = 1;
+	jitter->format = SINK_BITSSTREAM;
+	ctx->in = jitter;
+	ctx->format = jitter->format;
+
+	return ctx;
+}
+
+static unsigned int sink_attach(sink_ctx_t *ctx, encoder_t *encoder)
+{
+	if (encoder->ops->format)
+		ctx->format = encoder->ops->format(encoder->ctx);
+	if (encoder->ops->samplerate)
+		ctx->samplerate = encoder->ops->samplerate(encoder->ctx);
+	ctx->in->format = ctx->format;
+	return 0;
+}
+
+/**
+ * the media duration of the buffer, in ns.
+ * The PCM streams are measured from their length,
+ * the compressed streams from the samples heartbeat of the encoder.
+ */
+static uint64_t _sink_duration(sink_ctx_t *ctx, size_t length, beat_t *beat)
+{
+	unsigned int samplerate = ctx->samplerate;
+	if (samplerate == 0)
+		samplerate = jitter_samplerate(ctx->in);
+	if (samplerate == 0)
+		return 0;
+	if (FORMAT_IS_AUDIO(ctx->format) && !FORMAT_IS_COMPRESSED(ctx->format))
+	{
+		unsigned int framesize = FORMAT_SAMPLESIZE(ctx->format) / 8 * FORMAT_NCHANNELS(ctx->format);
+		if (framesize == 0)
+			return 0;
+		return (uint64_t)length / framesize * NSEC / samplerate;
+	}
+#ifdef HEARTBEAT
+	heartbeat_t *heartbeat = ctx->in->ctx->heartbeat;
+	if (beat != NULL && heartbeat != NULL && heartbeat->ops == heartbeat_samples)
+		return (uint64_t)beat->samples.nsamples * NSEC / samplerate;
+#endif
+	return 0;
+}
+
+static void _sink_stats(sink_ctx_t *ctx, sink_stats_t *stats, const char *name, uint64_t now)
+{
+	uint64_t elapsed = now - stats->start;
+	if (elapsed == 0)
+		return;
+	warn("sink: null %s %llu B/s %.2f x realtime jitter %lld us",
+		name, (unsigned long long)(stats->nbytes * NSEC / elapsed),
+		(double)stats->media / elapsed, (long long)(ctx->jitter / 1000));
+	if (ctx->speed > 0 && stats->nbuffers > 0)
+		warn("sink: null %s latency %lld us max %lld us late %lu/%lu",
+			name, (long long)(stats->latency / (int64_t)stats->nbuffers / 1000),
+			(long long)(stats->maxlatency / 1000), stats->nlates, stats->nbuffers);
+}
+
+static void _sink_account(sink_stats_t *stats, size_t length, uint64_t duration, int64_t latency)
+{
+	stats->nbytes += length;
+	stats->media += duration;
+	stats->nbuffers++;
+	stats->latency += latency;
+	if (latency > stats->maxlatency)
+		stats->maxlatency = latency;
+	if (latency > 0)
+		stats->nlates++;
+}
+
+static void *sink_thread(void *arg)
+{
+	sink_ctx_t *ctx = (sink_ctx_t *)arg;
+
+	dbg("sink: thread run");
+	while (1)
+	{
+		beat_t *beat = NULL;
+		/**
+		 * the beat is requested to consume the buffer without
+		 * waiting the heartbeat of the encoder.
+		 */
+		unsigned char *buff = ctx->in->ops->peer(ctx->in->ctx, (void **)&beat);
+		if (buff == NULL)
+			break;
+		size_t length = ctx->in->ops->length(ctx->in->ctx);
+		uint64_t duration = _sink_duration(ctx, length, beat);
+		uint64_t arrival = _sink_now();
+		if (ctx->start == 0)
+		{
+			ctx->start = arrival;
+			ctx->period.start = arrival;
+			ctx->total.start = arrival;
+			ctx->lastarrival = arrival;
+		}
+
+		/**
+		 * the transit time is the difference between the arrival
+		 * and the media timestamp of the buffer on the emulated clock.
+		 * The jitter is computed like RFC 3550 A.8.
+		 */
+		int64_t transit;
+		unsigned int speed = ctx->speed? ctx->speed: 1;
+		if (duration > 0)
+			transit = arrival - ctx->start - ctx->media / speed;
+		else
+			transit = arrival - ctx->lastarrival;
+		int64_t d = transit - ctx->lasttransit;
+		if (d < 0)
+			d = -d;
+		ctx->jitter += (d - ctx->jitter) / 16;
+		ctx->lasttransit = transit;
+		ctx->lastarrival = arrival;
+
+		int64_t latency = 0;
+		if (ctx->speed > 0 && duration > 0)
+		{
+			/**
+			 * the emulated clock consumes the buffer at its timestamp.
+			 * A positive latency is a late buffer, the device should
+			 * be in underrun.
+			 */
+			uint64_t clock = ctx->start + ctx->media / ctx->speed;
+			latency = arrival - clock;
+			if (latency < 0)
+				_sink_sleep(clock);
+		}
+		ctx->media += duration;
+		_sink_account(&ctx->period, length, duration, latency);
+		_sink_account(&ctx->total, length, duration, latency);
+		ctx->in->ops->pop(ctx->in->ctx, length);
+
+		uint64_t now = _sink_now();
+		if (now - ctx->period.start > STATS_PERIOD)
+		{
+			_sink_stats(ctx, &ctx->period, "period", now);
+			memset(&ctx->period, 0, sizeof(ctx->period));
+			ctx->period.start = now;
+		}
+	}
+	dbg("sink: thread end");
+	return NULL;
+}
+
+static int sink_run(sink_ctx_t *ctx)
+{
+	pthread_create(&ctx->thread, NULL, sink_thread, ctx);
+	return 0;
+}
+
+static jitter_t *sink_jitter(sink_ctx_t *ctx, unsigned int index)
+{
+	if (index == 0)
+		return ctx->in;
+	return NULL;
+}
+
+static const encoder_ops_t *sink_encoder(sink_ctx_t *ctx)
+{
+	return ctx->encoder;
+}
+
+static void sink_destroy(sink_ctx_t *ctx)
+{
+	/**
+	 * the encoder is already destroyed, the end of the stream
+	 * is pushed to stop the thread.
+	 */
+	if (ctx->in->ops->pull(ctx->in->ctx) != NULL)
+		ctx->in->ops->push(ctx->in->ctx, 0, NULL);
+	if (ctx->thread)
+		pthread_join(ctx->thread, NULL);
+	if (ctx->start > 0)
+		_sink_stats(ctx, &ctx->total, "total", _sink_now());
+	jitter_destroy(ctx->in);
+	free(ctx);
+}
+
+const sink_ops_t *sink_null = &(sink_ops_t)
+{
+	.name = "null",
+	.default_ = "null://",
+	.init = sink_init,
+	.jitter = sink_jitter,
+	.attach = sink_attach,
+	.encoder = sink_encoder,
+	.run = sink_run,
+	.destroy = sink_destroy,
+};
@@ -34,6 +34,7 @@
 #include <sys/socket.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <sys/ioctl.h>
@@ -50,13 +51,38 @@
 #include "encoder.h"
 #include "jitter.h"
 #include "unix_server.h"
+
+#ifdef SINK_UDP_GSO
+# ifndef UDP_SEGMENT
+#  define UDP_SEGMENT 103
+# endif
+# ifndef SOL_UDP
+#  define SOL_UDP 17
+# endif
+/// the kernel limits: 64 segments and one IP datagram
+# define UDP_GSO_MAXSEGS 64
+# define UDP_GSO_MAXSIZE 65000
+/// number of packets sent with one system call
+# define UDP_BATCH 16
+#else
+/// number of packets sent with one system call
+# define UDP_BATCH 8
+#endif
+/// number of messages (packets x addresses) by system call
+#define UDP_MAXMSG 64
+
 typedef struct sink_s sink_t;
 typedef struct sink_ctx_s sink_ctx_t;
+typedef struct sink_receiver_s sink_receiver_t;
 typedef struct addr_list_s addr_list_t;
 struct addr_list_s
 {
 	struct sockaddr_storage saddr;
 	socklen_t saddrlen;
+	/// the last error of sending, the address is removed after the batch
+	int error;
+	/// the first packet of the batch not sent on error
+	int failed;
 	addr_list_t *next;
 };
 
@@ -77,6 +103,13 @@ struct sink_ctx_s
 	int counter;
 	int waiting;
 	char *sink_txt[10];
+	/// copies of the packets popped from the jitter and sent together
+	unsigned char *batch;
+	struct iovec batchiov[UDP_BATCH];
+#ifdef SINK_UDP_GSO
+	/// the kernel segments the consecutive packets of same size
+	int gso;
+#endif
 #ifdef MUX
 	mux_t *mux;
 #endif
@@ -84,6 +117,15 @@ struct sink_ctx_s
 #ifdef UDP_DUMP
 	int dumpfd;
 #endif
+#ifdef RTP_RTCP
+	/// the receiver reports arrive on the port + 1
+	int rtcpsock;
+	int rtcprun;
+	pthread_t rtcpthread;
+	pthread_mutex_t rtcpmutex;
+	sink_receiver_t *receivers;
+	int nreceivers;
+#endif
 };
 #define SINK_CTX
 #include "sink.h"
@@ -102,9 +144,154 @@ struct sink_ctx_s
 
 #define SINK_POLICY REALTIME_SCHED
 #define SINK_PRIORITY 65
+#ifdef SINK_UDP_GSO
+/// the segmentation needs several packets ready into the jitter
+#define NBBUFFERS UDP_BATCH
+#else
 #define NBBUFFERS 6
+#endif
 
 static const char *jitter_name = "udp socket";
+
+#ifdef RTP_RTCP
+static void _sink_rtcpinit(sink_ctx_t *ctx, in_addr_t group, int port)
+{
+	ctx->rtcpsock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (ctx->rtcpsock < 0)
+		return;
+	int value = 1;
+	setsockopt(ctx->rtcpsock, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+	struct sockaddr_in saddr;
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin_family = PF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	saddr.sin_port = htons(port);
+	if (bind(ctx->rtcpsock, (struct sockaddr *)&saddr, sizeof(saddr)) < 0)
+	{
+		warn("sink: rtcp bind error %s", strerror(errno));
+		close(ctx->rtcpsock);
+		ctx->rtcpsock = -1;
+		return;
+	}
+	if (IN_MULTICAST(ntohl(group)))
+	{
+		struct ip_mreq imreq;
+		memset(&imreq, 0, sizeof(imreq));
+		imreq.imr_multiaddr.s_addr = group;
+		imreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(ctx->rtcpsock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &imreq, sizeof(imreq)) < 0)
+			warn("sink: rtcp multicast error %s", strerror(errno));
+	}
+	ctx->receivers = calloc(SINK_MAXRECEIVERS, sizeof(*ctx->receivers));
+	pthread_mutex_init(&ctx->rtcpmutex, NULL);
+}
+
+static void _sink_receiver(sink_ctx_t *ctx, uint32_t ssrc, const rtcpreport_t *report,
+			const rtcpext_putv_t *ext, struct sockaddr_in *from, uint32_t ntp, time_t now)
+{
+	pthread_mutex_lock(&ctx->rtcpmutex);
+	sink_receiver_t *receiver = NULL;
+	sink_receiver_t *oldest = &ctx->receivers[0];
+	int i;
+	for (i = 0; i < ctx->nreceivers; i++)
+	{
+		if (ctx->receivers[i].ssrc == ssrc)
+			receiver = &ctx->receivers[i];
+		if (ctx->receivers[i].last < oldest->last)
+			oldest = &ctx->receivers[i];
+	}
+	if (receiver == NULL && ctx->nreceivers < SINK_MAXRECEIVERS)
+		receiver = &ctx->receivers[ctx->nreceivers++];
+	else if (receiver == NULL)
+		receiver = oldest;
+	if (receiver->ssrc != ssrc)
+		memset(receiver, 0, sizeof(*receiver));
+	receiver->ssrc = ssrc;
+	inet_ntop(AF_INET, &from->sin_addr, receiver->address, sizeof(receiver->address));
+	uint32_t lost = ntohl(report->lost);
+	receiver->fraction = lost >> 24;
+	receiver->lost = ((int32_t)(lost << 8)) >> 8;
+	receiver->highest = ntohl(report->highest);
+	/// the timestamp runs at 100Hz
+	receiver->jitter = ntohl(report->jitter) * (RTP_HEARTBEAT_TIMELAPS / 1000);
+	uint32_t lsr = ntohl(report->lsr);
+	if (lsr != 0)
+		receiver->rtt = ((uint64_t)(uint32_t)(ntp - lsr - ntohl(report->dlsr)) * 1000) >> 16;
+	if (ext != NULL)
+	{
+		receiver->delay = (int32_t)ntohl(ext->delay);
+		receiver->jitter = ntohl(ext->jitter);
+	}
+	receiver->last = now;
+	pthread_mutex_unlock(&ctx->rtcpmutex);
+	sink_dbg("sink: rtcp receiver %#x lost %d rtt %u", ssrc, receiver->lost, receiver->rtt);
+}
+
+static void _sink_rtcp(sink_ctx_t *ctx, const unsigned char *input, size_t len, struct sockaddr_in *from)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	/// middle 32 bits of the NTP timestamp
+	uint32_t ntp = ((uint32_t)(now.tv_sec + RTCP_NTPOFFSET) << 16) |
+			(uint32_t)((((uint64_t)now.tv_nsec << 32) / 1000000000) >> 16);
+	while (len >= sizeof(rtcpheader_t))
+	{
+		const rtcpheader_t *header = (const rtcpheader_t *)input;
+		size_t length = (ntohs(header->length) + 1) * sizeof(uint32_t);
+		if (length > len)
+			break;
+		const unsigned char *block = (const unsigned char *)(header + 1);
+		if (header->pt == RTCP_SR)
+			block += sizeof(rtcpsender_t);
+		size_t blocklen = (input + length > block)? input + length - block: 0;
+		if ((header->pt == RTCP_RR || header->pt == RTCP_SR) && header->rc > 0 &&
+			blocklen >= sizeof(rtcpreport_t))
+		{
+			const rtcpext_putv_t *ext = NULL;
+			if (blocklen >= header->rc * sizeof(rtcpreport_t) + sizeof(*ext))
+				ext = (const rtcpext_putv_t *)(block + header->rc * sizeof(rtcpreport_t));
+			_sink_receiver(ctx, ntohl(header->ssrc), (const rtcpreport_t *)block, ext, from, ntp, now.tv_sec);
+		}
+		input += length;
+		len -= length;
+	}
+}
+
+static void *_sink_rtcpthread(void *arg)
+{
+	sink_ctx_t *ctx = (sink_ctx_t *)arg;
+	unsigned char buffer[1500];
+	while (ctx->rtcprun)
+	{
+		struct pollfd pfd = {.fd = ctx->rtcpsock, .events = POLLIN};
+		if (poll(&pfd, 1, 500) <= 0)
+			continue;
+		struct sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		ssize_t len = recvfrom(ctx->rtcpsock, buffer, sizeof(buffer), MSG_DONTWAIT,
+				(struct sockaddr *)&from, &fromlen);
+		if (len > 0)
+			_sink_rtcp(ctx, buffer, len, &from);
+	}
+	return NULL;
+}
+
+static int sink_receivers(sink_ctx_t *ctx, sink_receiver_t *receivers, int max)
+{
+	if (ctx->receivers == NULL)
+		return 0;
+	pthread_mutex_lock(&ctx->rtcpmutex);
+	int n = ctx->nreceivers;
+	if (n > max)
+		n = max;
+	memcpy(receivers, ctx->receivers, n * sizeof(*receivers));
+	pthread_mutex_unlock(&ctx->rtcpmutex);
+	return n;
+}
+#else
+#define sink_receivers NULL
+#endif
+
 static sink_ctx_t *sink_init(player_ctx_t *player, const char *url)
 {
 	int ret = 0;
@@ -307,9 +494,31 @@ static sink_ctx_t *sink_init(player_ctx_t *player, const char *url)
 		jitter->ctx->thredhold = NBBUFFERS / 2;
 		jitter->format = format;
 		ctx->in = jitter;
+		ctx->batch = malloc(UDP_BATCH * size);
+		for (i = 0; i < UDP_BATCH; i++)
+			ctx->batchiov[i].iov_base = ctx->batch + i * size;
+#ifdef SINK_UDP_GSO
+		/**
+		 * the kernel accepts the option since linux 4.18,
+		 * the segment size is set on each message.
+		 */
+		int segment = size;
+		if (setsockopt(sock, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0)
+		{
+			segment = 0;
+			setsockopt(sock, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment));
+			ctx->gso = 1;
+			warn("sink: udp segmentation offload");
+		}
+		else
+			warn("sink: udp segmentation offload not supported: %s", strerror(errno));
+#endif
 #ifdef MUX
 		ctx->mux = mux_build(player, protocol, search);
 #endif
+#ifdef RTP_RTCP
+		_sink_rtcpinit(ctx, saddr.sin_addr.s_addr, iport + 1);
+#endif
 #ifdef UDP_DUMP
 		ctx->dumpfd = open("udp_dump.stream", O_RDWR | O_CREAT, 0644);
 #endif
@@ -349,6 +558,157 @@ static const encoder_ops_t *sink_encoder(sink_ctx_t *ctx)
 	return ctx->encoder;
 }
 
+/**
+ * send the messages with the less system calls.
+ * On error, the first message not sent belongs to a dead address,
+ * the next messages of this address are skipped.
+ */
+static void _sink_sendmmsg(sink_ctx_t *ctx, struct mmsghdr *msgs, addr_list_t **dests, int nmsgs)
+{
+	int offset = 0;
+	while (offset < nmsgs)
+	{
+		int ret = sendmmsg(ctx->sock, msgs + offset, nmsgs - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+		sink_dbg("udp: send %d/%d", ret, nmsgs - offset);
+		if (ret > 0)
+		{
+			offset += ret;
+			continue;
+		}
+		if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			struct pollfd pfd = { .fd = ctx->sock, .events = POLLOUT};
+			poll(&pfd, 1, -1);
+			continue;
+		}
+		addr_list_t *dead = dests[offset];
+		dead->error = (ret < 0)? errno: EIO;
+		dead->failed = msgs[offset].msg_hdr.msg_iov - ctx->batchiov;
+		while (offset < nmsgs && dests[offset] == dead)
+			offset++;
+	}
+}
+
+#ifdef SINK_UDP_GSO
+/**
+ * join the consecutive packets of the same size into one message.
+ * The last packet may be shorter, it ends the message.
+ * Returns the number of packets into the message.
+ */
+static int _sink_gso(sink_ctx_t *ctx, struct msghdr *hdr, char *control, int first, int npackets)
+{
+	size_t segsize = ctx->batchiov[first].iov_len;
+	size_t total = segsize;
+	int n = 1;
+	while ((first + n) < npackets && n < UDP_GSO_MAXSEGS)
+	{
+		size_t len = ctx->batchiov[first + n].iov_len;
+		if (len > segsize || (total + len) > UDP_GSO_MAXSIZE)
+			break;
+		total += len;
+		n++;
+		if (len < segsize)
+			break;
+	}
+	if (n > 1)
+	{
+		hdr->msg_control = control;
+		hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*(uint16_t *)CMSG_DATA(cmsg) = segsize;
+	}
+	return n;
+}
+#endif
+
+/**
+ * each packet is sent to each address with the error "resend".
+ * The messages are sorted by address to skip a dead one.
+ * On resend, the packets before the failed message are already sent.
+ */
+static void _sink_sendbatch(sink_ctx_t *ctx, int npackets, int resend)
+{
+	struct mmsghdr msgs[UDP_MAXMSG];
+	addr_list_t *dests[UDP_MAXMSG];
+#ifdef SINK_UDP_GSO
+	char control[UDP_MAXMSG][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+	int nmsgs = 0;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (addr_list_t *it = ctx->addr; it != NULL; it = it->next)
+	{
+		if (it->error != resend)
+			continue;
+		it->error = 0;
+		int i = 0;
+		if (resend)
+			i = it->failed;
+		while (i < npackets)
+		{
+			struct msghdr *hdr = &msgs[nmsgs].msg_hdr;
+			hdr->msg_name = &it->saddr;
+			hdr->msg_namelen = it->saddrlen;
+			hdr->msg_iov = &ctx->batchiov[i];
+			hdr->msg_iovlen = 1;
+#ifdef SINK_UDP_GSO
+			if (ctx->gso)
+				hdr->msg_iovlen = _sink_gso(ctx, hdr, control[nmsgs], i, npackets);
+#endif
+			i += hdr->msg_iovlen;
+			dests[nmsgs] = it;
+			nmsgs++;
+			if (nmsgs == UDP_MAXMSG)
+			{
+				_sink_sendmmsg(ctx, msgs, dests, nmsgs);
+				memset(msgs, 0, sizeof(msgs));
+				nmsgs = 0;
+			}
+		}
+	}
+	if (nmsgs > 0)
+		_sink_sendmmsg(ctx, msgs, dests, nmsgs);
+}
+
+static void _sink_send(sink_ctx_t *ctx, int npackets)
+{
+	_sink_sendbatch(ctx, npackets, 0);
+#ifdef SINK_UDP_GSO
+	/**
+	 * the device without checksum offload refuses the segmentation,
+	 * the packets are sent again one by one.
+	 */
+	int gsoerror = 0;
+	for (addr_list_t *it = ctx->addr; it != NULL; it = it->next)
+		gsoerror |= (it->error == EIO);
+	if (ctx->gso && gsoerror)
+	{
+		warn("sink: udp segmentation offload refused, fallback");
+		ctx->gso = 0;
+		_sink_sendbatch(ctx, npackets, EIO);
+	}
+#endif
+
+	addr_list_t *it = ctx->addr;
+	while (it != NULL)
+	{
+		addr_list_t *next = it->next;
+		if (it->error != 0)
+		{
+			unsigned long longaddress = ((struct sockaddr_in*)&(it->saddr))->sin_addr.s_addr;
+			if (IN_MULTICAST(longaddress))
+				err("sink: udp multicast not routed");
+			else
+				err("sink: udp send error %s", strerror(it->error));
+			sinkudp_unregister(ctx, (struct sockaddr_in*)&(it->saddr));
+		}
+		it = next;
+	}
+}
+
 static void *sink_thread(void *arg)
 {
 	sink_ctx_t *ctx = (sink_ctx_t *)arg;
@@ -377,59 +737,49 @@ static void *sink_thread(void *arg)
 #endif
 	while (run)
 	{
-		unsigned char *buff = ctx->in->ops->peer(ctx->in->ctx, NULL);
-		if (buff == NULL)
+		int npackets = 0;
+		/**
+		 * the packets already ready into the jitter are sent together.
+		 * Only the first one waits the heartbeat.
+		 */
+		do
 		{
-			run = 0;
-			break;
-		}
+			unsigned char *buff = ctx->in->ops->peer(ctx->in->ctx, NULL);
+			if (buff == NULL)
+			{
+				run = 0;
+				break;
+			}
 
-		/// udp send block (MTU sizing) after block
-		//size_t length = ctx->in->ctx->size;
-		size_t length = ctx->in->ops->length(ctx->in->ctx);
+			/// udp send block (MTU sizing) after block
+			size_t length = ctx->in->ops->length(ctx->in->ctx);
 
 #ifdef UDP_MARKER
-		static unsigned long marker = 0;
-		ret = sendto(ctx->sock, (char *)&marker, sizeof(marker), MSG_NOSIGNAL| MSG_DONTWAIT,
-				(struct sockaddr *)&ctx->saddr, sizeof(ctx->saddr));
-		dbg("send %lx", marker);
-		marker++;
-#endif
-		ret = 0;
-		int maxfd = ctx->sock;
-		fd_set wfds;
-		FD_ZERO(&wfds);
-		FD_SET(ctx->sock, &wfds);
-		ret = select(maxfd + 1, NULL, &wfds, NULL, NULL);
-		if (ret > 0 && FD_ISSET(ctx->sock, &wfds))
-		{
-			for (addr_list_t *it = ctx->addr; it != NULL; it = it->next)
-			{
-				ret = sendto(ctx->sock, buff, length, MSG_NOSIGNAL| MSG_DONTWAIT,
-						(struct sockaddr *)&it->saddr, it->saddrlen);
-				sink_dbg("udp: send %d", ret);
-				if (ret < 0)
-				{
-					if (errno == EAGAIN)
-						continue;
-					unsigned long longaddress = ((struct sockaddr_in*)&(it->saddr))->sin_addr.s_addr;
-					if (IN_MULTICAST(longaddress))
-						err("sink: udp multicast not routed");
-					else
-						err("sink: udp send %lu error %s", length, strerror(errno));
-					sinkudp_unregister(ctx, (struct sockaddr_in*)&(it->saddr));
-				}
-			}
-#ifdef UDP_STATISTIC
-			statistic += length;
+			static unsigned long marker = 0;
+			ret = sendto(ctx->sock, (char *)&marker, sizeof(marker), MSG_NOSIGNAL| MSG_DONTWAIT,
+					(struct sockaddr *)&ctx->saddr, sizeof(ctx->saddr));
+			dbg("send %lx", marker);
+			marker++;
 #endif
-			if (ctx->waiting > 0)
-				usleep(ctx->waiting);
-		}
+			memcpy(ctx->batchiov[npackets].iov_base, buff, length);
+			ctx->batchiov[npackets].iov_len = length;
+			npackets++;
 #ifdef UDP_DUMP
-		write(ctx->dumpfd, buff, ret);
+			write(ctx->dumpfd, buff, length);
+#endif
+#ifdef UDP_STATISTIC
+			statistic += length;
 #endif
-		ctx->counter++;
+			ctx->in->ops->pop(ctx->in->ctx, length);
+		} while (npackets < UDP_BATCH && ctx->waiting == 0 &&
+				!ctx->in->ops->empty(ctx->in->ctx));
+
+		if (npackets == 0)
+			continue;
+		_sink_send(ctx, npackets);
+		if (ctx->waiting > 0)
+			usleep(ctx->waiting);
+		ctx->counter += npackets;
 
 #ifdef DEBUG
 		struct timespec now;
@@ -450,7 +800,6 @@ static void *sink_thread(void *arg)
 		}
 #endif
 #endif
-		ctx->in->ops->pop(ctx->in->ctx, length);
 	}
 	sched_yield();
 	dbg("sink: thread end");
@@ -497,6 +846,13 @@ static int sink_run(sink_ctx_t *ctx)
 #ifdef MUX
 	ctx->mux->ops->run(ctx->mux->ctx, ctx->in);
 #endif
+#ifdef RTP_RTCP
+	if (ctx->rtcpsock >= 0)
+	{
+		ctx->rtcprun = 1;
+		pthread_create(&ctx->rtcpthread, NULL, _sink_rtcpthread, ctx);
+	}
+#endif
 
 	return 0;
 }
@@ -516,7 +872,20 @@ static void sink_destroy(sink_ctx_t *ctx)
 {
 	if (ctx->thread)
 		pthread_join(ctx->thread, NULL);
+#ifdef RTP_RTCP
+	ctx->rtcprun = 0;
+	if (ctx->rtcpthread)
+		pthread_join(ctx->rtcpthread, NULL);
+	if (ctx->rtcpsock >= 0)
+		close(ctx->rtcpsock);
+	if (ctx->receivers)
+	{
+		pthread_mutex_destroy(&ctx->rtcpmutex);
+		free(ctx->receivers);
+	}
+#endif
 	jitter_destroy(ctx->in);
+	free(ctx->batch);
 	int i = 0;
 	while (ctx->sink_txt[i] != NULL)
 		free(ctx->sink_txt[i++]);
@@ -564,6 +933,7 @@ const sink_ops_t *sink_udp = &(sink_ops_t)
 	.encoder = sink_encoder,
 	.run = sink_run,
 	.service = sink_service,
+	.receivers = sink_receivers,
 	.destroy = sink_destroy,
 };
 
@@ -577,5 +947,6 @@ const sink_ops_t *sink_rtp = &(sink_ops_t)
 	.encoder = sink_encoder,
 	.run = sink_run,
 	.service = sink_service,
+	.receivers = sink_receivers,
 	.destroy = sink_destroy,
 };
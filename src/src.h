@@ -54,4 +54,12 @@ extern const src_ops_t *src_curl;
 extern const src_ops_t *src_unix;
 extern const src_ops_t *src_alsa;
 extern const src_ops_t *src_udp;
+
+/**
+ * decode ahead: the stream is decoded into a RAM cache before the playback
+ */
+int src_decodeahead_check(const char *url);
+src_t *src_decodeahead_build(player_ctx_t *player, const char *filtername,
+		jitter_t *out, const char *url, const char *mime, int id, const char *info);
+extern const src_ops_t *src_decodeahead;
 #endif
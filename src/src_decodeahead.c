@@ -0,0 +1,342 @@
+/*****************************************************************************
+ * src_decodeahead.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "player.h"
+#include "event.h"
+#include "decoder.h"
+#include "filter.h"
+typedef struct src_ops_s src_ops_t;
+typedef struct src_ctx_s src_ctx_t;
+struct src_ctx_s
+{
+	const src_ops_t *ops;
+	player_ctx_t *player;
+	/**
+	 * the player of the decoder running ahead.
+	 * Its state changes at the end of the decoding.
+	 */
+	player_ctx_t *ahead;
+	const char *filtername;
+	src_t *src;
+	decoder_t *decoder;
+	jitter_t *cache;
+	decoder_t *estream;
+	event_listener_t *listener;
+	long pid;
+	pthread_t thread;
+	int run;
+};
+#define SRC_CTX
+#include "src.h"
+#include "media.h"
+#include "jitter.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define src_dbg(...)
+
+#ifndef DECODEAHEAD_SIZE
+#define DECODEAHEAD_SIZE (32 * 1024 * 1024)
+#endif
+/// polling of the cache when the decoder is slower than the output
+#define DECODEAHEAD_WAIT_MS 10
+
+static const char *jitter_name = "decode ahead";
+
+static void _src_listener(void *arg, event_t event, void *eventarg)
+{
+	src_ctx_t *ctx = (src_ctx_t *)arg;
+	switch (event)
+	{
+	case SRC_EVENT_NEW_ES:
+	{
+		event_new_es_t *event_data = (event_new_es_t *)eventarg;
+		const src_t *src = event_data->src;
+		decoder_t *decoder = decoder_build(ctx->ahead, event_data->mime);
+		if (decoder == NULL)
+		{
+			err("decode ahead: decoder not found for %s", event_data->mime);
+			break;
+		}
+		event_data->decoder = decoder;
+		src->ops->attach(src->ctx, event_data->pid, decoder);
+		decoder->filter = filter_build(ctx->filtername, ctx->cache, src->info);
+		if (decoder->ops->prepare)
+			decoder->ops->prepare(decoder->ctx, decoder->filter, src->info);
+		ctx->decoder = decoder;
+	}
+	break;
+	case SRC_EVENT_DECODE_ES:
+	{
+		event_decode_es_t *event_data = (event_decode_es_t *)eventarg;
+		if (event_data->decoder != NULL)
+			event_data->decoder->ops->run(event_data->decoder->ctx, ctx->cache);
+	}
+	break;
+	default:
+	break;
+	}
+}
+
+static void *_src_thread(void *arg)
+{
+	src_ctx_t *ctx = (src_ctx_t *)arg;
+	jitter_t *out = ctx->estream->ops->jitter(ctx->estream->ctx, JITTE_LOW);
+	if (out == NULL)
+		return NULL;
+	/**
+	 * the previous decoder may leave a buffer in progress
+	 */
+	filter_flushoutput(out);
+	int complete = 0;
+	while (ctx->run)
+	{
+		if (ctx->cache->ops->empty(ctx->cache->ctx))
+		{
+			if (player_state(ctx->ahead, STATE_UNKNOWN) != STATE_CHANGE)
+			{
+				/**
+				 * the decoder is late: the network stalls
+				 */
+				usleep(DECODEAHEAD_WAIT_MS * 1000);
+				continue;
+			}
+			if (complete)
+				break;
+			filter_flushoutput(ctx->cache);
+			complete = 1;
+			continue;
+		}
+		unsigned char *data = ctx->cache->ops->peer(ctx->cache->ctx, NULL);
+		if (data == NULL)
+			break;
+		size_t length = ctx->cache->ops->length(ctx->cache->ctx);
+		if (length > out->ctx->size)
+			length = out->ctx->size;
+		unsigned char *buffer = out->ops->pull(out->ctx);
+		if (buffer == NULL)
+		{
+			ctx->cache->ops->pop(ctx->cache->ctx, length);
+			break;
+		}
+		memcpy(buffer, data, length);
+		out->ops->push(out->ctx, length, NULL);
+		ctx->cache->ops->pop(ctx->cache->ctx, length);
+	}
+	dbg("decode ahead: end of stream");
+	if (ctx->run)
+		player_state(ctx->player, STATE_CHANGE);
+	return NULL;
+}
+
+int src_decodeahead_check(const char *url)
+{
+	/**
+	 * only the network sources are decoded ahead
+	 */
+	if (strstr(url, "://") == NULL)
+		return 0;
+	if (!strncmp(url, "file://", 7))
+		return 0;
+	return 1;
+}
+
+src_t *src_decodeahead_build(player_ctx_t *player, const char *filtername,
+		jitter_t *out, const char *url, const char *mime, int id, const char *info)
+{
+	src_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->ops = src_decodeahead;
+	ctx->player = player;
+	ctx->filtername = filtername;
+
+	int count = DECODEAHEAD_SIZE / out->ctx->size;
+	if (count > 0)
+		ctx->cache = jitter_init(JITTER_TYPE_SG, jitter_name, count, out->ctx->size);
+	if (ctx->cache == NULL)
+	{
+		free(ctx);
+		return NULL;
+	}
+	ctx->cache->format = out->format;
+	ctx->cache->ctx->frequence = out->ctx->frequence;
+	ctx->cache->ctx->thredhold = 0;
+
+	ctx->ahead = player_init(filtername);
+	ctx->src = src_build(ctx->ahead, url, mime, id, info);
+	if (ctx->src == NULL || ctx->src->ops->eventlistener == NULL)
+	{
+		if (ctx->src)
+			src_destroy(ctx->src);
+		player_destroy(ctx->ahead);
+		jitter_destroy(ctx->cache);
+		free(ctx);
+		return NULL;
+	}
+	/**
+	 * the decoding starts now, on the thread of the decoder
+	 */
+	ctx->src->ops->eventlistener(ctx->src->ctx, _src_listener, ctx);
+	if (ctx->src->ops->prepare != NULL)
+		ctx->src->ops->prepare(ctx->src->ctx, info);
+	ctx->src->ops->run(ctx->src->ctx);
+	warn("decode ahead: %s into %zu kB", url, count * out->ctx->size / 1024);
+
+	src_t *src = calloc(1, sizeof(*src));
+	src->ops = src_decodeahead;
+	src->ctx = ctx;
+	src->mediaid = id;
+	if (info)
+		src->info = strdup(info);
+	return src;
+}
+
+static int _src_prepare(src_ctx_t *ctx, const char *info)
+{
+	const src_t src = { .ops = src_decodeahead, .ctx = ctx, .info = (char *)info, .mediaid = ctx->src->mediaid};
+	event_new_es_t event = {.pid = ctx->pid, .src = &src, .mime = mime_audiopcm, .jitte = JITTE_LOW};
+	event_listener_t *listener = ctx->listener;
+	while (listener)
+	{
+		listener->cb(listener->arg, SRC_EVENT_NEW_ES, (void *)&event);
+		listener = listener->next;
+	}
+	return 0;
+}
+
+static int _src_run(src_ctx_t *ctx)
+{
+	const src_t src = { .ops = src_decodeahead, .ctx = ctx};
+	event_decode_es_t event = {.pid = ctx->pid, .src = &src, .decoder = ctx->estream};
+	event_listener_t *listener = ctx->listener;
+	while (listener)
+	{
+		listener->cb(listener->arg, SRC_EVENT_DECODE_ES, (void *)&event);
+		listener = listener->next;
+	}
+	if (ctx->estream == NULL)
+		return -1;
+	ctx->run = 1;
+	pthread_create(&ctx->thread, NULL, _src_thread, ctx);
+	return 0;
+}
+
+static void _src_eventlistener(src_ctx_t *ctx, event_listener_cb_t cb, void *arg)
+{
+	event_listener_t *listener = calloc(1, sizeof(*listener));
+	listener->cb = cb;
+	listener->arg = arg;
+	if (ctx->listener == NULL)
+		ctx->listener = listener;
+	else
+	{
+		event_listener_t *previous = ctx->listener;
+		while (previous->next != NULL) previous = previous->next;
+		previous->next = listener;
+	}
+}
+
+static int _src_attach(src_ctx_t *ctx, long index, decoder_t *decoder)
+{
+	if (index > 0)
+		return -1;
+	ctx->estream = decoder;
+	ctx->pid = index;
+	return 0;
+}
+
+static decoder_t *_src_estream(src_ctx_t *ctx, long index)
+{
+	/**
+	 * the position and the duration come from the real decoder
+	 */
+	if (ctx->decoder != NULL && ctx->decoder->ops->position != NULL)
+		return ctx->decoder;
+	return ctx->estream;
+}
+
+static const char *_src_mime(src_ctx_t *ctx, int index)
+{
+	if (index > 0)
+		return NULL;
+	return mime_audiopcm;
+}
+
+static void _src_destroy(src_ctx_t *ctx)
+{
+	ctx->run = 0;
+	/**
+	 * the decoder is stopped by the flush of the cache
+	 */
+	ctx->cache->ops->flush(ctx->cache->ctx);
+	src_destroy(ctx->src);
+	if (ctx->thread)
+		pthread_join(ctx->thread, NULL);
+	if (ctx->estream != NULL)
+		ctx->estream->ops->destroy(ctx->estream->ctx);
+	event_listener_t *listener = ctx->listener;
+	while (listener)
+	{
+		event_listener_t *next = listener->next;
+		free(listener);
+		listener = next;
+	}
+	filter_flushoutput(ctx->cache);
+	jitter_destroy(ctx->cache);
+	player_destroy(ctx->ahead);
+	free(ctx);
+}
+
+static const char *_src_medium()
+{
+	return mime_audiopcm;
+}
+
+const src_ops_t *src_decodeahead = &(src_ops_t)
+{
+	.name = "decodeahead",
+	.protocol = "",
+	.medium = _src_medium,
+	.prepare = _src_prepare,
+	.run = _src_run,
+	.eventlistener = _src_eventlistener,
+	.attach = _src_attach,
+	.estream = _src_estream,
+	.destroy = _src_destroy,
+	.mime = _src_mime,
+};
@@ -33,6 +33,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#ifdef SRC_FILE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include <pwd.h>
 
@@ -40,6 +43,9 @@
 #include "event.h"
 #include "decoder.h"
 #include "demux.h"
+#ifdef SRC_FILE_URING
+#include "uring.h"
+#endif
 typedef struct src_ops_s src_ops_t;
 typedef struct src_ctx_s src_ctx_t;
 struct src_ctx_s
@@ -55,6 +61,13 @@ struct src_ctx_s
 	decoder_t *estream;
 	event_listener_t *listener;
 	long pid;
+#ifdef SRC_FILE_MMAP
+	unsigned char *map;
+	size_t maplength;
+#endif
+#ifdef SRC_FILE_URING
+	uring_t *uring;
+#endif
 };
 #define SRC_CTX
 #include "src.h"
@@ -71,9 +84,11 @@ struct src_ctx_s
 
 #define src_dbg(...)
 
+#define URING_DEPTH 4
+
 static int _src_attach(src_ctx_t *ctx, long index, decoder_t *decoder);
 
-static int _src_read(src_ctx_t *ctx, unsigned char *buff, int len)
+static int _src_waitread(src_ctx_t *ctx, unsigned char *buff, int len)
 {
 	int ret = 0;
 	fd_set rfds;
@@ -94,6 +109,18 @@ static int _src_read(src_ctx_t *ctx, unsigned char *buff, int len)
 	{
 		warn("src: timeout");
 	}
+	return ret;
+}
+
+static int _src_read(src_ctx_t *ctx, unsigned char *buff, int len)
+{
+	int ret = 0;
+#ifdef SRC_FILE_URING
+	if (ctx->uring != NULL)
+		ret = uring_read(ctx->uring, buff, len);
+	else
+#endif
+		ret = _src_waitread(ctx, buff, len);
 	if (ret < 0)
 		err("src file %d error: %s", ctx->fd, strerror(errno));
 	if (ret == 0)
@@ -226,10 +253,55 @@ static void _src_eventlistener(src_ctx_t *ctx, event_listener_cb_t cb, void *arg
 	}
 }
 
+#ifdef SRC_FILE_MMAP
+/**
+ * a regular file may be mapped and given directly to the decoder.
+ * The decoder reads the stream without the jitter and without copy.
+ */
+static int _src_map(src_ctx_t *ctx, decoder_t *decoder)
+{
+	struct stat filestat;
+
+	if (decoder->ops->map == NULL)
+		return -1;
+	if (fstat(ctx->fd, &filestat) < 0 || !S_ISREG(filestat.st_mode) || filestat.st_size == 0)
+		return -1;
+	if (ctx->map == NULL)
+	{
+		void *map = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, ctx->fd, 0);
+		if (map == MAP_FAILED)
+		{
+			warn("src: mmap error %s", strerror(errno));
+			return -1;
+		}
+		ctx->map = map;
+		ctx->maplength = filestat.st_size;
+		madvise(ctx->map, ctx->maplength, MADV_SEQUENTIAL);
+		madvise(ctx->map, ctx->maplength, MADV_WILLNEED);
+	}
+	if (decoder->ops->map(decoder->ctx, ctx->map, ctx->maplength) < 0)
+		return -1;
+	src_dbg("src: map %lu bytes to %s", ctx->maplength, decoder->ops->name);
+	return 0;
+}
+#endif
+
 static int _src_attach(src_ctx_t *ctx, long index, decoder_t *decoder)
 {
 	if (index > 0)
 		return -1;
+#ifdef SRC_FILE_MMAP
+	if (
+#ifdef DEMUX_PASSTHROUGH
+		ctx->demux == NULL &&
+#endif
+		_src_map(ctx, decoder) == 0)
+	{
+		ctx->estream = decoder;
+		ctx->pid = index;
+		return 0;
+	}
+#endif
 #ifdef DEMUX_PASSTHROUGH
 	if (ctx->demux != NULL)
 	{
@@ -246,6 +318,10 @@ static int _src_attach(src_ctx_t *ctx, long index, decoder_t *decoder)
 	ctx->pid = index;
 	if (ctx->out != NULL)
 	{
+#ifdef SRC_FILE_URING
+		if (ctx->uring == NULL)
+			ctx->uring = uring_init(ctx->fd, URING_DEPTH, ctx->out->ctx->size);
+#endif
 		src_dbg("src: add producter to %s", ctx->out->ctx->name);
 		ctx->out->ctx->produce = (produce_t)_src_read;
 		ctx->out->ctx->producter = (void *)ctx;
@@ -286,6 +362,14 @@ static void _src_destroy(src_ctx_t *ctx)
 		free(listener);
 		listener = next;
 	}
+#ifdef SRC_FILE_MMAP
+	if (ctx->map != NULL)
+		munmap(ctx->map, ctx->maplength);
+#endif
+#ifdef SRC_FILE_URING
+	if (ctx->uring != NULL)
+		uring_destroy(ctx->uring);
+#endif
 	close(ctx->fd);
 	free(ctx);
 }
@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <net/if.h>
@@ -45,8 +46,12 @@
 
 #include "player.h"
 #include "jitter.h"
+#include "heartbeat.h"
 #include "event.h"
 typedef struct src_ops_s src_ops_t;
+/// number of packets received by system call
+#define UDP_BATCH 16
+
 typedef struct src_ctx_s src_ctx_t;
 typedef struct src_s demux_t;
 struct src_ctx_s
@@ -73,6 +78,12 @@ struct src_ctx_s
 #ifdef UDP_DUMP
 	int dumpfd;
 #endif
+#ifdef UDP_THREAD
+	unsigned char *batch;
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	char control[UDP_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+#endif
 };
 #define SRC_CTX
 #include "src.h"
@@ -189,6 +200,11 @@ static int _src_connect(src_ctx_t *ctx, const char *host, int iport, const char
 	}
 	int value=1;
 	ret = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+	/**
+	 * the kernel stamps each packet at its arrival
+	 */
+	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof(value)) < 0)
+		warn("src: udp timestamp not available");
 
 	if (nif != NULL)
 	{
@@ -326,6 +342,7 @@ static src_ctx_t *_src_init(player_ctx_t *player, const char *url, const char *m
 	return ctx;
 }
 
+#ifndef UDP_THREAD
 static ssize_t _src_read(src_ctx_t *ctx, unsigned char *buff, int len)
 {
 	ssize_t ret;
@@ -352,7 +369,7 @@ static ssize_t _src_read(src_ctx_t *ctx, unsigned char *buff, int len)
 		ret = recvfrom(ctx->sock, (char *)&marker, sizeof(marker),
 				0, ctx->addr, &ctx->addrlen);
 		dbg("udp: marker %lx", marker);
-		return src_read(ctx, buff, len);
+		return _src_read(ctx, buff, len);
 	}
 	else
 #endif
@@ -383,6 +400,93 @@ static ssize_t _src_read(src_ctx_t *ctx, unsigned char *buff, int len)
 	}
 	return ret;
 }
+#else
+static void _src_timestamp(struct msghdr *hdr, beat_t *beat)
+{
+	struct timespec ts = {0};
+	struct cmsghdr *cmsg;
+	for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			break;
+		}
+	}
+	if (cmsg == NULL)
+		clock_gettime(CLOCK_REALTIME, &ts);
+	beat->timestamp.sec = ts.tv_sec;
+	beat->timestamp.nsec = ts.tv_nsec;
+}
+
+/**
+ * the packets are received by batch into the context,
+ * and copied one by one into the jitter, because the jitter
+ * gives only one buffer at a time.
+ */
+static int _src_receive(src_ctx_t *ctx)
+{
+	size_t size = ctx->out->ctx->size;
+	int i;
+	for (i = 0; i < UDP_BATCH; i++)
+	{
+		ctx->iov[i].iov_base = ctx->batch + i * size;
+		ctx->iov[i].iov_len = size;
+		memset(&ctx->msgs[i], 0, sizeof(ctx->msgs[i]));
+		ctx->msgs[i].msg_hdr.msg_iov = &ctx->iov[i];
+		ctx->msgs[i].msg_hdr.msg_iovlen = 1;
+		ctx->msgs[i].msg_hdr.msg_control = ctx->control[i];
+		ctx->msgs[i].msg_hdr.msg_controllen = sizeof(ctx->control[i]);
+	}
+	int nmsgs = recvmmsg(ctx->sock, ctx->msgs, UDP_BATCH, MSG_WAITFORONE, NULL);
+	if (nmsgs < 0 && errno == EINTR)
+		return 0;
+	if (nmsgs < 0)
+	{
+		ctx->state = STATE_ERROR;
+		err("src: udp reception error %s", strerror(errno));
+		return -1;
+	}
+	src_dbg("src: receive %d packets", nmsgs);
+	for (i = 0; i < nmsgs; i++)
+	{
+		size_t length = ctx->msgs[i].msg_len;
+		if (length == 0)
+		{
+			warn("src: udp end of stream");
+			ctx->state = STATE_ERROR;
+			return -1;
+		}
+#ifdef UDP_MARKER
+		if (length == sizeof(unsigned long))
+		{
+			dbg("udp: marker %lx", *(unsigned long *)ctx->iov[i].iov_base);
+			continue;
+		}
+#endif
+		if (ctx->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			warn("src: packet truncated to %lu", size);
+		beat_t beat = {0};
+		_src_timestamp(&ctx->msgs[i].msg_hdr, &beat);
+
+		unsigned char *buff = ctx->out->ops->pull(ctx->out->ctx);
+		if (buff == NULL)
+		{
+			ctx->state = STATE_ERROR;
+			return -1;
+		}
+		memcpy(buff, ctx->iov[i].iov_base, length);
+#ifdef UDP_DUMP
+		if (ctx->dumpfd > 0)
+		{
+			write(ctx->dumpfd, buff, length);
+		}
+#endif
+		ctx->out->ops->push(ctx->out->ctx, length, &beat);
+	}
+	return nmsgs;
+}
+#endif
 
 static void *_src_thread(void *arg)
 {
@@ -402,6 +506,15 @@ static void *_src_thread(void *arg)
 #ifdef UDP_MARKER
 	warn("src: udp marker is ON");
 #endif
+#ifdef UDP_THREAD
+	ctx->batch = malloc(UDP_BATCH * ctx->out->ctx->size);
+	while (ctx->state != STATE_ERROR)
+	{
+		_src_receive(ctx);
+	}
+	free(ctx->batch);
+	ctx->batch = NULL;
+#else
 	while (ctx->state != STATE_ERROR)
 	{
 		unsigned char *buff = ctx->out->ops->pull(ctx->out->ctx);
@@ -416,6 +529,7 @@ static void *_src_thread(void *arg)
 			ctx->out->ops->push(ctx->out->ctx, length, NULL);
 		}
 	}
+#endif
 	dbg("src: thread end");
 	ctx->out->ops->flush(ctx->out->ctx);
 #ifndef DEMUX_PASSTHROUGH
@@ -547,7 +661,7 @@ static int _src_attach(src_ctx_t *ctx, long index, decoder_t *decoder)
 #endif
 #ifndef UDP_THREAD
 	dbg("src: add producter to %s", ctx->out->ctx->name);
-	ctx->out->ctx->produce = (produce_t)src_read;
+	ctx->out->ctx->produce = (produce_t)_src_read;
 	ctx->out->ctx->producter = (void *)ctx;
 #endif
 	return ret;
@@ -0,0 +1,907 @@
+/*****************************************************************************
+ * transcache.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "player.h"
+#include "event.h"
+#include "heartbeat.h"
+typedef struct src_ops_s src_ops_t;
+typedef struct src_ctx_s src_ctx_t;
+struct src_ctx_s
+{
+	const src_ops_t *ops;
+	player_ctx_t *player;
+	struct transcache_s **caches;
+	int *fds;
+	int ncaches;
+	/// number of caches still replaying
+	int running;
+	pthread_mutex_t mutex;
+	event_listener_t *listener;
+};
+#define SRC_CTX
+#include "src.h"
+#include "jitter.h"
+#include "encoder.h"
+#include "transcache.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define transcache_dbg(...)
+
+#ifndef TRANSCACHE_DIR
+#define TRANSCACHE_DIR LOCALSTATEDIR"/cache/putv"
+#endif
+#ifndef TRANSCACHE_MAXSIZE
+#define TRANSCACHE_MAXSIZE (512 * 1024 * 1024)
+#endif
+/// polling of the encoder output when a media is replayed
+#define TRANSCACHE_WAIT_MS 5
+
+#define TRANSCACHE_MAGIC "PTC1"
+
+typedef struct transcache_header_s transcache_header_t;
+struct transcache_header_s
+{
+	char magic[4];
+	/// hash of the info of the media when it was encoded
+	uint32_t hash;
+};
+
+typedef struct transcache_record_s transcache_record_t;
+struct transcache_record_s
+{
+	uint32_t length;
+	beat_t beat;
+};
+
+/**
+ * A media is followed from the decoder output to the sink input:
+ *  - the decoder pushes the first samples of the media: "start" is
+ *    the number of samples already produced,
+ *  - the encoder pops the samples after "start": "atpush" is the number
+ *    of buffers already pushed by the encoder,
+ *  - the cache forwards the buffer "atpush" and switches to the new file.
+ */
+typedef struct transcache_entry_s transcache_entry_t;
+struct transcache_entry_s
+{
+	int id;
+	uint32_t hash;
+	unsigned long long start;
+	unsigned long atpush;
+	int encoded;
+	/// the decoder was stopped before the end of the media
+	int aborted;
+	transcache_entry_t *next;
+};
+
+struct transcache_s
+{
+	player_ctx_t *player;
+	char profile[32];
+	jitter_t *out;
+	jitter_t *encoded;
+	jitter_t *in;
+	jitter_t *producer;
+	unsigned int inframe;
+	unsigned int producerframe;
+
+	const src_t *producing;
+	transcache_entry_t *entries;
+	transcache_entry_t *recording;
+	unsigned long long produced;
+	unsigned long long consumed;
+	unsigned long npushed;
+	unsigned long nforwarded;
+	/// the beats of the encoder, one by buffer of the encoded jitter
+	beat_t *beats;
+	unsigned long nbeats;
+	int fd;
+
+	src_ctx_t *replay;
+	int replayfd;
+	unsigned char *record;
+
+	int eventid;
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	int run;
+	transcache_t *next;
+};
+
+typedef struct transcache_wrap_s transcache_wrap_t;
+struct transcache_wrap_s
+{
+	jitter_ops_t ops;
+	const jitter_ops_t *inops;
+	int refs;
+};
+
+static const char *jitter_name = "transcache";
+static transcache_t *_transcaches = NULL;
+/**
+ * the wrappers of the jitters' operations, indexed by the jitter id
+ */
+static transcache_wrap_t _wraps[MAXJITTERS] = {0};
+
+static uint32_t _transcache_hash(const char *info)
+{
+	uint32_t hash = 2166136261u;
+	if (info == NULL)
+		return 0;
+	for (; *info != '\0'; info++)
+	{
+		hash ^= (unsigned char)*info;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void _transcache_path(transcache_t *ctx, int id, const char *ext, char *path, size_t length)
+{
+	snprintf(path, length, "%s/%d-%s.%s", TRANSCACHE_DIR, id, ctx->profile, ext);
+}
+
+static int _transcache_filter(const struct dirent *entry)
+{
+	const char *ext = strrchr(entry->d_name, '.');
+	return (ext != NULL && !strcmp(ext, ".cache"));
+}
+
+typedef struct transcache_file_s transcache_file_t;
+struct transcache_file_s
+{
+	char *name;
+	off_t size;
+	time_t mtime;
+};
+
+static int _transcache_older(const void *a, const void *b)
+{
+	const transcache_file_t *fa = a;
+	const transcache_file_t *fb = b;
+	return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+/**
+ * the files are touched on each replay,
+ * the oldest ones are removed first.
+ */
+static void _transcache_evict(void)
+{
+	struct dirent **namelist = NULL;
+	int n = scandir(TRANSCACHE_DIR, &namelist, _transcache_filter, NULL);
+	if (n <= 0)
+		return;
+	transcache_file_t *files = calloc(n, sizeof(*files));
+	off_t total = 0;
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		struct stat filestat;
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/%s", TRANSCACHE_DIR, namelist[i]->d_name);
+		files[i].name = namelist[i]->d_name;
+		if (stat(path, &filestat) != 0)
+			continue;
+		files[i].size = filestat.st_size;
+		files[i].mtime = filestat.st_mtime;
+		total += filestat.st_size;
+	}
+	qsort(files, n, sizeof(*files), _transcache_older);
+	for (i = 0; i < n && total > TRANSCACHE_MAXSIZE; i++)
+	{
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/%s", TRANSCACHE_DIR, files[i].name);
+		if (unlink(path) == 0)
+		{
+			transcache_dbg("transcache: evict %s", files[i].name);
+			total -= files[i].size;
+		}
+	}
+	free(files);
+	for (i = 0; i < n; i++)
+		free(namelist[i]);
+	free(namelist);
+}
+
+static void _transcache_close(transcache_t *ctx)
+{
+	transcache_entry_t *entry = ctx->recording;
+	if (entry == NULL)
+		return;
+	if (ctx->fd >= 0)
+	{
+		char tmp[PATH_MAX];
+		_transcache_path(ctx, entry->id, "tmp", tmp, sizeof(tmp));
+		close(ctx->fd);
+		ctx->fd = -1;
+		if (entry->aborted)
+			unlink(tmp);
+		else
+		{
+			char path[PATH_MAX];
+			_transcache_path(ctx, entry->id, "cache", path, sizeof(path));
+			if (rename(tmp, path) == 0)
+				warn("transcache: media %d saved for %s", entry->id, ctx->profile);
+			_transcache_evict();
+		}
+	}
+	free(entry);
+	ctx->recording = NULL;
+}
+
+static void _transcache_open(transcache_t *ctx, transcache_entry_t *entry)
+{
+	ctx->recording = entry;
+	if (entry->id < 0 || entry->aborted)
+		return;
+	char tmp[PATH_MAX];
+	_transcache_path(ctx, entry->id, "tmp", tmp, sizeof(tmp));
+	ctx->fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (ctx->fd < 0)
+	{
+		err("transcache: open %s error %s", tmp, strerror(errno));
+		return;
+	}
+	transcache_header_t header = {.hash = entry->hash};
+	memcpy(header.magic, TRANSCACHE_MAGIC, sizeof(header.magic));
+	if (write(ctx->fd, &header, sizeof(header)) != sizeof(header))
+		entry->aborted = 1;
+}
+
+static void _transcache_write(transcache_t *ctx, unsigned char *data, size_t length, beat_t *beat)
+{
+	transcache_record_t record = {.length = length};
+	if (beat != NULL)
+		memcpy(&record.beat, beat, sizeof(record.beat));
+	if (write(ctx->fd, &record, sizeof(record)) != sizeof(record) ||
+		write(ctx->fd, data, length) != length)
+	{
+		err("transcache: write error %s", strerror(errno));
+		ctx->recording->aborted = 1;
+		close(ctx->fd);
+		ctx->fd = -1;
+		char tmp[PATH_MAX];
+		_transcache_path(ctx, ctx->recording->id, "tmp", tmp, sizeof(tmp));
+		unlink(tmp);
+	}
+}
+
+/**
+ * called by the decoder on the jitter of the player
+ */
+static void _transcache_produce(transcache_t *ctx, size_t length)
+{
+	const src_t *src = player_source(ctx->player);
+	pthread_mutex_lock(&ctx->mutex);
+	/**
+	 * the next source is allocated while the current one exists,
+	 * a new pointer is a new media
+	 */
+	if (src != NULL && src != ctx->producing)
+	{
+		transcache_entry_t *entry = calloc(1, sizeof(*entry));
+		entry->id = src->mediaid;
+		entry->hash = _transcache_hash(src->info);
+		entry->start = ctx->produced;
+		if (ctx->entries == NULL)
+			ctx->entries = entry;
+		else
+		{
+			transcache_entry_t *last = ctx->entries;
+			while (last->next != NULL) last = last->next;
+			last->next = entry;
+		}
+		ctx->producing = src;
+	}
+	ctx->produced += length / ctx->producerframe;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static void _transcache_abort(transcache_t *ctx)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	/**
+	 * the last entry is the media of the decoder
+	 */
+	transcache_entry_t *entry = ctx->entries;
+	while (entry != NULL && entry->next != NULL)
+		entry = entry->next;
+	if (entry == NULL)
+		entry = ctx->recording;
+	if (entry != NULL)
+		entry->aborted = 1;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+/**
+ * called by the encoder on its input jitter
+ */
+static void _transcache_consume(transcache_t *ctx, size_t length)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	transcache_entry_t *entry = ctx->entries;
+	while (entry != NULL && entry->encoded)
+		entry = entry->next;
+	while (entry != NULL && entry->start <= ctx->consumed)
+	{
+		entry->encoded = 1;
+		entry->atpush = ctx->npushed;
+		entry = entry->next;
+	}
+	ctx->consumed += length / ctx->inframe;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static void _transcache_boundary(transcache_t *ctx)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	while (ctx->entries != NULL && ctx->entries->encoded &&
+			ctx->entries->atpush <= ctx->nforwarded)
+	{
+		transcache_entry_t *entry = ctx->entries;
+		ctx->entries = entry->next;
+		entry->next = NULL;
+		_transcache_close(ctx);
+		_transcache_open(ctx, entry);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static int _transcache_is(jitter_t *jitter, jitter_ctx_t *jctx)
+{
+	return (jitter != NULL && jitter->ctx == jctx);
+}
+
+#define TRANSCACHE_FOREACH(ctx, member, jctx) \
+	for (transcache_t *ctx = _transcaches; ctx != NULL; ctx = ctx->next) \
+		if (_transcache_is(ctx->member, jctx))
+
+static unsigned char *_transcache_pull(jitter_ctx_t *jctx)
+{
+	unsigned char *buffer = _wraps[jctx->id].inops->pull(jctx);
+	/**
+	 * the jitter is flushed, the decoder didn't complete the media
+	 */
+	if (buffer == NULL)
+	{
+		TRANSCACHE_FOREACH(ctx, producer, jctx)
+			_transcache_abort(ctx);
+	}
+	return buffer;
+}
+
+static unsigned char *_transcache_pull_channel(jitter_ctx_t *jctx, int channel)
+{
+	unsigned char *buffer = _wraps[jctx->id].inops->pull_channel(jctx, channel);
+	if (buffer == NULL)
+	{
+		TRANSCACHE_FOREACH(ctx, producer, jctx)
+			_transcache_abort(ctx);
+	}
+	return buffer;
+}
+
+static void _transcache_push(jitter_ctx_t *jctx, size_t len, void *beat)
+{
+	TRANSCACHE_FOREACH(ctx, producer, jctx)
+		_transcache_produce(ctx, len);
+	TRANSCACHE_FOREACH(ctx, encoded, jctx)
+	{
+		ctx->npushed++;
+		/**
+		 * the beat is kept here, the jitter may not return it
+		 */
+		if (len > 0)
+		{
+			beat_t *slotbeat = &ctx->beats[ctx->nbeats++ % jctx->count];
+			memset(slotbeat, 0, sizeof(*slotbeat));
+			if (beat != NULL)
+				memcpy(slotbeat, beat, sizeof(*slotbeat));
+		}
+	}
+	_wraps[jctx->id].inops->push(jctx, len, beat);
+}
+
+static void _transcache_pop(jitter_ctx_t *jctx, size_t len)
+{
+	TRANSCACHE_FOREACH(ctx, in, jctx)
+		_transcache_consume(ctx, len);
+	_wraps[jctx->id].inops->pop(jctx, len);
+}
+
+/**
+ * the heartbeat of the encoder paces the sink
+ */
+static heartbeat_t *_transcache_heartbeat(jitter_ctx_t *jctx, heartbeat_t *new)
+{
+	TRANSCACHE_FOREACH(ctx, encoded, jctx)
+		return ctx->out->ops->heartbeat(ctx->out->ctx, new);
+	return _wraps[jctx->id].inops->heartbeat(jctx, new);
+}
+
+static void _transcache_wrap(jitter_t *jitter)
+{
+	transcache_wrap_t *wrap = &_wraps[jitter->ctx->id];
+	if (wrap->refs++ > 0)
+		return;
+	wrap->inops = jitter->ops;
+	memcpy(&wrap->ops, jitter->ops, sizeof(wrap->ops));
+	wrap->ops.pull = _transcache_pull;
+	if (wrap->ops.pull_channel)
+		wrap->ops.pull_channel = _transcache_pull_channel;
+	wrap->ops.push = _transcache_push;
+	wrap->ops.pop = _transcache_pop;
+	wrap->ops.heartbeat = _transcache_heartbeat;
+	jitter->ops = &wrap->ops;
+}
+
+static void _transcache_unwrap(jitter_t *jitter)
+{
+	transcache_wrap_t *wrap = &_wraps[jitter->ctx->id];
+	if (--wrap->refs > 0)
+		return;
+	/**
+	 * the operations are kept for the calls on the way,
+	 * the next wrap overwrites them.
+	 */
+	jitter->ops = wrap->inops;
+}
+
+static int _transcache_forward(transcache_t *ctx, unsigned char *data, size_t length, beat_t *beat)
+{
+	unsigned char *buffer = ctx->out->ops->pull(ctx->out->ctx);
+	if (buffer == NULL)
+		return -1;
+	memcpy(buffer, data, length);
+	ctx->out->ops->push(ctx->out->ctx, length, beat);
+	return 0;
+}
+
+static int _transcache_replay(transcache_t *ctx)
+{
+	transcache_record_t record;
+	size_t length = 0;
+	src_ctx_t *src = NULL;
+
+	pthread_mutex_lock(&ctx->mutex);
+	if (ctx->replayfd < 0)
+	{
+		pthread_mutex_unlock(&ctx->mutex);
+		return 0;
+	}
+	/**
+	 * the encoder completed the previous media
+	 */
+	if (ctx->recording != NULL && ctx->entries == NULL &&
+		ctx->in != NULL && ctx->in->ops->empty(ctx->in->ctx))
+		_transcache_close(ctx);
+	if (read(ctx->replayfd, &record, sizeof(record)) == sizeof(record) &&
+		record.length <= ctx->out->ctx->size &&
+		read(ctx->replayfd, ctx->record, record.length) == record.length)
+		length = record.length;
+	else
+	{
+		close(ctx->replayfd);
+		ctx->replayfd = -1;
+		src = ctx->replay;
+		ctx->replay = NULL;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	if (src != NULL)
+	{
+		pthread_mutex_lock(&src->mutex);
+		int running = --src->running;
+		pthread_mutex_unlock(&src->mutex);
+		if (running == 0)
+		{
+			dbg("transcache: end of replay");
+			player_state(src->player, STATE_CHANGE);
+		}
+		return 0;
+	}
+	_transcache_forward(ctx, ctx->record, length, &record.beat);
+	return 1;
+}
+
+static void *_transcache_thread(void *arg)
+{
+	transcache_t *ctx = (transcache_t *)arg;
+	jitter_t *encoded = ctx->encoded;
+
+	while (ctx->run)
+	{
+		/**
+		 * the end of the previous media is sent before the replay
+		 */
+		if (!encoded->ops->empty(encoded->ctx))
+		{
+			_transcache_boundary(ctx);
+			unsigned char *data = encoded->ops->peer(encoded->ctx, NULL);
+			if (data == NULL)
+				continue;
+			size_t length = encoded->ops->length(encoded->ctx);
+			beat_t *beat = &ctx->beats[ctx->nforwarded % encoded->ctx->count];
+			if (_transcache_forward(ctx, data, length, beat) == 0 && ctx->fd >= 0)
+				_transcache_write(ctx, data, length, beat);
+			encoded->ops->pop(encoded->ctx, length);
+			ctx->nforwarded++;
+		}
+		else if (_transcache_replay(ctx) == 0)
+			usleep(TRANSCACHE_WAIT_MS * 1000);
+	}
+	return NULL;
+}
+
+static void _transcache_playerstate_cb(void *arg, event_t event, void *data)
+{
+	if (event != PLAYER_EVENT_CHANGE)
+		return;
+	transcache_t *ctx = (transcache_t *)arg;
+	event_player_state_t *edata = (event_player_state_t *)data;
+	if ((edata->state & ~STATE_PAUSE_MASK) != STATE_STOP)
+		return;
+	/**
+	 * the jitters are flushed on stop, the samples are lost
+	 * and the counters restart together.
+	 */
+	pthread_mutex_lock(&ctx->mutex);
+	transcache_entry_t *entry;
+	for (entry = ctx->entries; entry != NULL; entry = entry->next)
+		entry->aborted = 1;
+	if (ctx->recording != NULL)
+		ctx->recording->aborted = 1;
+	ctx->producing = NULL;
+	ctx->consumed = ctx->produced;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static unsigned int _transcache_framesize(jitter_t *jitter)
+{
+	unsigned int framesize = FORMAT_NCHANNELS(jitter->format) * FORMAT_SAMPLESIZE(jitter->format) / 8;
+	if (framesize == 0)
+		framesize = 1;
+	return framesize;
+}
+
+transcache_t *transcache_init(player_ctx_t *player, encoder_t *encoder, jitter_t *out)
+{
+	if (encoder->ops->type != ES_AUDIO)
+		return NULL;
+	if (mkdir(TRANSCACHE_DIR, 0755) != 0 && errno != EEXIST)
+	{
+		err("transcache: %s not available %s", TRANSCACHE_DIR, strerror(errno));
+		return NULL;
+	}
+	jitter_t *encoded = jitter_init(JITTER_TYPE_SG, jitter_name, out->ctx->count, out->ctx->size);
+	if (encoded == NULL)
+		return NULL;
+	encoded->format = out->format;
+	encoded->ctx->frequence = out->ctx->frequence;
+	encoded->ctx->thredhold = 0;
+
+	transcache_t *ctx = calloc(1, sizeof(*ctx));
+	ctx->player = player;
+	ctx->out = out;
+	ctx->encoded = encoded;
+	ctx->fd = -1;
+	ctx->replayfd = -1;
+	ctx->record = malloc(out->ctx->size);
+	ctx->beats = calloc(encoded->ctx->count, sizeof(*ctx->beats));
+	int samplerate = 0;
+	if (encoder->ops->samplerate)
+		samplerate = encoder->ops->samplerate(encoder->ctx);
+	snprintf(ctx->profile, sizeof(ctx->profile), "%s-%d", encoder->ops->name, samplerate);
+	ctx->in = encoder->ops->jitter(encoder->ctx);
+	pthread_mutex_init(&ctx->mutex, NULL);
+
+	_transcache_wrap(encoded);
+	ctx->next = _transcaches;
+	_transcaches = ctx;
+
+	ctx->run = 1;
+	pthread_create(&ctx->thread, NULL, _transcache_thread, ctx);
+	return ctx;
+}
+
+jitter_t *transcache_jitter(transcache_t *ctx)
+{
+	return ctx->encoded;
+}
+
+int transcache_run(player_ctx_t *player)
+{
+	int ret = -1;
+	transcache_t *ctx;
+	for (ctx = _transcaches; ctx != NULL; ctx = ctx->next)
+	{
+		if (ctx->player != player || ctx->producer != NULL)
+			continue;
+		/**
+		 * the encoders may share the output of the decoder,
+		 * the player returns the jitter really filled by the decoder
+		 */
+		ctx->producer = player_outstream(player, ctx->in);
+		if (ctx->producer == NULL)
+			continue;
+		ctx->inframe = _transcache_framesize(ctx->in);
+		ctx->producerframe = _transcache_framesize(ctx->producer);
+		_transcache_wrap(ctx->in);
+		if (ctx->producer != ctx->in)
+			_transcache_wrap(ctx->producer);
+		ctx->eventid = player_eventlistener(player, _transcache_playerstate_cb, ctx, "transcache");
+		warn("transcache: %s into %s", ctx->profile, TRANSCACHE_DIR);
+		ret = 0;
+	}
+	return ret;
+}
+
+/**
+ * the cache doesn't follow anymore the decoder and the encoder,
+ * it still forwards the encoded stream to the sink.
+ */
+static void _transcache_stop(transcache_t *ctx)
+{
+	if (ctx->producer == NULL)
+		return;
+	player_removeevent(ctx->player, ctx->eventid);
+	pthread_mutex_lock(&ctx->mutex);
+	_transcache_unwrap(ctx->in);
+	if (ctx->producer != ctx->in)
+		_transcache_unwrap(ctx->producer);
+	ctx->in = NULL;
+	ctx->producer = NULL;
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+void transcache_stop(player_ctx_t *player)
+{
+	transcache_t *ctx;
+	for (ctx = _transcaches; ctx != NULL; ctx = ctx->next)
+	{
+		if (ctx->player == player)
+			_transcache_stop(ctx);
+	}
+}
+
+static void _transcache_destroy(transcache_t *ctx)
+{
+	_transcache_stop(ctx);
+	ctx->run = 0;
+	ctx->encoded->ops->flush(ctx->encoded->ctx);
+	pthread_join(ctx->thread, NULL);
+	/**
+	 * the last media is not complete
+	 */
+	if (ctx->recording != NULL)
+		ctx->recording->aborted = 1;
+	_transcache_close(ctx);
+	while (ctx->entries != NULL)
+	{
+		transcache_entry_t *entry = ctx->entries;
+		ctx->entries = entry->next;
+		free(entry);
+	}
+	if (ctx->replayfd >= 0)
+		close(ctx->replayfd);
+	_transcache_unwrap(ctx->encoded);
+	jitter_destroy(ctx->encoded);
+	pthread_mutex_destroy(&ctx->mutex);
+	free(ctx->record);
+	free(ctx->beats);
+	free(ctx);
+}
+
+void transcache_destroy(player_ctx_t *player)
+{
+	transcache_t **it = &_transcaches;
+	while (*it != NULL)
+	{
+		transcache_t *ctx = *it;
+		if (ctx->player != player)
+		{
+			it = &ctx->next;
+			continue;
+		}
+		*it = ctx->next;
+		_transcache_destroy(ctx);
+	}
+}
+
+/**
+ * the source is available only if all the encoders of the player
+ * own the media with the same info
+ */
+src_t *transcache_src(player_ctx_t *player, int id, const char *info)
+{
+	src_ctx_t *src = calloc(1, sizeof(*src));
+	src->ops = src_transcache;
+	src->player = player;
+	src->caches = calloc(MAX_ESTREAM, sizeof(*src->caches));
+	src->fds = calloc(MAX_ESTREAM, sizeof(*src->fds));
+	uint32_t hash = _transcache_hash(info);
+	transcache_t *ctx;
+	for (ctx = _transcaches; ctx != NULL; ctx = ctx->next)
+	{
+		if (ctx->player != player || ctx->producer == NULL)
+			continue;
+		/**
+		 * too many encoders to replay, the caches stay valid
+		 */
+		if (src->ncaches == MAX_ESTREAM)
+			break;
+		char path[PATH_MAX];
+		_transcache_path(ctx, id, "cache", path, sizeof(path));
+		transcache_header_t header = {0};
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			break;
+		if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+			memcmp(header.magic, TRANSCACHE_MAGIC, sizeof(header.magic)) ||
+			header.hash != hash)
+		{
+			/**
+			 * the media changed since its encoding
+			 */
+			close(fd);
+			unlink(path);
+			break;
+		}
+		utime(path, NULL);
+		src->caches[src->ncaches] = ctx;
+		src->fds[src->ncaches] = fd;
+		src->ncaches++;
+	}
+	if (ctx != NULL || src->ncaches == 0)
+	{
+		for (int i = 0; i < src->ncaches; i++)
+			close(src->fds[i]);
+		free(src->caches);
+		free(src->fds);
+		free(src);
+		return NULL;
+	}
+	pthread_mutex_init(&src->mutex, NULL);
+	dbg("transcache: replay media %d", id);
+
+	src_t *ret = calloc(1, sizeof(*ret));
+	ret->ops = src_transcache;
+	ret->ctx = src;
+	ret->mediaid = id;
+	if (info)
+		ret->info = strdup(info);
+	return ret;
+}
+
+static int _src_run(src_ctx_t *ctx)
+{
+	ctx->running = ctx->ncaches;
+	for (int i = 0; i < ctx->ncaches; i++)
+	{
+		transcache_t *cache = ctx->caches[i];
+		pthread_mutex_lock(&cache->mutex);
+		cache->replayfd = ctx->fds[i];
+		ctx->fds[i] = -1;
+		cache->replay = ctx;
+		/**
+		 * the next decoded media has to open a new entry
+		 */
+		cache->producing = NULL;
+		pthread_mutex_unlock(&cache->mutex);
+	}
+	return 0;
+}
+
+static void _src_eventlistener(src_ctx_t *ctx, event_listener_cb_t cb, void *arg)
+{
+	/**
+	 * the media doesn't need any decoder,
+	 * then the events are never sent.
+	 */
+	event_listener_t *listener = calloc(1, sizeof(*listener));
+	listener->cb = cb;
+	listener->arg = arg;
+	listener->next = ctx->listener;
+	ctx->listener = listener;
+}
+
+static int _src_attach(src_ctx_t *ctx, long index, decoder_t *decoder)
+{
+	return -1;
+}
+
+static decoder_t *_src_estream(src_ctx_t *ctx, long index)
+{
+	return NULL;
+}
+
+static void _src_destroy(src_ctx_t *ctx)
+{
+	for (int i = 0; i < ctx->ncaches; i++)
+	{
+		transcache_t *cache = ctx->caches[i];
+		pthread_mutex_lock(&cache->mutex);
+		if (cache->replay == ctx)
+		{
+			close(cache->replayfd);
+			cache->replayfd = -1;
+			cache->replay = NULL;
+		}
+		pthread_mutex_unlock(&cache->mutex);
+		if (ctx->fds[i] >= 0)
+			close(ctx->fds[i]);
+	}
+	event_listener_t *listener = ctx->listener;
+	while (listener)
+	{
+		event_listener_t *next = listener->next;
+		free(listener);
+		listener = next;
+	}
+	pthread_mutex_destroy(&ctx->mutex);
+	free(ctx->caches);
+	free(ctx->fds);
+	free(ctx);
+}
+
+static const char *_src_medium()
+{
+	return "audio/x-putv-cache";
+}
+
+const src_ops_t *src_transcache = &(src_ops_t)
+{
+	.name = "transcache",
+	.protocol = "",
+	.medium = _src_medium,
+	.run = _src_run,
+	.eventlistener = _src_eventlistener,
+	.attach = _src_attach,
+	.estream = _src_estream,
+	.destroy = _src_destroy,
+};
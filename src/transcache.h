@@ -0,0 +1,40 @@
+#ifndef __TRANSCACHE_H__
+#define __TRANSCACHE_H__
+
+#include "jitter.h"
+#include "encoder.h"
+#include "src.h"
+
+/**
+ * the encoded stream of each media is saved into TRANSCACHE_DIR,
+ * one file by media id and encoder profile.
+ * When all the encoders of the player own the media in the cache,
+ * the media is replayed directly into the sinks.
+ */
+typedef struct transcache_s transcache_t;
+
+/**
+ * insert the cache between the encoder and its sink.
+ * The encoder must run on the jitter returned by transcache_jitter.
+ */
+transcache_t *transcache_init(player_ctx_t *player, encoder_t *encoder, jitter_t *out);
+jitter_t *transcache_jitter(transcache_t *ctx);
+/**
+ * start to record the media, after the subscription of all the encoders
+ */
+int transcache_run(player_ctx_t *player);
+/**
+ * return a source to replay the media from the cache or NULL
+ */
+src_t *transcache_src(player_ctx_t *player, int id, const char *info);
+/**
+ * release the inputs of the encoders, before to destroy the encoders
+ */
+void transcache_stop(player_ctx_t *player);
+/**
+ * the encoders have to be destroyed before, the sinks after.
+ */
+void transcache_destroy(player_ctx_t *player);
+
+extern const src_ops_t *src_transcache;
+#endif
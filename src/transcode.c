@@ -0,0 +1,302 @@
+/*****************************************************************************
+ * transcode.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+
+#include "player.h"
+#include "encoder.h"
+#include "sink.h"
+#include "jitter.h"
+#include "transcode.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define transcode_dbg(...)
+
+typedef struct transcode_s transcode_t;
+struct transcode_s
+{
+	player_ctx_t *player;
+	jitter_t *in;
+	jitter_ops_t ops;
+	const jitter_ops_t *inops;
+	unsigned long long nbytes;
+	int started;
+	/// the encoder waits a new buffer
+	int idle;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+/**
+ * one pipeline runs into each process,
+ * the encoder input is counted here.
+ */
+static transcode_t _transcode = {0};
+
+static void _transcode_push(jitter_ctx_t *jctx, size_t len, void *beat)
+{
+	_transcode.nbytes += len;
+	_transcode.inops->push(jctx, len, beat);
+}
+
+static unsigned char *_transcode_peer(jitter_ctx_t *jctx, void **beat)
+{
+	pthread_mutex_lock(&_transcode.mutex);
+	_transcode.idle = 1;
+	pthread_mutex_unlock(&_transcode.mutex);
+	pthread_cond_broadcast(&_transcode.cond);
+	unsigned char *buffer = _transcode.inops->peer(jctx, beat);
+	pthread_mutex_lock(&_transcode.mutex);
+	_transcode.idle = 0;
+	pthread_mutex_unlock(&_transcode.mutex);
+	return buffer;
+}
+
+/**
+ * the player flushed the encoder input before the STOP event,
+ * and it resets the jitter after. The job waits the encoder
+ * consumes the last buffer, otherwise the end of the file is lost.
+ */
+static void _transcode_drain(transcode_t *ctx)
+{
+	pthread_mutex_lock(&ctx->mutex);
+	while (!ctx->idle || !ctx->inops->empty(ctx->in->ctx))
+		pthread_cond_wait(&ctx->cond, &ctx->mutex);
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static void _transcode_playerstate_cb(void *arg, event_t event, void *data)
+{
+	if (event != PLAYER_EVENT_CHANGE)
+		return;
+	transcode_t *ctx = (transcode_t *)arg;
+	event_player_state_t *edata = (event_player_state_t *)data;
+	if (edata->state == STATE_PLAY)
+		ctx->started = 1;
+	/**
+	 * the media contains only one entry, the player stops at its end
+	 */
+	else if (edata->state == STATE_STOP && ctx->started)
+	{
+		_transcode_drain(ctx);
+		player_state(ctx->player, STATE_ERROR);
+	}
+}
+
+static char *_transcode_output(const char *output, const char *input)
+{
+	char *name = strdup(input);
+	char *base = basename(name);
+	char *ext = strrchr(base, '.');
+	if (ext != NULL)
+		*ext = '\0';
+	const char *pattern = strstr(output, "%s");
+	size_t length = strlen(output) + strlen(base) + 1;
+	char *url = malloc(length);
+	snprintf(url, length, "%.*s%s%s", (int)(pattern - output), output, base, pattern + 2);
+	free(name);
+	return url;
+}
+
+/**
+ * the output name keeps only the base name of the input,
+ * two inputs from different directories may write the same file.
+ */
+static int _transcode_collide(const char *output, char * const inputs[], int index)
+{
+	int ret = -1;
+	char *url = _transcode_output(output, inputs[index]);
+	for (int i = 0; i < index && ret < 0; i++)
+	{
+		char *other = _transcode_output(output, inputs[i]);
+		if (!strcmp(url, other))
+			ret = i;
+		free(other);
+	}
+	free(url);
+	return ret;
+}
+
+static double _transcode_diff(struct timespec *start, struct timespec *stop)
+{
+	return (stop->tv_sec - start->tv_sec) + (stop->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static int _transcode_file(const char *filtername, const char *output, const char *input)
+{
+	int ret = -1;
+	player_ctx_t *player = player_init(filtername);
+	if (player == NULL)
+		return -1;
+	_transcode.player = player;
+	pthread_mutex_init(&_transcode.mutex, NULL);
+	pthread_cond_init(&_transcode.cond, NULL);
+
+	char *url = _transcode_output(output, input);
+	sink_t *sink = sink_build(player, url);
+	if (sink == NULL)
+	{
+		err("transcode: output %s not available", url);
+		free(url);
+		player_destroy(player);
+		return -1;
+	}
+	/**
+	 * the sink must to run before to start the encoder
+	 */
+	sink->ops->run(sink->ctx);
+	encoder_t encoder = {0};
+	encoder.ops = sink->ops->encoder(sink->ctx);
+	encoder.ctx = encoder.ops->init(player);
+	if (encoder.ctx == NULL)
+	{
+		err("transcode: encoder not found");
+		goto end_sink;
+	}
+	int index = sink->ops->attach(sink->ctx, &encoder);
+	encoder.ops->run(encoder.ctx, sink->ops->jitter(sink->ctx, index));
+	player_subscribe(player, &encoder);
+
+	_transcode.in = encoder.ops->jitter(encoder.ctx);
+	_transcode.inops = _transcode.in->ops;
+	memcpy(&_transcode.ops, _transcode.inops, sizeof(_transcode.ops));
+	_transcode.ops.push = _transcode_push;
+	_transcode.ops.peer = _transcode_peer;
+	_transcode.in->ops = &_transcode.ops;
+
+	player_eventlistener(player, _transcode_playerstate_cb, &_transcode, "transcode");
+	player_change(player, input, 0, 0, 0);
+	player_state(player, STATE_PLAY);
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = player_run(player);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	jitter_t *in = _transcode.in;
+	unsigned int framesize = FORMAT_NCHANNELS(in->format) * FORMAT_SAMPLESIZE(in->format) / 8;
+	double duration = 0;
+	if (jitter_samplerate(in) > 0 && framesize > 0)
+		duration = (double)_transcode.nbytes / framesize / jitter_samplerate(in);
+	double elapsed = _transcode_diff(&start, &stop);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	double cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+	fprintf(stdout, "%s => %s: %.2fs in %.2fs (x%.1f realtime, cpu %.2fs)\n",
+			input, url, duration, elapsed,
+			(elapsed > 0)? duration / elapsed: 0, cpu);
+	fflush(stdout);
+
+	_transcode.in->ops = _transcode.inops;
+	encoder.ops->destroy(encoder.ctx);
+end_sink:
+	sink->ops->destroy(sink->ctx);
+	player_destroy(player);
+	free(url);
+	return ret;
+}
+
+int transcode_run(const char *filtername, const char *output, char * const inputs[], int ninputs, int njobs)
+{
+	if (strstr(output, "%s") == NULL)
+	{
+		err("transcode: output must contain %%s to be replaced by the input name");
+		return -1;
+	}
+	if (njobs <= 0)
+		njobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (njobs <= 0)
+		njobs = 1;
+	/**
+	 * the pipeline is paced only by the decoder and the encoder
+	 */
+	__jitter_freerun__ = 1;
+
+	int nerrors = 0;
+	int running = 0;
+	int i;
+	for (i = 0; i < ninputs || running > 0;)
+	{
+		if (i < ninputs && running < njobs)
+		{
+			int other = _transcode_collide(output, inputs, i);
+			if (other >= 0)
+			{
+				err("transcode: %s and %s have the same output", inputs[other], inputs[i]);
+				nerrors++;
+				i++;
+				continue;
+			}
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				int ret = _transcode_file(filtername, output, inputs[i]);
+				exit((ret < 0)? 1: 0);
+			}
+			if (pid < 0)
+			{
+				err("transcode: %s", strerror(errno));
+				nerrors++;
+			}
+			else
+				running++;
+			i++;
+			continue;
+		}
+		int status = 0;
+		if (wait(&status) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		running--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			nerrors++;
+	}
+	dbg("transcode: %d files, %d errors", ninputs, nerrors);
+	return (nerrors > 0)? -1: 0;
+}
@@ -0,0 +1,11 @@
+#ifndef __TRANSCODE_H__
+#define __TRANSCODE_H__
+
+/**
+ * offline transcoding: each input is decoded and encoded to output
+ * without heartbeat, "njobs" files are transcoded at the same time.
+ * output is an url of sink where "%s" is replaced by the input name.
+ */
+int transcode_run(const char *filtername, const char *output, char * const inputs[], int ninputs, int njobs);
+
+#endif
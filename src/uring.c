@@ -0,0 +1,347 @@
+/*****************************************************************************
+ * uring.c
+ * this file is part of https://github.com/ouistiti-project/putv
+ *****************************************************************************
+ * Copyright (C) 2016-2017
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <liburing.h>
+
+#include "uring.h"
+
+#define err(format, ...) fprintf(stderr, "\x1B[31m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#define warn(format, ...) fprintf(stderr, "\x1B[35m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#ifdef DEBUG
+#define dbg(format, ...) fprintf(stderr, "\x1B[32m"format"\x1B[0m\n",  ##__VA_ARGS__)
+#else
+#define dbg(...)
+#endif
+
+#define uring_dbg(...)
+
+#define URING_ALIGN 4096
+
+typedef struct uring_slot_s uring_slot_t;
+struct uring_slot_s
+{
+	unsigned char *buffer;
+	off_t offset;
+	size_t length;
+	int result;
+	int done;
+};
+
+struct uring_s
+{
+	struct io_uring ring;
+	int fd;
+	unsigned int depth;
+	size_t size;
+	unsigned char *buffers;
+	uring_slot_t *slots;
+	/// oldest slot in flight
+	unsigned int head;
+	unsigned int inflight;
+	/// bytes of the head slot already given to the reader
+	size_t consumed;
+	/// offset of the next request
+	off_t offset;
+	/// offset of the next byte for the reader
+	off_t readoffset;
+	int eof;
+};
+
+uring_t *uring_init(int fd, unsigned int depth, size_t size)
+{
+	struct stat filestat;
+	/**
+	 * the requests are sent with an explicit offset,
+	 * only the regular files may be used.
+	 */
+	if (fstat(fd, &filestat) < 0 || !S_ISREG(filestat.st_mode))
+		return NULL;
+
+	uring_t *ctx = calloc(1, sizeof(*ctx));
+	int ret = io_uring_queue_init(depth, &ctx->ring, 0);
+	if (ret < 0)
+	{
+		warn("uring: not available %s", strerror(-ret));
+		free(ctx);
+		return NULL;
+	}
+	ctx->fd = fd;
+	ctx->depth = depth;
+	ctx->size = size;
+	if (posix_memalign((void **)&ctx->buffers, URING_ALIGN, depth * size) != 0)
+	{
+		io_uring_queue_exit(&ctx->ring);
+		free(ctx);
+		return NULL;
+	}
+	ctx->slots = calloc(depth, sizeof(*ctx->slots));
+	struct iovec *iov = calloc(depth, sizeof(*iov));
+	int i;
+	for (i = 0; i < depth; i++)
+	{
+		ctx->slots[i].buffer = ctx->buffers + (i * size);
+		iov[i].iov_base = ctx->slots[i].buffer;
+		iov[i].iov_len = size;
+	}
+	ret = io_uring_register_buffers(&ctx->ring, iov, depth);
+	free(iov);
+	if (ret < 0)
+	{
+		warn("uring: buffers registration error %s", strerror(-ret));
+		io_uring_queue_exit(&ctx->ring);
+		free(ctx->slots);
+		free(ctx->buffers);
+		free(ctx);
+		return NULL;
+	}
+	ctx->offset = lseek(fd, 0, SEEK_CUR);
+	if (ctx->offset < 0)
+		ctx->offset = 0;
+	ctx->readoffset = ctx->offset;
+	dbg("uring: %u requests of %lu bytes on %d", depth, size, fd);
+	return ctx;
+}
+
+static int _uring_complete(uring_t *ctx, int wait)
+{
+	struct io_uring_cqe *cqe = NULL;
+	int ret;
+	if (wait)
+		ret = io_uring_wait_cqe(&ctx->ring, &cqe);
+	else
+		ret = io_uring_peek_cqe(&ctx->ring, &cqe);
+	if (ret < 0)
+		return ret;
+	uring_slot_t *slot = &ctx->slots[(uintptr_t)io_uring_cqe_get_data(cqe)];
+	slot->result = cqe->res;
+	slot->done = 1;
+	io_uring_cqe_seen(&ctx->ring, cqe);
+	return 0;
+}
+
+static void _uring_read_submit(uring_t *ctx)
+{
+	int nsqe = 0;
+	while (!ctx->eof && ctx->inflight < ctx->depth)
+	{
+		unsigned int index = (ctx->head + ctx->inflight) % ctx->depth;
+		uring_slot_t *slot = &ctx->slots[index];
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+		if (sqe == NULL)
+			break;
+		slot->offset = ctx->offset;
+		slot->length = ctx->size;
+		slot->done = 0;
+		io_uring_prep_read_fixed(sqe, ctx->fd, slot->buffer, slot->length, slot->offset, index);
+		io_uring_sqe_set_data(sqe, (void *)(uintptr_t)index);
+		ctx->offset += slot->length;
+		ctx->inflight++;
+		nsqe++;
+	}
+	if (nsqe > 0)
+		io_uring_submit(&ctx->ring);
+}
+
+static void _uring_release(uring_t *ctx)
+{
+	ctx->head = (ctx->head + 1) % ctx->depth;
+	ctx->inflight--;
+	ctx->consumed = 0;
+}
+
+int uring_read(uring_t *ctx, unsigned char *buff, size_t len)
+{
+	while (1)
+	{
+		_uring_read_submit(ctx);
+		if (ctx->inflight == 0)
+			return 0;
+		uring_slot_t *slot = &ctx->slots[ctx->head];
+		while (!slot->done)
+		{
+			int ret = _uring_complete(ctx, 1);
+			if (ret < 0 && ret != -EINTR)
+			{
+				errno = -ret;
+				return -1;
+			}
+		}
+		if (slot->offset + ctx->consumed != ctx->readoffset)
+		{
+			/**
+			 * a previous request returned less data than requested,
+			 * this one has to be sent again at the right offset.
+			 */
+			uring_dbg("uring: drop request at %ld", slot->offset);
+			_uring_release(ctx);
+			continue;
+		}
+		if (slot->result < 0)
+		{
+			errno = -slot->result;
+			_uring_release(ctx);
+			return -1;
+		}
+		if (slot->result == 0)
+		{
+			ctx->eof = 1;
+			_uring_release(ctx);
+			continue;
+		}
+		size_t length = slot->result - ctx->consumed;
+		if (length > len)
+			length = len;
+		memcpy(buff, slot->buffer + ctx->consumed, length);
+		ctx->consumed += length;
+		ctx->readoffset += length;
+		if (ctx->consumed == slot->result)
+		{
+			if (slot->result < slot->length)
+				ctx->offset = ctx->readoffset;
+			_uring_release(ctx);
+		}
+		return length;
+	}
+	return -1;
+}
+
+static int _uring_write_complete(uring_t *ctx, int wait)
+{
+	while (ctx->inflight > 0)
+	{
+		uring_slot_t *slot = &ctx->slots[ctx->head];
+		while (!slot->done)
+		{
+			int ret = _uring_complete(ctx, wait);
+			if (ret == -EAGAIN)
+				return 0;
+			if (ret < 0 && ret != -EINTR)
+			{
+				errno = -ret;
+				return -1;
+			}
+		}
+		if (slot->result < 0)
+		{
+			errno = -slot->result;
+			_uring_release(ctx);
+			return -1;
+		}
+		if (slot->result < slot->length)
+		{
+			/**
+			 * short write, the end is written synchronously
+			 */
+			ssize_t ret = pwrite(ctx->fd, slot->buffer + slot->result,
+						slot->length - slot->result, slot->offset + slot->result);
+			if (ret < 0)
+			{
+				_uring_release(ctx);
+				return -1;
+			}
+		}
+		_uring_release(ctx);
+	}
+	return 0;
+}
+
+int uring_write(uring_t *ctx, const unsigned char *buff, size_t len)
+{
+	size_t ret = 0;
+	while (ret < len)
+	{
+		if (_uring_write_complete(ctx, 0) < 0)
+			return -1;
+		if (ctx->inflight == ctx->depth)
+		{
+			uring_slot_t *slot = &ctx->slots[ctx->head];
+			while (!slot->done)
+			{
+				int error = _uring_complete(ctx, 1);
+				if (error < 0 && error != -EINTR)
+				{
+					errno = -error;
+					return -1;
+				}
+			}
+			continue;
+		}
+		unsigned int index = (ctx->head + ctx->inflight) % ctx->depth;
+		uring_slot_t *slot = &ctx->slots[index];
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+		if (sqe == NULL)
+		{
+			io_uring_submit(&ctx->ring);
+			continue;
+		}
+		slot->length = len - ret;
+		if (slot->length > ctx->size)
+			slot->length = ctx->size;
+		slot->offset = ctx->offset;
+		slot->done = 0;
+		memcpy(slot->buffer, buff + ret, slot->length);
+		io_uring_prep_write_fixed(sqe, ctx->fd, slot->buffer, slot->length, slot->offset, index);
+		io_uring_sqe_set_data(sqe, (void *)(uintptr_t)index);
+		io_uring_submit(&ctx->ring);
+		ctx->offset += slot->length;
+		ctx->inflight++;
+		ret += slot->length;
+	}
+	uring_dbg("uring: write %lu bytes, %u requests", len, ctx->inflight);
+	return ret;
+}
+
+int uring_flush(uring_t *ctx)
+{
+	return _uring_write_complete(ctx, 1);
+}
+
+void uring_destroy(uring_t *ctx)
+{
+	while (ctx->inflight > 0)
+	{
+		uring_slot_t *slot = &ctx->slots[ctx->head];
+		if (!slot->done && _uring_complete(ctx, 1) < 0)
+			break;
+		if (slot->done)
+			_uring_release(ctx);
+	}
+	io_uring_unregister_buffers(&ctx->ring);
+	io_uring_queue_exit(&ctx->ring);
+	free(ctx->slots);
+	free(ctx->buffers);
+	free(ctx);
+}
@@ -0,0 +1,21 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+typedef struct uring_s uring_t;
+
+/**
+ * io_uring requests on a regular file.
+ * "depth" requests of "size" bytes are kept in flight into registered buffers.
+ * NULL is returned when io_uring is not available, the caller keeps
+ * the synchronous path.
+ */
+uring_t *uring_init(int fd, unsigned int depth, size_t size);
+/// read the next data of the file, 0 on end of file
+int uring_read(uring_t *ctx, unsigned char *buff, size_t len);
+/// queue data at the end of the previous write
+int uring_write(uring_t *ctx, const unsigned char *buff, size_t len);
+/// wait the end of all write requests
+int uring_flush(uring_t *ctx);
+void uring_destroy(uring_t *ctx);
+
+#endif